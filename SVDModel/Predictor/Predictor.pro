@@ -90,7 +90,8 @@ SOURCES += \
     dnnshell.cpp \
     batchdnn.cpp \
     inputtensoritem.cpp \
-    fetchdata.cpp
+    fetchdata.cpp \
+    inferenceservice.cpp
 
 HEADERS += \
     predictortest.h \
@@ -103,7 +104,8 @@ HEADERS += \
     dnnshell.h \
     batchdnn.h \
     inputtensoritem.h \
-    fetchdata.h
+    fetchdata.h \
+    inferenceservice.h
 unix {
     target.path = /usr/lib
     INSTALLS += target
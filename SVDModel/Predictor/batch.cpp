@@ -32,6 +32,7 @@ Batch::Batch(size_t batch_size)
     mError=false;
     mType = Invalid;
     mModule = nullptr;
+    mModel = nullptr;
     mPackageId=0;
     mCells.resize(mBatchSize);
 }
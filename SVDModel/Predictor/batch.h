@@ -23,11 +23,14 @@
 #include <atomic>
 #include <vector>
 
+#include "randomgen.h"
+
 //#include "inferencedata.h"
 
 class BatchManager; // forward
 class Cell; // forward
 class Module; // forward
+class Model; // forward
 
 class Batch
 {
@@ -49,6 +52,11 @@ public:
     void setPackageId(int id) { mPackageId = id; }
     void setModule(Module *module) { mModule = module; }
     Module *module() const { return mModule; }
+    /// the model the batch belongs to (the results of the DNN are written in the context of this model)
+    void setModel(Model *model) { mModel = model; }
+    Model *model() const { return mModel; }
+    /// random numbers for processing the batch in a worker thread (seeded by the ModelShell in the order of the batches)
+    RandomGenerator &random() { return mRandom; }
     size_t batchSize() const { return mBatchSize; }
 
     /// get slot number in the batch (atomic access)
@@ -82,6 +90,8 @@ protected:
     std::vector< Cell* > mCells;
     /// the handling module if present
     Module *mModule;
+    Model *mModel;
+    RandomGenerator mRandom;
     friend class BatchManager;
 };
 
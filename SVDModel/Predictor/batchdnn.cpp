@@ -26,11 +26,9 @@
 
 #include "dnn.h"
 #include "fetchdata.h"
+#include "batchmanager.h"
 #include "statechangeout.h"
 
-// static decl
-StateChangeOut *BatchDNN::mSCOut = nullptr;
-
 BatchDNN::BatchDNN(size_t batch_size) : Batch(batch_size)
 {
     mType = DNN;
@@ -93,9 +91,10 @@ void BatchDNN::processResults()
 bool BatchDNN::fetchPredictors(Cell *cell, size_t slot)
 {
     inferenceData(slot).fetchData(cell, this, slot); // the old way
+    BatchManager *manager = BatchManager::instance();
     for (auto &t : DNN::tensorDefinition()) {
         try {
-        t.mFetch->fetch(cell, this, slot);
+        t.mFetch->fetch(cell, this, slot, manager->fetchState(t.index));
         } catch (const std::logic_error &e) {
             throw std::logic_error("Error fetching data for tensor: " + t.name + ": " + e.what());
         }
@@ -55,8 +55,8 @@ private:
     size_t chooseProbabilisticIndex(float *values, size_t n);
 
     // state change output specific
-    /// link to detailed output
-    static StateChangeOut *mSCOut;
+    /// link to detailed output (of the model of the batch)
+    StateChangeOut *mSCOut;
     std::string stateChangeOutput(size_t index);
 
     /// the data for the individual cells
@@ -18,6 +18,8 @@
 ********************************************************************************************/
 #include "batchmanager.h"
 #include "batchdnn.h"
+#include "dnn.h"
+#include "fetchdata.h"
 #include "tensorhelper.h"
 
 #include "model.h"
@@ -41,9 +43,15 @@ BatchManager *BatchManager::mInstance = nullptr;
 
 BatchManager::BatchManager()
 {
-    if (mInstance!=nullptr)
+    // the batch manager belongs to the current model; the batch manager of the first model is the global instance
+    Model *model = Model::hasInstance() ? Model::instance() : nullptr;
+    if (!model && mInstance!=nullptr)
         throw std::logic_error("Creation of batch manager: instance ptr is not 0.");
-    mInstance = this;
+    mModel = model;
+    if (model)
+        model->setBatchManager(this);
+    if (mInstance==nullptr)
+        mInstance = this;
     if (spdlog::get("dnn"))
         spdlog::get("dnn")->debug("Batch manager created: {}", static_cast<void*>(this));
 
@@ -58,7 +66,18 @@ BatchManager::~BatchManager()
     if (auto lg = spdlog::get("dnn"))
         lg->debug("Batch manager destroyed: {x}", static_cast<void*>(this));
 
-    mInstance = nullptr;
+    if (mModel && Model::hasInstance() && Model::instance()==mModel && mModel->batchManager()==this)
+        mModel->setBatchManager(nullptr);
+    if (mInstance==this)
+        mInstance = nullptr;
+}
+
+BatchManager *BatchManager::instance()
+{
+    if (Model::hasInstance() && Model::instance()->batchManager())
+        return Model::instance()->batchManager();
+    assert(mInstance!=nullptr);
+    return mInstance;
 }
 
 void BatchManager::setup()
@@ -78,6 +97,22 @@ void BatchManager::setup()
 void BatchManager::newYear()
 {
     mSlotRequested = false;
+    if (mFetchStates.size() != DNN::tensorDefinition().size())
+        setupFetchStates();
+    // let the data extractors prepare data for the new year (e.g. distance grids)
+    for (const auto &item : DNN::tensorDefinition())
+        if (item.mFetch)
+            item.mFetch->newYear(fetchState(item.index));
+}
+
+void BatchManager::setupFetchStates()
+{
+    // the tensor definition is shared by all models, the data that changes during the simulation is kept per model
+    mFetchStates.clear();
+    mFetchStates.resize(DNN::tensorDefinition().size());
+    for (const auto &item : DNN::tensorDefinition())
+        if (item.mFetch)
+            mFetchStates[item.index].reset(item.mFetch->createState());
 }
 
 static std::mutex batch_mutex;
@@ -144,6 +179,7 @@ std::pair<Batch *, size_t> BatchManager::findValidSlot(Module *module)
         // create a new batch; the default (forest) is a batch for DNN
         batch = createBatch(module ? module->batchType() : Batch::DNN);
         batch->setModule(module);
+        batch->setModel(mModel);
         mBatches.push_back( batch );
         lg->trace("created a new batch. Now the list contains {} batch(es).", mBatches.size());
         /*if ( lg->should_log(spdlog::level::trace) ) {
@@ -21,6 +21,7 @@
 
 #include <utility>
 #include <list>
+#include <vector>
 #include <cassert>
 #include <memory>
 #include "spdlog/spdlog.h"
@@ -31,6 +32,8 @@
 class BatchDNN;  // forward
 class TensorWrapper; // forward
 class Module; // forward
+class Model; // forward
+class FetchState; // forward
 
 
 
@@ -45,9 +48,8 @@ public:
 
     /// access to the currently avaialable BatchManager
     /// this allows accessing the model with BatchManager::instance()->....
-    static BatchManager *instance() {
-        assert(mInstance!=nullptr);
-        return mInstance; }
+    /// This is the batch manager of the current model (see Model::batchManager()), or the global batch manager.
+    static BatchManager *instance();
     static bool hasInstance() { return mInstance != nullptr; }
     size_t batchSize() const { return mBatchSize; }
 
@@ -61,6 +63,9 @@ public:
 
     bool slotsRequested() const { return mSlotRequested; }
 
+    /// the data of input tensor 'tensor_index' that belongs to the model of the batch manager (see FetchData::createState())
+    FetchState *fetchState(size_t tensor_index) const { return mFetchStates[tensor_index].get(); }
+
 private:
     size_t mBatchSize;
     size_t mMaxQueueLength;
@@ -69,6 +74,10 @@ private:
     Batch *createBatch(Batch::BatchType type);
     std::pair<Batch *, size_t> findValidSlot(Module *module);
     std::list<Batch *> mBatches;
+    /// create the model specific data of the input tensors
+    void setupFetchStates();
+    std::vector< std::unique_ptr<FetchState> > mFetchStates; ///< model specific data of the input tensors (indexed by tensor)
+    Model *mModel; ///< the model the batch manager belongs to
     static BatchManager *mInstance;
 
     // logging
@@ -32,10 +32,13 @@
 // Tensorflow includes
 //  from inception demo
 #include <fstream>
+#include <cstring>
 #include <vector>
 #include <iomanip>
 
 #include <queue>
+#include <unordered_map>
+#include <unordered_set>
 
 #pragma warning(push, 0)
 //Some includes with unfixable warnings: https://stackoverflow.com/questions/2541984/how-to-suppress-warnings-in-external-headers-in-visual-c
@@ -58,6 +61,10 @@
 #include "tensorflow/core/public/session.h"
 #include "tensorflow/core/util/command_line_flags.h"
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/platform/env.h"
 
 #pragma warning(pop)
 
@@ -76,29 +83,91 @@ using tensorflow::Status;
 using tensorflow::string;
 using tensorflow::int32;
 
-// Reads a model graph definition from disk, and creates a session object you
-// can use to run it.
-Status LoadGraph(string graph_file_name,
-                 tensorflow::Session* session) {
-  tensorflow::GraphDef graph_def;
-  Status load_graph_status =
-      ReadBinaryProto(tensorflow::Env::Default(), graph_file_name, &graph_def);
-  if (!load_graph_status.ok()) {
-    return tensorflow::errors::NotFound("Failed to load compute graph at '",
-                                        graph_file_name, "'");
-  }
-  //session->reset(tensorflow::NewSession(tensorflow::SessionOptions()));
-  Status session_create_status = session->Create(graph_def);
-  if (!session_create_status.ok()) {
-    return session_create_status;
-  }
-
-
-
-  return Status::OK();
+// FNV-1a hash over the content of a file. Used as a key for the graph cache,
+// i.e. a changed network file leads to a new cache entry.
+static uint64_t hashFileContent(const std::string &file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    if (!in.is_open())
+        return 0;
+    uint64_t hash = 14695981039346656037ULL;
+    std::vector<char> buffer(1 << 16);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize n = in.gcount();
+        for (std::streamsize i=0;i<n;++i) {
+            hash ^= static_cast<unsigned char>(buffer[static_cast<size_t>(i)]);
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+// extract the node name from a node input (e.g. "^name" or "name:1")
+static std::string graphNodeName(const std::string &input)
+{
+    size_t start = (!input.empty() && input[0]=='^') ? 1 : 0;
+    size_t pos = input.find(':', start);
+    return input.substr(start, pos==std::string::npos ? std::string::npos : pos - start);
 }
 
+// the number of examples in the batches evaluated by the network: with the inference service,
+// the network evaluates combined batches (dnn.service.batchSize), otherwise the batches of the model (dnn.batchSize)
+static size_t networkBatchSize()
+{
+    size_t service_batch_size = Model::instance()->settings().valueUInt("dnn.service.batchSize", 0);
+    return service_batch_size > 0 ? service_batch_size : BatchManager::instance()->batchSize();
+}
 
+// Remove all nodes from 'graph_def' that are not required to calculate 'output_names'
+// (placeholders are always kept, as they are fed by SVD). The unknown batch dimension
+// of the placeholders is fixed to 'batch_size', which allows static shape inference.
+static size_t pruneGraph(tensorflow::GraphDef &graph_def, const std::vector<std::string> &output_names, int batch_size)
+{
+    std::unordered_map<std::string, const tensorflow::NodeDef*> nodes;
+    std::vector<std::string> stack;
+    for (const auto &node : graph_def.node()) {
+        nodes[node.name()] = &node;
+        if (node.op() == "Placeholder")
+            stack.push_back(node.name());
+    }
+    for (const auto &name : output_names)
+        stack.push_back(graphNodeName(name));
+
+    std::unordered_set<std::string> keep;
+    while (!stack.empty()) {
+        std::string name = stack.back();
+        stack.pop_back();
+        if (!keep.insert(name).second)
+            continue;
+        auto it = nodes.find(name);
+        if (it == nodes.end())
+            continue;
+        for (const auto &input : it->second->input())
+            stack.push_back(graphNodeName(input));
+    }
+
+    tensorflow::GraphDef pruned;
+    *pruned.mutable_versions() = graph_def.versions();
+    *pruned.mutable_library() = graph_def.library();
+    for (const auto &node : graph_def.node()) {
+        if (keep.find(node.name()) == keep.end())
+            continue;
+        tensorflow::NodeDef *new_node = pruned.add_node();
+        *new_node = node;
+        if (node.op() == "Placeholder" && batch_size > 0) {
+            auto shape_it = new_node->mutable_attr()->find("shape");
+            if (shape_it != new_node->mutable_attr()->end() && shape_it->second.has_shape()) {
+                tensorflow::TensorShapeProto *shape = shape_it->second.mutable_shape();
+                if (!shape->unknown_rank() && shape->dim_size()>0 && shape->dim(0).size()<0)
+                    shape->mutable_dim(0)->set_size(batch_size);
+            }
+        }
+    }
+    size_t n_removed = static_cast<size_t>(graph_def.node_size() - pruned.node_size());
+    graph_def.Swap(&pruned);
+    return n_removed;
+}
 
 DNN::DNN()
 {
@@ -143,6 +212,9 @@ bool DNN::setupDNN(size_t aindex)
          mNStateCls = Model::instance()->states()->states().size(); // default: number of states
 
     mNResTimeCls = settings.valueUInt("dnn.restime.N");
+    std::string cache_dir = settings.hasKey("dnn.graphCache") ? settings.valueString("dnn.graphCache") : "";
+    if (!cache_dir.empty())
+        cache_dir = Tools::path(cache_dir);
 
 
     lg->info("DNN file: '{}'", file);
@@ -178,7 +250,7 @@ bool DNN::setupDNN(size_t aindex)
     session = tensorflow::NewSession(opts); // no specific options: tensorflow::SessionOptions()
 
     lg->trace("attempting to load the graph...");
-    Status load_graph_status = LoadGraph(file, session);
+    Status load_graph_status = loadGraph(file, cache_dir);
     if (!load_graph_status.ok()) {
         lg->error("Error loading the graph: {}", load_graph_status.error_message().data());
         return false;
@@ -189,7 +261,7 @@ bool DNN::setupDNN(size_t aindex)
         lg->trace("build the top-k graph...");
         // output_classes = new tensorflow::Tensor(dt, tensorflow::TensorShape({ static_cast<int>(mBatchSize), static_cast<int>(1418)}));
         //output_classes = new tensorflow::Input();
-        int bs = static_cast<int>( BatchManager::instance()->batchSize() );
+        int bs = static_cast<int>( networkBatchSize() );
         // number of classes:
         int ncls = static_cast<int>( mNStateCls );
         Tensor top_k_tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({bs, ncls}));
@@ -276,6 +348,98 @@ bool DNN::setupDNN(size_t aindex)
 
 }
 
+tensorflow::Status DNN::loadGraph(const std::string &file_name, const std::string &cache_dir)
+{
+    tensorflow::GraphDef graph_def;
+    std::string cache_file;
+    bool from_cache = false;
+    if (!cache_dir.empty()) {
+        // the cache key includes the network file, the output layers and the batch size
+        uint64_t key = hashFileContent(file_name);
+        for (const auto &name : mOutputTensorNames)
+            for (char c : name)
+                key = (key ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        cache_file = fmt::format("{}/svd_graph_{:016x}_bs{}.pb", cache_dir, key, networkBatchSize());
+        if (Tools::fileExists(cache_file)) {
+            Status cache_status = ReadBinaryProto(tensorflow::Env::Default(), cache_file, &graph_def);
+            if (cache_status.ok()) {
+                lg->info("Loaded DNN graph from cache: '{}' ({} nodes).", cache_file, graph_def.node_size());
+                from_cache = true;
+            } else {
+                lg->warn("Could not read graph cache file '{}' ({}); loading '{}'.", cache_file, cache_status.error_message(), file_name);
+                graph_def.Clear();
+            }
+        }
+    }
+
+    if (!from_cache) {
+        Status load_graph_status = ReadBinaryProto(tensorflow::Env::Default(), file_name, &graph_def);
+        if (!load_graph_status.ok())
+            return tensorflow::errors::NotFound("Failed to load compute graph at '", file_name, "'");
+
+        if (!cache_dir.empty()) {
+            size_t n_removed = pruneGraph(graph_def, mOutputTensorNames, static_cast<int>(networkBatchSize()));
+            lg->debug("Pruned DNN graph: removed {} nodes, {} nodes left.", n_removed, graph_def.node_size());
+        }
+    }
+
+    Status session_create_status = session->Create(graph_def);
+    if (!session_create_status.ok())
+        return session_create_status;
+
+    // write the cache only after the session accepted the graph
+    if (!cache_dir.empty() && !from_cache) {
+        tensorflow::Env::Default()->RecursivelyCreateDir(cache_dir);
+        Status write_status = WriteBinaryProto(tensorflow::Env::Default(), cache_file, graph_def);
+        if (write_status.ok())
+            lg->info("Stored DNN graph in cache: '{}'.", cache_file);
+        else
+            lg->warn("Could not write graph cache file '{}': {}", cache_file, write_status.error_message());
+    }
+
+    return Status::OK();
+}
+
+bool DNN::warmup(size_t n_passes)
+{
+    if (mDummyDNN || n_passes==0 || !session)
+        return true;
+
+    auto start_time = std::chrono::system_clock::now();
+    size_t batch_size = networkBatchSize();
+
+    // build zero-filled input tensors with the full batch size
+    std::vector<std::unique_ptr<TensorWrapper> > tensors;
+    std::vector<std::pair<string, Tensor> > inputs;
+    for (auto &def : mTensorDef) {
+        tensors.push_back(std::unique_ptr<TensorWrapper>(buildTensor(batch_size, def)));
+        Tensor &t = tensors.back()->tensor();
+        auto data = t.tensor_data();
+        memset(const_cast<char*>(data.data()), 0, data.size());
+        inputs.push_back(std::pair<string, Tensor>(def.name, t));
+    }
+
+    std::vector<Tensor> outputs;
+    std::vector<Tensor> topk_output;
+    for (size_t i=0;i<n_passes;++i) {
+        Status run_status = session->Run(inputs, mOutputTensorNames, {}, &outputs);
+        if (!run_status.ok()) {
+            lg->error("DNN #{}: Tensorflow error during warm-up (main network): {}", mIndex, run_status.error_message());
+            return false;
+        }
+        if (mTopK_tf && top_k_session && outputs.size()>0) {
+            run_status = top_k_session->Run({ {"Const/Const" , outputs[0]} }, {"top_k:0", "top_k:1"}, {}, &topk_output);
+            if (!run_status.ok()) {
+                lg->error("DNN #{}: Tensorflow error during warm-up (top-k): {}", mIndex, run_status.error_message());
+                return false;
+            }
+        }
+    }
+    lg->info("DNN #{}: warm-up with {} passes (batch size {}) finished in {}ms.", mIndex, n_passes, batch_size,
+             std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start_time).count());
+    return true;
+}
+
 class STimer {
 public:
     STimer(std::shared_ptr<spdlog::logger> logger, std::string name) { start_time = std::chrono::system_clock::now(); _logger=logger; _name=name; }
@@ -296,18 +460,36 @@ Batch * DNN::run(Batch *abatch)
     BatchDNN *batch = dynamic_cast<BatchDNN*>(abatch);
     if (!batch)
         throw std::logic_error("DNN:run: invalid Batch!");
+
+    std::vector<TensorWrapper*> inputs;
+    for (size_t tindex=0; tindex<tensorDefinition().size(); ++tindex)
+        inputs.push_back(batch->tensor(tindex));
+    std::vector<std::pair<BatchDNN*, size_t> > targets;
+    for (size_t i=0;i<batch->usedSlots();++i)
+        targets.push_back(std::pair<BatchDNN*, size_t>(batch, i));
+
+    if (!infer(inputs, batch->batchSize(), targets, batch->packageId())) {
+        batch->setError(true);
+        return batch;
+    }
+    batch->changeState(Batch::FinishedDNN);
+    return batch;
+}
+
+bool DNN::infer(std::vector<TensorWrapper *> &input_tensors, size_t batch_size, const std::vector<std::pair<BatchDNN *, size_t> > &targets, int package_id)
+{
 #ifdef CUDA_PROFILING
     cudaProfilerStart();
 #endif
     std::vector<Tensor> outputs;
-    STimer timr(lg, "DNN::run:" + to_string(batch->packageId()));
-    lg->debug("DNN#{}: started execution for package {}.", mIndex, batch->packageId());
+    STimer timr(lg, "DNN::run:" + to_string(package_id));
+    lg->debug("DNN#{}: started execution for package {}.", mIndex, package_id);
 
     std::vector<std::pair<string, Tensor> > inputs;
     const std::list<InputTensorItem> &tdef = tensorDefinition();
     size_t tindex=0;
     for (const auto &def : tdef) {
-        inputs.push_back( std::pair<string, Tensor>( def.name, batch->tensor(tindex)->tensor() ));
+        inputs.push_back( std::pair<string, Tensor>( def.name, input_tensors[tindex]->tensor() ));
         tindex++;
     }
 
@@ -316,17 +498,20 @@ Batch * DNN::run(Batch *abatch)
         lg->debug("DNN in debug mode... no action");
         // wait a bit...
         //std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        // ... and produce a random result
-        for (size_t i=0;i<batch->usedSlots();++i) {
-            InferenceData &id=batch->inferenceData(i);
+        // ... and produce a random result (with a generator of the package: the DNN runs concurrently with the models)
+        RandomGenerator random(static_cast<uint64_t>(package_id));
+        RandomScope random_scope(&random);
+        for (const auto &target : targets) {
+            // the batches may belong to different models (inference service)
+            ModelScope scope(target.first->model());
+            InferenceData &id=target.first->inferenceData(target.second);
             // just random ....
             const State &s = Model::instance()->states()->randomState();
             restime_t rt = static_cast<restime_t>(Model::instance()->year()+irandom(1,12));
             id.setResult(s.id(), rt);
 
         }
-        batch->changeState(Batch::FinishedDNN);
-        return batch;
+        return true;
     }
 
     /* Run Tensorflow */
@@ -335,10 +520,10 @@ Batch * DNN::run(Batch *abatch)
 
     Status run_status = session->Run(inputs, mOutputTensorNames, {}, &outputs);
     if (!run_status.ok()) {
-        lg->trace("{}", batch->inferenceData(0).dumpTensorData());
+        if (!targets.empty())
+            lg->trace("{}", targets.front().first->inferenceData(targets.front().second).dumpTensorData());
         lg->error("Tensorflow error (run main network): {}", run_status.error_message());
-        batch->setError(true);
-        return batch;
+        return false;
     }
     timr.print("main dnn");
     //timr.now();
@@ -348,8 +533,7 @@ Batch * DNN::run(Batch *abatch)
         lg->error("Wrong number of dimensions of DNN outputs. Number of output tensors: '{}' (expected: 2), Classes state: '{}' (expected: {}); classes residence time: '{}' (expected: {}).",
                   outputs.size(), outputs.size()>0 ? outputs[0].dim_size(1) : 0, mNStateCls,
                   outputs.size()>1 ? outputs[1].dim_size(1) : 0 , mNResTimeCls);
-        batch->setError(true);
-        return batch;
+        return false;
     }
 
     tensorflow::Tensor *scores= nullptr;
@@ -361,10 +545,10 @@ Batch * DNN::run(Batch *abatch)
         run_status = top_k_session->Run({ {"Const/Const" , outputs[0]} }, {"top_k:0", "top_k:1"},
         {}, &topk_output);
         if (!run_status.ok()) {
-            lg->trace("{}", batch->inferenceData(0).dumpTensorData());
+            if (!targets.empty())
+                lg->trace("{}", targets.front().first->inferenceData(targets.front().second).dumpTensorData());
             lg->error("Tensorflow error (run top-k): {}", run_status.error_message());
-            batch->setError(true);
-            return batch;
+            return false;
         }
         timr.print("topk dnn");
         scores = &topk_output[0];
@@ -372,11 +556,11 @@ Batch * DNN::run(Batch *abatch)
     } else {
         // use CPU to extract top-k results
         // outputs[0] is the output tensor with the state probabilities
-        scores = new Tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({  static_cast<long long>(batch->batchSize()), static_cast<long long>(mTopK_NClasses)}));
-        indices = new Tensor(tensorflow::DT_INT32, tensorflow::TensorShape({  static_cast<long long>(batch->batchSize()), static_cast<long long>(mTopK_NClasses)}));
+        scores = new Tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({  static_cast<long long>(batch_size), static_cast<long long>(mTopK_NClasses)}));
+        indices = new Tensor(tensorflow::DT_INT32, tensorflow::TensorShape({  static_cast<long long>(batch_size), static_cast<long long>(mTopK_NClasses)}));
 
         // run the top-k on CPU
-        getTopClasses(outputs[0], batch->batchSize(), mTopK_NClasses, indices, scores);
+        getTopClasses(outputs[0], batch_size, mTopK_NClasses, indices, scores);
         timr.print("topk cpu");
 
 
@@ -387,7 +571,7 @@ Batch * DNN::run(Batch *abatch)
 #endif
 
 
-    lg->debug("DNN result (#{}): {} output tensors. package {}, {} slots.", mIndex, outputs.size(), batch->packageId(), batch->usedSlots());
+    lg->debug("DNN result (#{}): {} output tensors. package {}, {} slots.", mIndex, outputs.size(), package_id, targets.size());
     lg->debug("out:  {}", outputs[0].DebugString());
     lg->debug("time: {}", outputs[1].DebugString());
     // output tensors: 2dim; 1x batch, 1x data
@@ -398,12 +582,16 @@ Batch * DNN::run(Batch *abatch)
     TensorWrap2d<float> scores_flat(*scores);
     TensorWrap2d<int32> indices_flat(*indices);
 
-    // Copy the results of the TopK (states, probabilities, residence times) to the batch
-    for (size_t i=0; i<batch->usedSlots(); ++i) {
+    // Copy the results of the TopK (states, probabilities, residence times) to the target slots
+    for (size_t i=0; i<targets.size(); ++i) {
+        BatchDNN *batch = targets[i].first;
+        size_t slot = targets[i].second;
+        // the batches may belong to different models (inference service): use the states of the model of the batch
+        ModelScope scope(batch->model());
         float *ostate = scores_flat.example(i);
-        float *tstate = batch->stateProbResult(i);
+        float *tstate = batch->stateProbResult(slot);
         int *oidx = indices_flat.example(i);
-        state_t *tidx = batch->stateResult(i);
+        state_t *tidx = batch->stateResult(slot);
         for (size_t r=0;r<mTopK_NClasses;++r) {
 
             *tstate++ = *ostate++;
@@ -413,7 +601,7 @@ Batch * DNN::run(Batch *abatch)
         }
 
         float *otime = out_time.example(i);
-        float *ttime = batch->timeProbResult(i);
+        float *ttime = batch->timeProbResult(slot);
         for (size_t r=0;r<mNResTimeCls;++r) {
             *ttime++ = *otime++;
         }
@@ -426,9 +614,8 @@ Batch * DNN::run(Batch *abatch)
         delete indices;
     }
 
-    lg->debug("DNN::run finished; package {}", batch->packageId());
-    batch->changeState(Batch::FinishedDNN);
-    return batch;
+    lg->debug("DNN::run finished; package {}", package_id);
+    return true;
 }
 
 void DNN::setupInput()
@@ -573,6 +760,12 @@ TensorWrapper *DNN::buildTensor(size_t batch_size, InputTensorItem &item)
 
 
 
+void DNN::setupTensors(size_t batch_size, std::vector<TensorWrapper *> &tensors)
+{
+    for (auto &td : mTensorDef)
+        tensors.push_back(buildTensor(batch_size, td));
+}
+
 void DNN::setupBatch(Batch *abatch, std::vector<TensorWrapper *> &tensors)
 {
     BatchDNN *batch = dynamic_cast<BatchDNN*>(abatch);
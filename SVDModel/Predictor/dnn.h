@@ -27,6 +27,7 @@ class Status;
 class Input;
 }
 class Batch; // forward
+class BatchDNN; // forward
 
 #include "inputtensoritem.h"
 #include "tensorhelper.h"
@@ -45,12 +46,24 @@ public:
     /// set up the links to the main model
     static void setupInput();
 
+    /// run the network 'n_passes' times with zero-filled input tensors of the full batch size.
+    /// This forces TensorFlow to initialize kernels and allocators before the first real batch.
+    /// Requires that the input tensors are already set up (setupInput()).
+    bool warmup(size_t n_passes);
+
     static void setupBatch(Batch *abatch, std::vector<TensorWrapper*> &tensors);
+    /// create input tensors (one for each tensor definition) for 'batch_size' examples
+    static void setupTensors(size_t batch_size, std::vector<TensorWrapper*> &tensors);
 
     /// DNN main function: execute the DNN inference for the
     /// examples provided in 'batch'.
     Batch *run(Batch *abatch);
 
+    /// execute the inference for the 'input_tensors' (with 'batch_size' examples, see setupTensors()).
+    /// The results for the example i are written to the slot targets[i].second of the batch targets[i].first;
+    /// i.e., the examples can stem from different batches. Returns false if an error occurred.
+    bool infer(std::vector<TensorWrapper*> &input_tensors, size_t batch_size, const std::vector<std::pair<BatchDNN*, size_t> > &targets, int package_id);
+
     // getters
     /// the definition of the tensors to fill
     static const std::list<InputTensorItem> &tensorDefinition() {return mTensorDef; }
@@ -59,6 +72,9 @@ public:
 private:
 
     static TensorWrapper *buildTensor(size_t batch_size, InputTensorItem &item);
+    /// load the graph from 'file_name' and create the session. If 'cache_dir' is not empty,
+    /// the pruned graph is stored in / loaded from the cache directory.
+    tensorflow::Status loadGraph(const std::string &file_name, const std::string &cache_dir);
     // logging
     std::shared_ptr<spdlog::logger> lg;
 
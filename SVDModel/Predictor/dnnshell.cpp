@@ -28,19 +28,26 @@
 #include "randomgen.h"
 #include "model.h"
 #include "batch.h"
+#include "batchdnn.h"
 #include "batchmanager.h"
 #include "dnn.h"
+#include "inferenceservice.h"
 
 
 
 DNNShell::DNNShell()
 {
     mThreads = new QThreadPool();
+    mModel = nullptr;
+    mSharedShell = nullptr;
 }
 
 DNNShell::~DNNShell()
 {
-    delete_and_clear(mDNNs);
+    // finish pending batches before the networks are deleted
+    mService.reset();
+    if (!mSharedShell)
+        delete_and_clear(mDNNs);
     delete mThreads;
 
 }
@@ -55,6 +62,9 @@ void DNNShell::setup(QString fileName)
 
     // setup is called *after* the set up of the main model
     lg = spdlog::get("dnn");
+    if (!mModel)
+        mModel = Model::instance();
+    ModelScope scope(mModel);
 
     if (lg)
         lg->info("DNN Setup, config file: {}", fileName.toStdString());
@@ -73,7 +83,14 @@ void DNNShell::setup(QString fileName)
 
     try {
         size_t n_models = Model::instance()->settings().valueUInt("dnn.count", 1);
-        lg->info("DNN Setup, starting '{}' DNN instances....", n_models);
+        if (mSharedShell) {
+            // the networks are thread safe and used by both shells
+            mDNNs = mSharedShell->mDNNs;
+            n_models = 0;
+            lg->info("DNN Setup, using the {} DNN instances of the shared model.", mDNNs.size());
+        } else {
+            lg->info("DNN Setup, starting '{}' DNN instances....", n_models);
+        }
         for (size_t i=0;i<n_models;++i) {
             DNN *dnn = new DNN();
             mDNNs.push_back(dnn);
@@ -86,23 +103,53 @@ void DNNShell::setup(QString fileName)
 
         // wait for the model thread to complete model setup before
         // setting up the inputs (which may need data from the model)
-
-        while (RunState::instance()->modelState() == ModelRunState::Creating) {
+        if (RunState::instance()->modelState() == ModelRunState::Creating) {
             lg->trace("waiting for Model thread ...");
-            QThread::msleep(50);
-            QCoreApplication::processEvents();
+            RunState::instance()->waitWhile(RunState::instance()->modelState(), ModelRunState::Creating);
         }
 
-        if (RunState::instance()->modelState() != ModelRunState::ErrorDuringSetup)
-            DNN::setupInput();
-        else
+        if (RunState::instance()->modelState() != ModelRunState::ErrorDuringSetup) {
+            // the definition of the input tensors is shared by replicate models
+            if (!Model::instance()->isReplicate())
+                DNN::setupInput();
+            // run the network(s) a couple of times so that the first batches of the simulation
+            // do not pay for the initialization of TensorFlow kernels and memory allocators
+            const Settings &settings = Model::instance()->settings();
+            size_t n_warmup = settings.hasKey("dnn.warmup") ? settings.valueUInt("dnn.warmup", 1) : 1;
+            for (auto *dnn : mDNNs) {
+                if (!mSharedShell && !dnn->warmup(n_warmup)) {
+                    RunState::instance()->dnnState()=ModelRunState::ErrorDuringSetup;
+                    return;
+                }
+            }
+        } else {
             lg->debug("Error during model setup - setup of DNN interrupted.");
+        }
 
     } catch (const std::exception &e) {
         RunState::instance()->dnnState()=ModelRunState::ErrorDuringSetup;
         lg->error("An error occurred during DNN setup: {}", e.what());
         return;
     }
+    // the inference service combines the batches of replicate models (which share the service)
+    try {
+        const Settings &settings = Model::instance()->settings();
+        if (mSharedShell) {
+            mService = mSharedShell->mService;
+        } else if (!mDNNs.empty() && settings.valueUInt("dnn.service.batchSize", 0) > 0) {
+            size_t service_batch_size = settings.valueUInt("dnn.service.batchSize", 0);
+            if (service_batch_size < mBatchManager->batchSize())
+                throw logic_error_fmt("The batch size of the inference service (dnn.service.batchSize={}) must not be smaller than dnn.batchSize ({}).", service_batch_size, mBatchManager->batchSize());
+            int max_wait = settings.valueInt("dnn.service.maxWait", 5);
+            mService = std::make_shared<InferenceService>(mDNNs, service_batch_size, std::chrono::milliseconds(max_wait));
+            lg->info("Started the inference service (batch size: {}, max. waiting time: {} ms).", service_batch_size, max_wait);
+        }
+    } catch (const std::exception &e) {
+        RunState::instance()->dnnState()=ModelRunState::ErrorDuringSetup;
+        lg->error("An error occurred during setup of the inference service: {}", e.what());
+        return;
+    }
+
     int n_threads = Model::instance()->settings().valueInt("dnn.threads", -1);
     if (n_threads>-1) {
         mThreads->setMaxThreadCount(n_threads);
@@ -117,6 +164,7 @@ void DNNShell::setup(QString fileName)
 
 void DNNShell::doWork(Batch *batch)
 {
+    ModelScope scope(mModel);
 
     RunState::instance()->dnnState() = ModelRunState::Running;
 
@@ -142,8 +190,21 @@ void DNNShell::doWork(Batch *batch)
     mProcessing++;
     lg->debug("DNNShell: received package {}. Starting DNN (batch: {}, state: {}, active threads now: {}, #processing: {}) ", batch->packageId(), static_cast<void*>(batch), batch->state(), mThreads->activeThreadCount(), mProcessing);
 
+    BatchDNN *batch_dnn = dynamic_cast<BatchDNN*>(batch);
+    if (mService && batch_dnn) {
+        // the batch is combined with batches of other models; the result is routed back to this shell
+        mService->submit(batch_dnn, [this](Batch *finished_batch) {
+            if (!QMetaObject::invokeMethod(this, "dnnFinished", Qt::QueuedConnection,
+                                           Q_ARG(void*, static_cast<void*>(finished_batch))) ) {
+                finished_batch->setError(true);
+            }
+        });
+        return;
+    }
+
     QtConcurrent::run( mThreads,
                        [](DNNShell *shell, Batch *batch, DNN *dnn){
+                            ModelScope scope(shell->mModel);
                             dnn->run(batch);
 
                             if (!QMetaObject::invokeMethod(shell, "dnnFinished", Qt::QueuedConnection,
@@ -155,6 +216,7 @@ void DNNShell::doWork(Batch *batch)
 
 void DNNShell::dnnFinished(void *vbatch)
 {
+    ModelScope scope(mModel);
     Batch * batch = static_cast<Batch*>(vbatch);
     mProcessing--;
     // get the batch from the future watcher
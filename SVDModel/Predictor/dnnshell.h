@@ -30,6 +30,8 @@ class InferenceData; // forward
 class Batch; // forward
 class DNN; // forward
 class BatchManager; // forward
+class Model; // forward
+class InferenceService; // forward
 
 class DNNShell: public QObject
 {
@@ -42,6 +44,11 @@ public:
     size_t batchesProcessed() const { return mBatchesProcessed; }
     size_t cellsProcessed() const { return mCellsProcessed; }
 
+    /// the model the shell works for (default: the global model)
+    void setModel(Model *model) { mModel = model; }
+    /// use the networks (and the inference service) of 'source' instead of loading them again (replicate models)
+    void setSharedNetworks(DNNShell *source) { mSharedShell = source; }
+
 private:
 public slots:
     void setup(QString fileName);
@@ -61,6 +68,10 @@ private:
     std::unique_ptr<BatchManager> mBatchManager;
     //std::unique_ptr<DNN> mDNN;
     std::vector<DNN *> mDNNs;
+    Model *mModel;
+    DNNShell *mSharedShell; ///< shell that owns the networks (if not nullptr)
+    /// service that combines the batches of several models (nullptr: batches are run individually)
+    std::shared_ptr<InferenceService> mService;
     std::atomic<size_t> mExecutionCount;
     std::atomic<int> mProcessing;
 
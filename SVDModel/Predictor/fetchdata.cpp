@@ -19,6 +19,10 @@
 #include "fetchdata.h"
 
 #include <regex>
+#include <set>
+#include <numeric>
+#include <limits>
+#include <QtConcurrent>
 
 #include "model.h"
 #include "tensorhelper.h"
@@ -33,7 +37,11 @@ void FetchData::setup(const Settings * /*settings*/, const std::string & /*key*/
 
 }
 
-void FetchData::fetch(Cell * /* cell */, BatchDNN* /*batch */, size_t /* slot */)
+void FetchData::fetch(Cell * /* cell */, BatchDNN* /*batch */, size_t /* slot */, FetchState * /* state */)
+{
+}
+
+void FetchData::newYear(FetchState * /* state */)
 {
 }
 
@@ -71,16 +79,16 @@ void FetchDataStandard::setup(const Settings * /*settings*/, const std::string &
     switch (item.content) {
     case InputTensorItem::SiteNPKA:
         // required columns: availableNitrogen, soilDepth
-        i_nitrogen = indexOf(EnvironmentCell::variables(), "availableNitrogen");
-        i_soildepth = indexOf(EnvironmentCell::variables(), "soilDepth");
-        if (i_nitrogen==-1 || i_soildepth==-1) {
+        col_nitrogen = EnvironmentCell::column("availableNitrogen");
+        col_soildepth = EnvironmentCell::column("soilDepth");
+        if (!col_nitrogen.isValid() || !col_soildepth.isValid()) {
             spdlog::get("dnn")->error("The required columns 'availableNitrogen' and 'soilDepth' are not available in the environment (item: '{}', available: '{}').", item.name, join(EnvironmentCell::variables()));
             throw std::logic_error("Error in setup of SiteNPKA");
         }
         return;
     case InputTensorItem::DistanceOutside:
-            i_distance = indexOf(EnvironmentCell::variables(), "distanceOutside");
-            if (i_distance==-1 ) {
+            col_distance = EnvironmentCell::column("distanceOutside");
+            if (!col_distance.isValid()) {
                 spdlog::get("dnn")->error("The required columns 'distanceOutside' is not available in the environment (item: '{}', available: '{}').", item.name, join(EnvironmentCell::variables()));
                 throw std::logic_error("Error in setup of DistanceOutside");
             }
@@ -90,7 +98,7 @@ void FetchDataStandard::setup(const Settings * /*settings*/, const std::string &
 
 }
 
-void FetchDataStandard::fetch(Cell *cell, BatchDNN *batch, size_t slot)
+void FetchDataStandard::fetch(Cell *cell, BatchDNN *batch, size_t slot, FetchState * /* state */)
 {
     switch (mItem->content) {
     case InputTensorItem::Climate:
@@ -205,8 +213,8 @@ void FetchDataStandard::fetchSite(Cell *cell, BatchDNN* batch, size_t slot)
     // site: nitrogen/soil-depth
     const auto &ec = cell->environment();
     // TODO: transformation...
-    *p++ = static_cast<float>( (ec->value(static_cast<size_t>(i_nitrogen)) -58.500)/41.536 );
-    *p++ = static_cast<float>( (ec->value(static_cast<size_t>(i_soildepth))-58.500)/41.536 );
+    *p++ = static_cast<float>( (col_nitrogen(ec) -58.500)/41.536 );
+    *p++ = static_cast<float>( (col_soildepth(ec)-58.500)/41.536 );
 }
 
 void FetchDataStandard::fetchDistanceOutside(Cell *cell, BatchDNN* batch, size_t slot)
@@ -216,7 +224,7 @@ void FetchDataStandard::fetchDistanceOutside(Cell *cell, BatchDNN* batch, size_t
     float *p = tw->example(slot);
     const auto &ec = cell->environment();
 
-    *p = static_cast<float>( ec->value(static_cast<size_t>(i_distance)) );
+    *p = static_cast<float>( col_distance(ec) );
 
 }
 
@@ -256,7 +264,7 @@ void FetchDataVars::setup(const Settings *settings, const std::string &key, cons
     }
 }
 
-void FetchDataVars::fetch(Cell *cell, BatchDNN *batch, size_t slot)
+void FetchDataVars::fetch(Cell *cell, BatchDNN *batch, size_t slot, FetchState * /* state */)
 {
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
@@ -293,8 +301,22 @@ void FetchDataFunction::setup(const Settings *settings, const std::string &key,
 
 }
 
-void FetchDataFunction::fetch(Cell *cell , BatchDNN *batch, size_t slot)
+FetchState *FetchDataFunction::createState() const
+{
+    SState *state = new SState();
+    if (mFn == SimpleManagement) {
+        state->mgmtModule = dynamic_cast<SimpleManagementModule*>(Model::instance()->module("mgmt"));
+        if (!state->mgmtModule) {
+            delete state;
+            throw logic_error_fmt("Setup of management: the required module 'mgmt' is not available!");
+        }
+    }
+    return state;
+}
+
+void FetchDataFunction::fetch(Cell *cell , BatchDNN *batch, size_t slot, FetchState *state)
 {
+    const SState &s = *static_cast<SState*>(state);
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
     float *p = tw->example(slot);
@@ -302,11 +324,11 @@ void FetchDataFunction::fetch(Cell *cell , BatchDNN *batch, size_t slot)
     float value;
     switch (mFn) {
     case DistToSeedSource:
-        value = calculateDistToSeedSource(cell);
+        value = calculateDistToSeedSource(cell, s);
         break;
     case SimpleManagement: {
         float rActivity, rTime;
-        calculateSimpleManagement(cell, rActivity, rTime);
+        calculateSimpleManagement(cell, s, rActivity, rTime);
         *p++ = rActivity;
         *p = rTime;
         return;
@@ -318,6 +340,12 @@ void FetchDataFunction::fetch(Cell *cell , BatchDNN *batch, size_t slot)
 
 }
 
+void FetchDataFunction::newYear(FetchState *state)
+{
+    if (mFn == DistToSeedSource)
+        updateDistToSeedSource(*static_cast<SState*>(state));
+}
+
 void FetchDataFunction::setupDisttoSeedSource()
 {
     // check if required columns are available:
@@ -325,9 +353,77 @@ void FetchDataFunction::setupDisttoSeedSource()
         throw std::logic_error("The 'DistToSeedSource' function requires the state properties 'seedSourceType' and 'seedTargetType'.");
     mD2S_seed_source = static_cast<size_t>(State::valueIndex("seedSourceType"));
     mD2S_target = static_cast<size_t>(State::valueIndex("seedTargetType"));
+
+    // the seed source types used by the states: a distance grid is maintained for every type
+    std::set<size_t> types;
+    for (const auto &s : Model::instance()->states()->states())
+        types.insert(static_cast<size_t>(s.value(mD2S_seed_source)));
+    if (!types.empty() && *types.rbegin() > 100000)
+        throw logic_error_fmt("DistToSeedSource: invalid seedSourceType {} (max. 100000).", *types.rbegin());
+    mD2S_slot.assign(types.empty() ? 0 : *types.rbegin() + 1, -1);
+    int slot = 0;
+    for (auto t : types)
+        mD2S_slot[t] = slot++;
+    spdlog::get("setup")->debug("DistToSeedSource: {} seed source types.", types.size());
 }
 
 
+float FetchDataFunction::calculateDistToSeedSource(Cell *cell, const SState &state) const
+{
+    if (cell->state()==nullptr)
+        return 0.f;
+
+    if (state.D2S_values.empty())
+        throw std::logic_error("DistToSeedSource: distance grids are not available (newYear() not called).");
+
+    size_t target = static_cast<size_t>(cell->state()->value(mD2S_target));
+    if (target >= mD2S_slot.size() || mD2S_slot[target] < 0)
+        return 1.25f; // no seed source of the target type on the landscape (max. distance)
+
+    auto &grid =  Model::instance()->landscape()->grid();
+    return state.D2S_values[static_cast<size_t>(mD2S_slot[target])].constValueAtIndex(grid.indexOf(cell));
+}
+
+int FetchDataFunction::seedSourceSlot(const Cell &cell) const
+{
+    if (cell.isNull() || cell.state()==nullptr)
+        return -1;
+    size_t type = static_cast<size_t>(cell.state()->value(mD2S_seed_source));
+    return type < mD2S_slot.size() ? mD2S_slot[type] : -1;
+}
+
+void FetchDataFunction::updateDistToSeedSource(SState &state) const
+{
+    // the distance grid of a seed source type is only re-calculated if
+    // cells changed from/to the seed source type since the last update
+    auto &grid = Model::instance()->landscape()->grid();
+    const size_t n_types = static_cast<size_t>(std::count_if(mD2S_slot.begin(), mD2S_slot.end(), [](int s) { return s>=0; }));
+    bool first_time = state.D2S_values.empty();
+    if (first_time) {
+        state.D2S_values.resize(n_types);
+        for (auto &g : state.D2S_values)
+            g.setup(grid.metricRect(), grid.cellsize());
+        state.D2S_cellSource.assign(static_cast<size_t>(grid.count()), -1);
+    }
+    std::vector<char> changed(n_types, first_time ? 1 : 0);
+    for (int i=0;i<grid.count();++i) {
+        int slot = seedSourceSlot(grid[i]);
+        int &old_slot = state.D2S_cellSource[static_cast<size_t>(i)];
+        if (slot != old_slot) {
+            if (old_slot >= 0) changed[static_cast<size_t>(old_slot)] = 1;
+            if (slot >= 0) changed[static_cast<size_t>(slot)] = 1;
+            old_slot = slot;
+        }
+    }
+    int n_updated = 0;
+    for (size_t t=0;t<n_types;++t)
+        if (changed[t]) {
+            calculateDistanceGrid(state, static_cast<int>(t));
+            ++n_updated;
+        }
+    spdlog::get("dnn")->debug("DistToSeedSource: updated the distance grids of {} of {} seed source types.", n_updated, n_types);
+}
+
 // distances from center point (X)
 // 4 4 3 4 4
 // 4 2 1 2 4
@@ -343,54 +439,121 @@ static std::vector<std::pair<Point, float> > dist2seeds = {
     {{-2, 2},200.f }, {{-1, 2},200.f }, {{1, 2},200.f }, {{2, 2},200.f }, {{-2, 1},200.f }, {{2, 1},200.f } // distances 4 (lower half)
 };
 
-float FetchDataFunction::calculateDistToSeedSource(Cell *cell)
-{
-    if (cell->state()==nullptr)
-        return 0.f;
-
-    auto &grid =  Model::instance()->landscape()->grid();
+static const double DT_INF = std::numeric_limits<double>::infinity();
 
-    size_t target = static_cast<size_t>(cell->state()->value(mD2S_target));
-
-    Point center = grid.indexOf(cell);
-
-    for (const auto &p : dist2seeds) {
-        if (grid.isIndexValid(center + p.first)) {
-            Cell &c = grid.valueAtIndex(center + p.first);
-            if (!c.isNull() && c.state()!=nullptr)
-                if (static_cast<size_t>(c.state()->value(mD2S_seed_source)) == target) {
-                    // found a distance
-                    return p.second / 1000.f;
-                }
+// 1d squared distance transform (Felzenszwalb & Huttenlocher, 2012): d[q] = min_p ( (q+shift-p)^2 + f[p] )
+// 'f' is DT_INF for non-seed cells.
+static void distanceTransform1d(const double *f, int n, double shift, double *d)
+{
+    std::vector<int> v(static_cast<size_t>(n)); // locations of the parabolas of the lower envelope
+    std::vector<double> z(static_cast<size_t>(n)+1); // boundaries between parabolas
+    int k = -1;
+    for (int q=0;q<n;++q) {
+        if (f[q] == DT_INF)
+            continue;
+        if (k<0) {
+            k = 0; v[0] = q; z[0] = -DT_INF; z[1] = DT_INF;
+            continue;
         }
+        double s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2.*q - 2.*v[k]);
+        while (s <= z[k]) {
+            --k;
+            s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2.*q - 2.*v[k]);
+        }
+        ++k;
+        v[k] = q; z[k] = s; z[k+1] = DT_INF;
+    }
+    if (k<0) {
+        std::fill(d, d+n, DT_INF);
+        return;
+    }
+    k = 0;
+    for (int q=0;q<n;++q) {
+        double x = q + shift;
+        while (z[k+1] < x)
+            ++k;
+        d[q] = (x - v[k])*(x - v[k]) + f[v[k]];
     }
+}
 
-    // brute force
-    float min_dist_sq = 100000.f;
-    for (int y=-12; y<=12; ++y)
-        for (int x=-12; x<=12; ++x)
-            if (grid.isIndexValid(center + Point(x,y))) {
-                Cell &c = grid.valueAtIndex(center + Point(x,y));
-                if (!c.isNull() && c.state()!=nullptr)
-                    if (static_cast<size_t>(c.state()->value(mD2S_seed_source)) == target) {
-                        // found a seed pixel: (x-0.5)*(x-0.5)=x^2-x+0.25
-                        min_dist_sq = std::min(min_dist_sq, x*x-x+0.25f + y*y-y+0.25f);
+// exact squared euclidean distance transform of a grid (size sx*sy) with the query point moved by 'shift' cells in x and y direction.
+// The transform is separable: first all columns, then all rows are processed (in parallel).
+static void distanceTransform(const std::vector<double> &f, int sx, int sy, double shift, std::vector<double> &result)
+{
+    std::vector<double> tmp(f.size());
+    std::vector<int> cols(static_cast<size_t>(sx));
+    std::iota(cols.begin(), cols.end(), 0);
+    QtConcurrent::blockingMap(cols, [&](int x) {
+        std::vector<double> in(static_cast<size_t>(sy)), out(static_cast<size_t>(sy));
+        for (int y=0;y<sy;++y)
+            in[static_cast<size_t>(y)] = f[static_cast<size_t>(y*sx+x)];
+        distanceTransform1d(in.data(), sy, shift, out.data());
+        for (int y=0;y<sy;++y)
+            tmp[static_cast<size_t>(y*sx+x)] = out[static_cast<size_t>(y)];
+    });
+    result.resize(f.size());
+    std::vector<int> rows(static_cast<size_t>(sy));
+    std::iota(rows.begin(), rows.end(), 0);
+    QtConcurrent::blockingMap(rows, [&](int y) {
+        distanceTransform1d(&tmp[static_cast<size_t>(y*sx)], sx, shift, &result[static_cast<size_t>(y*sx)]);
+    });
+}
+
+void FetchDataFunction::calculateDistanceGrid(SState &state, int slot) const
+{
+    const std::vector<int> &cell_source = state.D2S_cellSource;
+    auto &grid =  Model::instance()->landscape()->grid();
+    const int sx = grid.sizeX();
+    const int sy = grid.sizeY();
+    std::vector<double> f(static_cast<size_t>(grid.count()));
+    for (size_t i=0;i<f.size();++i)
+        f[i] = cell_source[i]==slot ? 0. : DT_INF;
+
+    // squared distances (in cells) between cell centers, and from the point shifted by
+    // half a cell (as the former brute force search: (x-0.5)^2 + (y-0.5)^2 )
+    std::vector<double> dist_center, dist_shifted;
+    distanceTransform(f, sx, sy, 0., dist_center);
+    distanceTransform(f, sx, sy, 0.5, dist_shifted);
+
+    Grid<float> &values = state.D2S_values[static_cast<size_t>(slot)];
+    for (int y=0;y<sy;++y)
+        for (int x=0;x<sx;++x) {
+            size_t i = static_cast<size_t>(y*sx + x);
+            float value = -1.f;
+            // distance classes in the 5x5 neighborhood
+            if (cell_source[i]==slot) {
+                // the cell itself is a seed source: look for other seed cells in the neighborhood
+                Point center(x,y);
+                for (const auto &p : dist2seeds)
+                    if (grid.isIndexValid(center + p.first) &&
+                            cell_source[static_cast<size_t>(grid.index(center + p.first))]==slot) {
+                        value = p.second / 1000.f;
+                        break;
                     }
+            } else {
+                double d = dist_center[i];
+                if (d==1.) value = 50.f / 1000.f;
+                else if (d==2.) value = 100.f / 1000.f;
+                else if (d==4.) value = 150.f / 1000.f;
+                else if (d==5. || d==8.) value = 200.f / 1000.f;
             }
-    float min_dist = std::min(sqrt(min_dist_sq), 12.5f); // training data goes to 1250m distance, unit here is 100m steps
-    return min_dist / 10.f; // convert to m/1000
-
+            if (value < 0.f) {
+                float min_dist_sq = dist_shifted[i] < 100000. ? static_cast<float>(dist_shifted[i]) : 100000.f;
+                float min_dist = std::min(sqrt(min_dist_sq), 12.5f); // training data goes to 1250m distance, unit here is 100m steps
+                value = min_dist / 10.f; // convert to m/1000
+            }
+            values.valueAtIndex(x,y) = value;
+        }
 }
 
 void FetchDataFunction::setupSimpleManagement()
 {
-    // check if required modules / variables are available
-    mMgmtModule = dynamic_cast<SimpleManagementModule*>(Model::instance()->module("mgmt")) ;
-    if (!mMgmtModule)
+    // check if required modules / variables are available (the module of each model is used, see createState())
+    if (!dynamic_cast<SimpleManagementModule*>(Model::instance()->module("mgmt")))
         throw logic_error_fmt("Setup of management: the required module 'mgmt' is not available!");
 }
 
-void FetchDataFunction::calculateSimpleManagement(Cell *cell, float &rActivity, float &rTime)
+void FetchDataFunction::calculateSimpleManagement(Cell *cell, const SState &state, float &rActivity, float &rTime) const
 {
-    mMgmtModule->managementActivity(cell, rActivity, rTime);
+    state.mgmtModule->managementActivity(cell, rActivity, rTime);
 }
@@ -22,11 +22,24 @@
 #include "inputtensoritem.h"
 #include "expression.h"
 #include "strtools.h"
+#include "grid.h"
+#include "environmentcell.h"
 
 class Cell; // forward
 class Batch; // forward
 class BatchDNN; // forward
 class Settings; // forward
+
+/** FetchState is the base class for data of a FetchData object that changes during a simulation (e.g. distance grids).
+ *  The FetchData objects (part of the tensor definition) are shared by all models of the process, while
+ *  each model has its own states (see BatchManager::fetchState()).
+ * */
+class FetchState
+{
+public:
+    virtual ~FetchState() { }
+};
+
 class FetchData
 {
 public:
@@ -34,7 +47,14 @@ public:
     virtual ~FetchData() { }
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
 
-    virtual void fetch(Cell *cell, BatchDNN* batch, size_t slot);
+    /// create the state for the current model (Model::instance()); nullptr if the object has no mutable data
+    virtual FetchState *createState() const { return nullptr; }
+
+    /// write the data of 'cell' to 'slot' of 'batch'; 'state' is the state of the model (see createState())
+    virtual void fetch(Cell *cell, BatchDNN* batch, size_t slot, FetchState *state);
+
+    /// called at the start of a simulation year (before data for the year is fetched)
+    virtual void newYear(FetchState *state);
 
     // factory function
     static FetchData *createFetchObject(InputTensorItem *def);
@@ -49,7 +69,7 @@ public:
     ~FetchDataStandard() {}
     FetchDataStandard(InputTensorItem *item) : FetchData(item) {}
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
-    virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot);
+    virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot, FetchState *state);
 private:
     void fetchClimate(Cell *cell, BatchDNN* batch, size_t slot);
     void fetchState(Cell *cell, BatchDNN *batch, size_t slot);
@@ -57,10 +77,10 @@ private:
     void fetchNeighbors(Cell *cell, BatchDNN* batch, size_t slot);
     void fetchSite(Cell *cell, BatchDNN* batch, size_t slot);
     void fetchDistanceOutside(Cell *cell, BatchDNN* batch, size_t slot);
-    // columns
-    int i_distance;
-    int i_nitrogen;
-    int i_soildepth;
+    // columns (handles to the environment table)
+    EnvironmentColumn col_distance;
+    EnvironmentColumn col_nitrogen;
+    EnvironmentColumn col_soildepth;
 };
 
 
@@ -73,7 +93,7 @@ public:
     ~FetchDataVars() { delete_and_clear(mExpressions); }
     FetchDataVars(InputTensorItem *item) : FetchData(item) {}
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
-    virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot);
+    virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot, FetchState *state);
 private:
     std::vector<Expression*> mExpressions; ///< list of expressions
 };
@@ -88,7 +108,9 @@ public:
     ~FetchDataFunction() {  }
     FetchDataFunction(InputTensorItem *item) : FetchData(item) { mFn = Invalid; }
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
-    virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot);
+    virtual FetchState *createState() const;
+    virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot, FetchState *state);
+    virtual void newYear(FetchState *state);
 
     // functions
     enum EFunctions { Invalid=0,
@@ -96,17 +118,30 @@ public:
                       SimpleManagement = 2};
 private:
     EFunctions mFn;
+    /// the data of a model
+    struct SState : public FetchState {
+        SState(): mgmtModule(nullptr) {}
+        std::vector< Grid<float> > D2S_values; ///< predictor value (distance to the next seed source) per seed source type
+        std::vector<int> D2S_cellSource; ///< seed source type index of each cell (at the last update)
+        SimpleManagementModule *mgmtModule; ///< the management module of the model
+    };
 
     // entrypoints for the individual variables
     void setupDisttoSeedSource();
-    float calculateDistToSeedSource(Cell *cell);
+    float calculateDistToSeedSource(Cell *cell, const SState &state) const;
+    /// update the distance grids of all seed source types with changed seed cells
+    void updateDistToSeedSource(SState &state) const;
+    /// calculate the predictor values for seed source type 'slot' for the full landscape
+    void calculateDistanceGrid(SState &state, int slot) const;
+    /// the index of the seed source type of 'cell' (or -1)
+    int seedSourceSlot(const Cell &cell) const;
     size_t mD2S_target; // index of target
     size_t mD2S_seed_source; // index of source
+    std::vector<int> mD2S_slot; ///< index of the seed source type (-1: no cells with this type), indexed by type
 
     // simple management
     void setupSimpleManagement();
-    void calculateSimpleManagement(Cell *cell, float &rActivity, float &rTime);
-    SimpleManagementModule *mMgmtModule;
+    void calculateSimpleManagement(Cell *cell, const SState &state, float &rActivity, float &rTime) const;
 
 };
 
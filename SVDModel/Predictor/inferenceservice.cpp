@@ -0,0 +1,145 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "inferenceservice.h"
+
+#include <cstring>
+#include <stdexcept>
+#include "spdlog/spdlog.h"
+
+#include "dnn.h"
+#include "batchdnn.h"
+#include "tensorhelper.h"
+
+InferenceService::InferenceService(const std::vector<DNN *> &networks, size_t batch_size, std::chrono::milliseconds max_wait)
+{
+    if (networks.empty())
+        throw std::logic_error("InferenceService: no DNN available.");
+    mBatchSize = batch_size;
+    mMaxWait = max_wait;
+    mQueuedExamples = 0;
+    mStop = false;
+    mInferenceCalls = 0;
+    mExamples = 0;
+    for (auto *dnn : networks)
+        mThreads.push_back(std::thread(&InferenceService::workerLoop, this, dnn));
+}
+
+InferenceService::~InferenceService()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mQueued.notify_all();
+    // the workers process all pending batches before they quit
+    for (auto &t : mThreads)
+        if (t.joinable())
+            t.join();
+    if (auto lg = spdlog::get("dnn"))
+        lg->debug("Inference service: {} examples in {} calls of the network.", mExamples.load(), mInferenceCalls.load());
+}
+
+void InferenceService::submit(BatchDNN *batch, std::function<void (Batch *)> finished)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back(Request{batch, finished, std::chrono::steady_clock::now()});
+        mQueuedExamples += batch->usedSlots();
+    }
+    mQueued.notify_all();
+}
+
+void InferenceService::workerLoop(DNN *dnn)
+{
+    // each worker has its own tensors for the combined batch
+    std::vector<TensorWrapper*> tensors;
+    DNN::setupTensors(mBatchSize, tensors);
+    std::vector<Request> requests;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mQueued.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+        if (mQueue.empty())
+            break; // mStop and nothing left to process
+
+        // wait for batches of other models until the combined batch is full, or the oldest batch waited too long
+        auto deadline = mQueue.front().queued + mMaxWait;
+        mQueued.wait_until(lock, deadline, [this]() { return mStop || mQueue.empty() || mQueuedExamples >= mBatchSize; });
+        if (mQueue.empty())
+            continue; // processed by another worker
+
+        // take batches as long as the examples fit into the combined batch
+        requests.clear();
+        size_t n_examples = 0;
+        while (!mQueue.empty() && (requests.empty() || n_examples + mQueue.front().batch->usedSlots() <= mBatchSize)) {
+            n_examples += mQueue.front().batch->usedSlots();
+            requests.push_back(mQueue.front());
+            mQueue.pop_front();
+        }
+        mQueuedExamples -= n_examples;
+        lock.unlock();
+
+        runCombined(dnn, tensors, requests);
+
+        lock.lock();
+    }
+    lock.unlock();
+    for (auto *t : tensors)
+        delete t;
+}
+
+void InferenceService::runCombined(DNN *dnn, std::vector<TensorWrapper *> &tensors, std::vector<Request> &requests)
+{
+    size_t n_examples = 0;
+    try {
+        // copy the examples of all batches to the combined tensors; the targets are the slots in the original batches
+        std::vector<std::pair<BatchDNN*, size_t> > targets;
+        for (const auto &r : requests) {
+            size_t n = r.batch->usedSlots();
+            for (size_t t=0;t<tensors.size();++t) {
+                if (tensors[t]->ndim()==0)
+                    continue; // scalars: one value for the whole batch
+                tensorflow::Tensor &source = r.batch->tensor(t)->tensor();
+                size_t example_bytes = source.TotalBytes() / static_cast<size_t>(source.dim_size(0));
+                char *target = const_cast<char*>(tensors[t]->tensor().tensor_data().data());
+                memcpy(target + targets.size()*example_bytes, source.tensor_data().data(), n*example_bytes);
+            }
+            for (size_t i=0;i<n;++i)
+                targets.push_back(std::pair<BatchDNN*, size_t>(r.batch, i));
+        }
+        n_examples = targets.size();
+        bool ok = dnn->infer(tensors, mBatchSize, targets, requests.front().batch->packageId());
+        for (const auto &r : requests) {
+            if (ok)
+                r.batch->changeState(Batch::FinishedDNN);
+            else
+                r.batch->setError(true);
+        }
+    } catch (const std::exception &e) {
+        spdlog::get("dnn")->error("Error in inference service: {}", e.what());
+        for (const auto &r : requests)
+            r.batch->setError(true);
+    }
+    mInferenceCalls++;
+    mExamples += n_examples;
+    spdlog::get("dnn")->debug("Inference service: evaluated {} examples of {} batch(es).", n_examples, requests.size());
+
+    for (const auto &r : requests)
+        r.finished(r.batch);
+}
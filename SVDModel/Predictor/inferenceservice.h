@@ -0,0 +1,80 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef INFERENCESERVICE_H
+#define INFERENCESERVICE_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+class Batch; // forward
+class BatchDNN; // forward
+class DNN; // forward
+class TensorWrapper; // forward
+
+/// The InferenceService runs the DNN inference for the batches of several models (e.g., stochastic
+/// replicates of the same scenario, see Model::isReplicate()). The examples of batches that are submitted
+/// by different models are copied to a combined batch, which is evaluated with a single call of the network;
+/// the results are written back to the slots of the original batches.
+/// A combined batch is started when enough examples are queued, or when the oldest batch waited for 'max_wait'.
+class InferenceService
+{
+public:
+    /// create the service with one worker thread for each of the 'networks'.
+    /// 'batch_size' is the number of examples of a combined batch.
+    InferenceService(const std::vector<DNN*> &networks, size_t batch_size, std::chrono::milliseconds max_wait);
+    /// waits until all queued batches are processed
+    ~InferenceService();
+
+    /// queue the 'batch' for inference. 'finished' is called (from a worker thread) when the results
+    /// are available (or the error flag of the batch is set).
+    void submit(BatchDNN *batch, std::function<void(Batch*)> finished);
+
+    size_t batchSize() const { return mBatchSize; }
+    /// number of calls of the network
+    size_t inferenceCalls() const { return mInferenceCalls; }
+    /// number of examples evaluated
+    size_t examplesProcessed() const { return mExamples; }
+private:
+    struct Request {
+        BatchDNN *batch;
+        std::function<void(Batch*)> finished;
+        std::chrono::steady_clock::time_point queued;
+    };
+    void workerLoop(DNN *dnn);
+    void runCombined(DNN *dnn, std::vector<TensorWrapper*> &tensors, std::vector<Request> &requests);
+
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mQueued;
+    std::deque<Request> mQueue;
+    size_t mQueuedExamples; ///< number of examples of all queued batches
+    size_t mBatchSize;
+    std::chrono::milliseconds mMaxWait;
+    bool mStop;
+    std::atomic<size_t> mInferenceCalls;
+    std::atomic<size_t> mExamples;
+};
+
+#endif // INFERENCESERVICE_H
@@ -29,9 +29,14 @@ SOURCES += \
     modules/simplemanagement/simplemanagementmodule.cpp \
     outputs/statehistout.cpp \
     tools/geotiff.cpp \
+    tools/tiffreader.cpp \
     tools/grid.cpp \
     tools/strtools.cpp \
     tools/filereader.cpp \
+    tools/mappedfile.cpp \
+    tools/checkpoint.cpp \
+    tools/taskgraph.cpp \
+    tools/tablereader.cpp \
     tools/settings.cpp \
     tools/randomgen.cpp \
     core/model.cpp \
@@ -44,13 +49,17 @@ SOURCES += \
     modelrunstate.cpp \
     outputs/output.cpp \
     outputs/outputmanager.cpp \
+    outputs/outputwriter.cpp \
     outputs/stategridout.cpp \
     outputs/restimegridout.cpp \
     core/externalseeds.cpp \
     outputs/statechangeout.cpp \
+    outputs/statechangelogout.cpp \
+    outputs/statechangelogreader.cpp \
     tools/expression.cpp \
     tools/expressionwrapper.cpp \
     core/transitionmatrix.cpp \
+    core/neighborhoodstats.cpp \
     modules/fire/firemodule.cpp \
     modules/fire/fireout.cpp \
     modules/module.cpp \
@@ -61,9 +70,14 @@ HEADERS += \
     modules/simplemanagement/simplemanagementmodule.h \
     outputs/statehistout.h \
     tools/geotiff.h \
+    tools/tiffreader.h \
     tools/grid.h \
     tools/strtools.h \
     tools/filereader.h \
+    tools/mappedfile.h \
+    tools/checkpoint.h \
+    tools/taskgraph.h \
+    tools/tablereader.h \
     tools/settings.h \
     tools/randomgen.h \
     core/model.h \
@@ -76,13 +90,17 @@ HEADERS += \
     modelrunstate.h \
     outputs/output.h \
     outputs/outputmanager.h \
+    outputs/outputwriter.h \
     outputs/stategridout.h \
     outputs/restimegridout.h \
     core/externalseeds.h \
     outputs/statechangeout.h \
+    outputs/statechangelogout.h \
+    outputs/statechangelogreader.h \
     tools/expression.h \
     tools/expressionwrapper.h \
     core/transitionmatrix.h \
+    core/neighborhoodstats.h \
     modules/fire/firemodule.h \
     modules/fire/fireout.h \
     modules/module.h \
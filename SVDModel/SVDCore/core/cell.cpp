@@ -72,6 +72,18 @@ void Cell::update()
 
 }
 
+void Cell::restore(state_t state, restime_t res_time, int next_update, state_t next_state)
+{
+    if (state==0)
+        setInvalid();
+    else
+        setState(state);
+    mResidenceTime = res_time;
+    mNextUpdateTime = next_update;
+    mNextStateId = next_state;
+    mIsUpdated = false;
+}
+
 void Cell::setState(state_t new_state)
 {
     if (new_state==0) {
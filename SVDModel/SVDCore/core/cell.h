@@ -50,6 +50,8 @@ public:
     restime_t residenceTime() const { return mResidenceTime; }
     /// get the year for which the next update is scheduled
     int nextUpdate() const {return mNextUpdateTime; }
+    /// the state scheduled for the next update
+    state_t nextStateId() const { return mNextStateId; }
     /// the index is the position of the cell within the landscape
     int cellIndex() const { return mCellIndex; }
     float elevation() const { return mElevation; }
@@ -72,6 +74,8 @@ public:
     /// sets a new state immediately (later updates from DNN are blocked)
     void setNewState(state_t new_state);
     void setInvalid() { mStateId=0; mResidenceTime=0; mState=nullptr; }
+    /// restore the state of the cell (e.g. from a checkpoint); 'state' = 0 marks an invalid cell
+    void restore(state_t state, restime_t res_time, int next_update, state_t next_state);
 
     bool hasExternalSeed() const { return mExternalSeedType>0 || (state()!=nullptr && !isNull()); }
     /// set external forest type:
@@ -87,6 +91,10 @@ public:
     double stateFrequencyLocal(state_t stateId) const;
     double stateFrequencyIntermediate(state_t stateId) const;
     double stateFrequencyGlobal(state_t stateId) const;
+
+    /// the cells of the local (8 cells) and the intermediate (radius 3 cells) neighborhood (relative to the focal cell)
+    static const std::vector<Point> &localNeighbors() { return mLocalNeighbors; }
+    static const std::vector<Point> &mediumNeighbors() { return mMediumNeighbors; }
 private:
     void dumpDebugData();
     int mCellIndex; ///< index of the grid cell within the landscape grid
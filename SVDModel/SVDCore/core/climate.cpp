@@ -21,7 +21,7 @@
 #include <regex>
 
 #include "model.h"
-#include "filereader.h"
+#include "tablereader.h"
 #include "tools.h"
 #include "strtools.h"
 #include "expression.h"
@@ -36,7 +36,7 @@ void Climate::setup()
     auto settings = Model::instance()->settings();
     settings.requiredKeys("climate", {"file"});
     std::string file_name = Tools::path(settings.valueString("climate.file"));
-    FileReader rdr(file_name);
+    TableReader rdr(file_name);
 
     const auto &targetIds = Model::instance()->landscape()->climateIds();
 
@@ -58,9 +58,9 @@ void Climate::setup()
 
 
     // set up transformations
-    std::vector<Expression> transformations;
+    // note: Expression is not copyable, the vector is therefore created with its final size
+    std::vector<Expression> transformations(settings.hasKey("climate.transformations") ? mNColumns : 0);
     if (settings.hasKey("climate.transformations")) {
-        transformations.resize(mNColumns);
         std::string tlist = settings.valueString("climate.transformations");
         // get elements via regex
         std::regex re("\\{([^\\:]*)\\:([^\\}]*)\\}");
@@ -93,25 +93,24 @@ void Climate::setup()
         lg->debug("No climate transformations specified. Using climate data as is.");
     }
 
-    int n=0;
-    int id_skipped = 0;
-    while (rdr.next()) {
-        int id = int( rdr.value(i_id) );
-        int year =int (rdr.value(i_year));
+    // the file is parsed (and transformed) in parallel chunks, and the records
+    // of the chunks are added to the data container afterwards (in file order)
+    struct SRecord { int id; int year; std::vector<float> values; };
+    std::vector< std::vector<SRecord> > chunk_records(rdr.chunkCount());
+    std::vector<int> chunk_skipped(rdr.chunkCount(), 0);
+    rdr.forEachRow([&](size_t chunk, const double *values) {
+        int id = int( values[i_id] );
+        int year =int (values[i_year]);
 
         if (targetIds.find(id) == targetIds.end()) {
-            ++id_skipped;
-            continue;
+            ++chunk_skipped[chunk];
+            return;
         }
 
-        mAllIds.insert(id);
-        mAllYears.insert(year);
-
-        auto &year_container = mData[year];
-        auto &vec = year_container[id];
-        vec.resize(rdr.columnCount()-2);
+        chunk_records[chunk].push_back( SRecord { id, year, std::vector<float>(rdr.columnCount()-2) } );
+        auto &vec = chunk_records[chunk].back().values;
         for (size_t i=2;i<rdr.columnCount();++i)
-            vec[i-2] = static_cast<float>(rdr.value(i));
+            vec[i-2] = static_cast<float>(values[i]);
 
         for (size_t i=0;i<transformations.size();++i) {
             // apply transformations (if present)
@@ -122,8 +121,20 @@ void Climate::setup()
 //            vec[i] =  (vec[i]- 6.3) / 6.7 ; // temp
 //        for (int i=12;i<24;++i)
 //            vec[i] = (vec[i]- 116) / 63; // precip
+    });
 
-        ++n;
+    int n=0;
+    int id_skipped = 0;
+    for (size_t c=0;c<chunk_records.size();++c) {
+        id_skipped += chunk_skipped[c];
+        for (auto &rec : chunk_records[c]) {
+            mAllIds.insert(rec.id);
+            mAllYears.insert(rec.year);
+            mData[rec.year][rec.id] = std::move(rec.values);
+            ++n;
+        }
+        chunk_records[c].clear();
+        chunk_records[c].shrink_to_fit();
     }
     lg->debug("loaded {} records.", n);
 
@@ -19,14 +19,32 @@
 #include "environmentcell.h"
 
 std::vector<std::string> EnvironmentCell::mVariables = {};
-
+std::vector< std::vector<double> > EnvironmentCell::mColumns;
 
 
 void EnvironmentCell::setValue(const int var_idx, double new_value)
 {
-    if (var_idx<0 || static_cast<size_t>(var_idx)>=mVariables.size())
+    if (var_idx<0 || static_cast<size_t>(var_idx)>=mColumns.size() || mIndex>=mColumns[static_cast<size_t>(var_idx)].size())
         throw std::logic_error("EnvironmentCell::setValue: invalid index.");
-    if (mValues.size()<mVariables.size())
-        mValues.resize(mVariables.size());
-    mValues[static_cast<size_t>(var_idx)] = new_value;
+    mColumns[static_cast<size_t>(var_idx)][mIndex] = new_value;
+}
+
+void EnvironmentCell::setupTable(size_t n_rows)
+{
+    mColumns.assign(mVariables.size(), std::vector<double>(n_rows, 0.));
+}
+
+std::vector<double> &EnvironmentCell::columnValues(size_t var_idx)
+{
+    if (var_idx >= mColumns.size())
+        throw std::logic_error("EnvironmentCell::columnValues: invalid index.");
+    return mColumns[var_idx];
+}
+
+EnvironmentColumn EnvironmentCell::column(const std::string &var_name)
+{
+    int idx = indexOf(var_name);
+    if (idx < 0 || static_cast<size_t>(idx) >= mColumns.size())
+        return EnvironmentColumn();
+    return EnvironmentColumn(mColumns[static_cast<size_t>(idx)].data());
 }
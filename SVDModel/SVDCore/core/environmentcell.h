@@ -22,14 +22,41 @@
 #include <vector>
 #include <strtools.h>
 
+class EnvironmentCell; // forward
+
+/**
+ * @brief The EnvironmentColumn class is a handle to the values of a single environment variable.
+ * Handles are created once (see EnvironmentCell::column()), and provide fast access to the value of the variable for an environment cell.
+ */
+class EnvironmentColumn
+{
+public:
+    EnvironmentColumn(): mData(nullptr) {}
+    explicit EnvironmentColumn(const double *data): mData(data) {}
+    bool isValid() const { return mData != nullptr; }
+    /// the value of the variable for the environment cell 'ec'
+    inline double operator()(const EnvironmentCell *ec) const;
+    /// the values of the variable (one value per environment cell, see EnvironmentCell::index())
+    const double *data() const { return mData; }
+private:
+    const double *mData;
+};
+
+/**
+ * @brief The EnvironmentCell class describes a single environment (e.g. soil conditions, climate zone).
+ * The values of the environment variables are stored column-wise in a (static) table: one array per variable,
+ * and each environment cell refers to a row of the table (index()).
+ */
 class EnvironmentCell
 {
 public:
-    EnvironmentCell(int id, int climate_id): mId(id), mClimateId(climate_id) {}
+    EnvironmentCell(int id, int climate_id, size_t index=0): mId(id), mClimateId(climate_id), mIndex(index) {}
     int climateId() const {return mClimateId; }
     int id() const {return mId; }
+    /// the row of the cell in the environment table
+    size_t index() const { return mIndex; }
     double value(const std::string &s) const { return value(static_cast<size_t>(indexOf(s))); }
-    double value(const size_t var_idx) const { if (var_idx<mValues.size()) return mValues[var_idx]; throw std::logic_error("Invalid index for environment cell!");}
+    double value(const size_t var_idx) const { if (var_idx<mColumns.size()) return mColumns[var_idx][mIndex]; throw std::logic_error("Invalid index for environment cell!");}
     /// return the index of variable 's' or -1 if invalid
     static int indexOf(const std::string &s)  { return ::indexOf(mVariables, s); }
 
@@ -39,11 +66,25 @@ public:
     void setValue(const std::string &var_name, double new_value) { setValue(indexOf(var_name), new_value);}
     /// access the list of variables change
     static std::vector<std::string> &variables()  { return mVariables; }
+
+    // environment table
+    /// set up the table with 'n_rows' rows (values are 0) for all variables (see variables()).
+    /// Note: existing column handles are invalidated.
+    static void setupTable(size_t n_rows);
+    /// number of rows of the environment table
+    static size_t rowCount() { return mColumns.empty() ? 0 : mColumns.front().size(); }
+    /// the values of the variable 'var_idx' (e.g. for filling the table)
+    static std::vector<double> &columnValues(size_t var_idx);
+    /// get a handle to the values of the variable 'var_name'. The handle is invalid if the variable does not exist.
+    static EnvironmentColumn column(const std::string &var_name);
 private:
     int mId; ///< the cell/region ID
     int mClimateId; ///< the unique ID of the climate series that represents this region
-    std::vector<double> mValues; ///< further values (constants)
-    static std::vector<std::string> mVariables; ///< (static) list of variable names (linked to the mValues vector)
+    size_t mIndex; ///< row in the environment table
+    static std::vector<std::string> mVariables; ///< (static) list of variable names (linked to the mColumns vector)
+    static std::vector< std::vector<double> > mColumns; ///< (static) the values of the environment variables (one vector per variable)
 };
 
+double EnvironmentColumn::operator()(const EnvironmentCell *ec) const { return mData[ec->index()]; }
+
 #endif // ENVIRONMENTCELL_H
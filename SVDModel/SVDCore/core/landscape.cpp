@@ -19,17 +19,135 @@
 #include "landscape.h"
 
 #include "model.h"
-#include "filereader.h"
+#include "tablereader.h"
 #include "settings.h"
 #include "tools.h"
 #include "strtools.h"
 #include "randomgen.h"
 
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+namespace {
+
+// dense lookup of the row of an environment cell by its ID.
+// A direct table is used when the IDs are compact, and a sorted array (binary search) otherwise.
+// For duplicate IDs the first row wins.
+class EnvironmentIndex
+{
+public:
+    void setup(const std::vector<EnvironmentCell> &cells) {
+        mDirect.clear(); mSorted.clear();
+        if (cells.empty())
+            return;
+        auto mm = std::minmax_element(cells.begin(), cells.end(), [](const EnvironmentCell &a, const EnvironmentCell &b) { return a.id() < b.id(); });
+        mMinId = mm.first->id();
+        int64_t range = static_cast<int64_t>(mm.second->id()) - mMinId + 1;
+        if (range <= 4 * static_cast<int64_t>(cells.size()) + 1024) {
+            mDirect.assign(static_cast<size_t>(range), -1);
+            for (size_t i=cells.size(); i-- > 0; )
+                mDirect[static_cast<size_t>(cells[i].id() - mMinId)] = static_cast<int>(i);
+        } else {
+            mSorted.reserve(cells.size());
+            for (size_t i=0;i<cells.size();++i)
+                mSorted.push_back(std::make_pair(cells[i].id(), static_cast<int>(i)));
+            std::stable_sort(mSorted.begin(), mSorted.end(), [](const std::pair<int,int> &a, const std::pair<int,int> &b) { return a.first < b.first; });
+            mSorted.erase(std::unique(mSorted.begin(), mSorted.end(), [](const std::pair<int,int> &a, const std::pair<int,int> &b) { return a.first == b.first; }), mSorted.end());
+        }
+    }
+    /// the row of the environment cell with 'id', or -1 if not present
+    int find(int id) const {
+        if (!mDirect.empty()) {
+            int64_t i = static_cast<int64_t>(id) - mMinId;
+            return i>=0 && i<static_cast<int64_t>(mDirect.size()) ? mDirect[static_cast<size_t>(i)] : -1;
+        }
+        auto it = std::lower_bound(mSorted.begin(), mSorted.end(), id, [](const std::pair<int,int> &a, int v) { return a.first < v; });
+        return it!=mSorted.end() && it->first==id ? it->second : -1;
+    }
+private:
+    int mMinId {0};
+    std::vector<int> mDirect;
+    std::vector< std::pair<int, int> > mSorted;
+};
+
+// grids are processed in parallel in blocks of rows with about 64k cells per block
+int rowsPerBlock(int size_x)
+{
+    return std::max(1, 65536 / std::max(size_x, 1));
+}
+
+// the number of row blocks of a grid with 'size_x' x 'size_y' cells
+size_t rowBlockCount(int size_x, int size_y)
+{
+    const int rows_per_block = rowsPerBlock(size_x);
+    return static_cast<size_t>((size_y + rows_per_block - 1) / rows_per_block);
+}
+
+// run 'fn' in parallel for blocks of rows of a grid with 'size_x' x 'size_y' cells.
+// 'fn' gets the block number and the range of cell indices [begin, end) of the block.
+// Errors are collected and the error of the first block that failed is rethrown.
+void runRowBlocks(int size_x, int size_y, const std::function<void(size_t, int, int)> &fn)
+{
+    const int rows_per_block = rowsPerBlock(size_x);
+    std::vector<size_t> blocks(rowBlockCount(size_x, size_y));
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::vector<std::string> errors(blocks.size());
+    Model *model = Model::instance();
+    QtConcurrent::blockingMap(blocks, [&](size_t block) {
+        ModelScope scope(model);
+        try {
+            int first_row = static_cast<int>(block) * rows_per_block;
+            int last_row = std::min(first_row + rows_per_block, size_y);
+            fn(block, first_row * size_x, last_row * size_x);
+        } catch (const std::exception &e) {
+            errors[block] = e.what();
+        }
+    });
+    for (const auto &e : errors)
+        if (!e.empty())
+            throw std::logic_error(e);
+}
+
+} // namespace
+
 Landscape::Landscape()
 {
 }
 
 void Landscape::setup()
+{
+    setupEnvironment();
+    setupGrid();
+}
+
+void Landscape::setup(const std::shared_ptr<Landscape> &source)
+{
+    // the environment cells are owned by 'source' and used read-only
+    mSource = source;
+    mEnvironmentGrid.setup(source->mEnvironmentGrid);
+    std::copy(source->mEnvironmentGrid.begin(), source->mEnvironmentGrid.end(), mEnvironmentGrid.begin());
+    mClimateIds = source->mClimateIds;
+    mNCells = source->mNCells;
+
+    // copy the cells (and link them to the states of the current model)
+    mGrid.setup(source->mGrid);
+    std::copy(source->mGrid.begin(), source->mGrid.end(), mGrid.begin());
+    // cells outside of the project area may carry the state of an external seed source (Cell::setExternalState())
+    for (Cell *c = mGrid.begin(); c!=mGrid.end(); ++c)
+        if (c->state()) {
+            if (c->isNull())
+                c->setExternalState(c->state()->id());
+            else
+                c->setState(c->stateId());
+        }
+
+    spdlog::get("setup")->debug("Landscape of replicate set up from the shared landscape ({} cells).", mNCells);
+}
+
+void Landscape::setupEnvironment()
 {
     auto settings = Model::instance()->settings();
     auto lg = spdlog::get("setup");
@@ -45,112 +163,160 @@ void Landscape::setup()
         throw std::logic_error("Landscape setup: '" + grid_file_name + "' (landscape.grid) does not exist!");
 
 
-    Grid<int> grid;
     GeoTIFF::clearProjection(); // first chance to load a tif
 
-    grid.loadGridFromFile(grid_file_name);
+    mIdGrid.loadGridFromFile(grid_file_name);
 
-    lg->info("Loaded the grid (landscape.grid) '{}'. Dimensions: {} x {}, with cell size: {}m. ", grid_file_name, grid.sizeX(), grid.sizeY(), grid.cellsize());
-    lg->info("Metric rectangle with {}x{}m. Left-Right: {}m - {}m, Top-Bottom: {}m - {}m.  ", grid.metricRect().width(), grid.metricRect().height(), grid.metricRect().left(), grid.metricRect().right(), grid.metricRect().top(), grid.metricRect().bottom());
+    lg->info("Loaded the grid (landscape.grid) '{}'. Dimensions: {} x {}, with cell size: {}m. ", grid_file_name, mIdGrid.sizeX(), mIdGrid.sizeY(), mIdGrid.cellsize());
+    lg->info("Metric rectangle with {}x{}m. Left-Right: {}m - {}m, Top-Bottom: {}m - {}m.  ", mIdGrid.metricRect().width(), mIdGrid.metricRect().height(), mIdGrid.metricRect().left(), mIdGrid.metricRect().right(), mIdGrid.metricRect().top(), mIdGrid.metricRect().bottom());
     if (lg->should_log(spdlog::level::trace)) {
         // some statistics:
-        lg->trace("The grid contains '{}' not-null values.", grid.countNotNull());
-        std::set<int> uval = grid.uniqueValues();
+        lg->trace("The grid contains '{}' not-null values.", mIdGrid.countNotNull());
+        std::set<int> uval = mIdGrid.uniqueValues();
         lg->trace("Unique values: {}", join(uval.begin(), uval.end(), ",", 1000));
 
     }
 
-    FileReader rdr(table_file_name);
+    TableReader rdr(table_file_name);
     rdr.requiredColumns({"id", "climateId"});
     auto i_clim = rdr.columnIndex("climateId");
     auto i_id = rdr.columnIndex("id");
     // update the names of the environment:
     std::vector<std::string> &vars = EnvironmentCell::variables();
     vars.clear();
+    std::vector<size_t> var_columns; // column index of each variable
     for (size_t i=0;i<rdr.columnCount();++i) {
-        if (rdr.columnName(i) != "climateId" && rdr.columnName(i)!="id")
+        if (rdr.columnName(i) != "climateId" && rdr.columnName(i)!="id") {
             vars.push_back(rdr.columnName(i));
+            var_columns.push_back(i);
+        }
     }
 
-
-    while (rdr.next()) {
-        int cid = int(rdr.value(i_clim));
-        int id = int(rdr.value(i_id));
-
-        mEnvironmentCells.push_back( EnvironmentCell (id, cid) );
-        EnvironmentCell &ecell=mEnvironmentCells.back();
-        for (size_t i=0;i<rdr.columnCount();++i)
-            if (i!=i_clim && i!=i_id)
-                ecell.setValue(rdr.columnName(i), rdr.value(i));
+    rdr.readColumns();
+    const std::vector<double> &col_clim = rdr.column(i_clim);
+    const std::vector<double> &col_id = rdr.column(i_id);
+    mEnvironmentCells.clear();
+    mClimateIds.clear();
+    mEnvironmentCells.reserve(rdr.rowCount());
+    for (size_t row=0; row<rdr.rowCount(); ++row) {
+        int cid = int(col_clim[row]);
+        int id = int(col_id[row]);
+
+        mEnvironmentCells.push_back( EnvironmentCell (id, cid, row) );
         // store all climate regions that are present
         mClimateIds[cid]++;
     }
+    // the values of the variables are stored column-wise in the environment table
+    EnvironmentCell::setupTable(0);
+    for (size_t i=0;i<var_columns.size();++i)
+        EnvironmentCell::columnValues(i) = rdr.takeColumn(var_columns[i]);
 
     lg->info("Loaded the environment file (landscape.file) '{}'.", table_file_name);
     lg->debug("Environment: added {} entries for the variables: '{}'", mEnvironmentCells.size(), join(vars, ", "));
 
-    // setup the env-grid with the same extent:
-    mEnvironmentGrid.setup(grid.metricRect(), grid.cellsize());
-
-    // setup a hash for quick look up: do this only when cell-vector does not change anymore
-    std::unordered_map<int, EnvironmentCell*> env_hash;
-    for (EnvironmentCell &c : mEnvironmentCells)
-        env_hash.insert(std::pair<int, EnvironmentCell*>(c.id(), &c));
-
-    EnvironmentCell **ec=mEnvironmentGrid.begin();
-    int *iptr=grid.begin();
-    try {
-        for (; iptr!=grid.end(); ++iptr, ++ec) {
-            if (!grid.isNull(*iptr)) {
-                EnvironmentCell *cell = env_hash.at(*iptr);
-                *ec = cell;
-            } else {
-                *ec = nullptr;
-            }
-        }
-    } catch(const std::out_of_range &) {
-        lg->error("Setup of the landscape: the ID {} (found at index {}/{} of grid '{}') is not present as 'id' in the landscape file '{}'.", *iptr, grid.indexOf(iptr).x(), grid.indexOf(iptr).y(), grid_file_name, table_file_name);
-        throw std::logic_error("Setup of the landscape: The ID '" + std::to_string(*iptr) + "' is invalid. Check the log for additional details.");
-    }
+}
+
+void Landscape::setupGrid()
+{
+    auto settings = Model::instance()->settings();
+    auto lg = spdlog::get("setup");
+    if (mIdGrid.isEmpty())
+        throw std::logic_error("Landscape::setupGrid: the environment is not loaded (setupEnvironment()).");
 
     // load a DEM (if available)
     Grid<float> dem;
-    std::string filename = Model::instance()->settings().valueString("visualization.dem","");
+    std::string filename = settings.valueString("visualization.dem","");
     if (!filename.empty()) {
         filename = Tools::path(filename);
 
         if (!Tools::fileExists(filename)) {
             lg->error("DEM is provided, but the file is not available ('{}').", filename);
-            return;
+            filename.clear();
+        } else if (has_ending(filename, ".tif") || has_ending(filename, ".TIF")) {
+            // read only the part of the DEM that covers the landscape (with the resolution of the DEM)
+            TiffReader tif(filename);
+            if (!tif.hasGeoReference())
+                throw logic_error_fmt("The digital elevation model '{}' does not contain a geo reference.", filename);
+            // snap the window outwards to the pixel raster of the DEM (origin at the tie point), so that
+            // each cell of the window is exactly one pixel of the TIF
+            const RectF &r = mIdGrid.metricRect();
+            const double cs = tif.cellsize();
+            const double eps = 1e-6; // tolerance (in pixels) for coordinates that are already on the raster
+            double px_left = std::floor((r.left() - tif.xLeft()) / cs + eps);
+            double px_right = std::ceil((r.right() - tif.xLeft()) / cs - eps);
+            double py_top = std::floor((tif.yTop() - r.bottom()) / cs + eps); // first TIF row (the TIF starts at the upper edge)
+            double py_bottom = std::ceil((tif.yTop() - r.top()) / cs - eps);
+            RectF window(tif.xLeft() + px_left * cs, tif.yTop() - py_bottom * cs,
+                         tif.xLeft() + px_right * cs, tif.yTop() - py_top * cs);
+            dem.setup(window, cs);
+            dem.loadWindowFromGeoTIFF(filename);
+        } else {
+            dem.loadGridFromFile(filename);
         }
-        dem.loadGridFromFile(filename);
-        lg->debug("Loaded a digital elevation model (DEM) from '{}'. Cellsize: {}m, Left-Right: {}m - {}m, Top-Bottom: {}m - {}m.", filename, dem.cellsize(), dem.metricRect().left(), dem.metricRect().right(), dem.metricRect().top(), dem.metricRect().bottom());
+        if (!dem.isEmpty())
+            lg->debug("Loaded a digital elevation model (DEM) from '{}'. Cellsize: {}m, Left-Right: {}m - {}m, Top-Bottom: {}m - {}m.", filename, dem.cellsize(), dem.metricRect().left(), dem.metricRect().right(), dem.metricRect().top(), dem.metricRect().bottom());
     }
 
-
-    // now set up the landscape cells
-    // the grid has the same size:
+    // setup the env-grid and the landscape cells with the same extent:
+    mEnvironmentGrid.setup(mIdGrid.metricRect(), mIdGrid.cellsize());
     mGrid.setup(mEnvironmentGrid.metricRect(), mEnvironmentGrid.cellsize());
 
-    Cell *a=mGrid.begin();
-    int cell_index = 0;
-    mNCells = 0;
-    for (EnvironmentCell **ec=mEnvironmentGrid.begin(); ec!=mEnvironmentGrid.end(); ++ec, ++a, ++cell_index)
-        if (*ec) {
-            a->setCellIndex(cell_index);
+    // dense look up of environment cells: do this only when cell-vector does not change anymore
+    EnvironmentIndex env_index;
+    env_index.setup(mEnvironmentCells);
+
+    // resolve the environment cells and set up the landscape cells (in parallel for blocks of rows)
+    size_t n_blocks = rowBlockCount(mIdGrid.sizeX(), mIdGrid.sizeY());
+    std::vector<int> block_cells(n_blocks, 0);
+    std::vector<int> block_invalid(n_blocks, -1); // index of the first invalid ID per block
+    runRowBlocks(mIdGrid.sizeX(), mIdGrid.sizeY(), [&](size_t block, int begin, int end) {
+        int n = 0;
+        for (int i=begin; i<end; ++i) {
+            int id = mIdGrid[i];
+            if (mIdGrid.isNull(id)) {
+                mEnvironmentGrid[i] = nullptr;
+                continue;
+            }
+            int row = env_index.find(id);
+            if (row < 0) {
+                mEnvironmentGrid[i] = nullptr;
+                if (block_invalid[block] < 0)
+                    block_invalid[block] = i;
+                continue;
+            }
+            EnvironmentCell *ec = &mEnvironmentCells[static_cast<size_t>(row)];
+            mEnvironmentGrid[i] = ec;
+            Cell &a = mGrid[i];
+            a.setCellIndex(i);
             // set to invalid state (different from NULL which is outside of the project area)
-            a->setInvalid();
+            a.setInvalid();
             // establish link to the environment
-            a->setEnvironmentCell(*ec);
+            a.setEnvironmentCell(ec);
             if (!dem.isEmpty()) {
-                PointF p = mGrid.cellCenterPoint(cell_index);
+                PointF p = mGrid.cellCenterPoint(i);
                 if (!dem.coordValid(p))
                     throw logic_error_fmt("The digital elevation model '{}' is not valid for the point {}/{} (which is within the project area)!", filename, p.x(), p.y());
-                a->setElevation( dem[p] );
+                a.setElevation( dem[p] );
             }
-            ++mNCells;
+            ++n;
+        }
+        block_cells[block] = n;
+    });
+
+    for (int invalid : block_invalid)
+        if (invalid >= 0) {
+            std::string grid_file_name = Tools::path(settings.valueString("landscape.grid"));
+            std::string table_file_name = Tools::path(settings.valueString("landscape.file"));
+            lg->error("Setup of the landscape: the ID {} (found at index {}/{} of grid '{}') is not present as 'id' in the landscape file '{}'.", mIdGrid[invalid], mIdGrid.indexOf(invalid).x(), mIdGrid.indexOf(invalid).y(), grid_file_name, table_file_name);
+            throw std::logic_error("Setup of the landscape: The ID '" + std::to_string(mIdGrid[invalid]) + "' is invalid. Check the log for additional details.");
         }
 
+    mNCells = 0;
+    for (int n : block_cells)
+        mNCells += n;
+
+    // the ID grid is no longer needed
+    mIdGrid.clear();
 
     setupInitialState();
 
@@ -185,28 +351,42 @@ void Landscape::setupInitialState()
 
     if (mode=="file") {
         // check if keys are available:
-        auto i_state = indexOf(EnvironmentCell::variables(), "initialStateId");
-        auto i_restime = indexOf(EnvironmentCell::variables(), "initialResidenceTime");
-        if (i_state<0 || i_restime<0)
+        EnvironmentColumn col_state = EnvironmentCell::column("initialStateId");
+        EnvironmentColumn col_restime = EnvironmentCell::column("initialResidenceTime");
+        if (!col_state.isValid() || !col_restime.isValid())
             throw std::logic_error("Initialize landscape state: mode is 'file' and the 'landscape.file' does not contain the columns 'initialStateId' and/or 'initialResidenceTime'.");
 
-        Cell *cell = grid().begin();
-        bool error = false;
-        int n_affected=0;
-        for (EnvironmentCell **ec=mEnvironmentGrid.begin(); ec!=mEnvironmentGrid.end(); ++ec, ++cell)
-            if (*ec) {
-                state_t t= state_t( (*ec)->value(static_cast<size_t>(i_state)) );
-                short int res_time = static_cast<short int> ( (*ec)->value(static_cast<size_t>(i_restime)) );
+        // the states are set in parallel (blocks of rows); invalid states are reported afterwards (in grid order)
+        size_t n_blocks = rowBlockCount(grid().sizeX(), grid().sizeY());
+        std::vector<int> block_affected(n_blocks, 0);
+        std::vector< std::vector<int> > block_errors(n_blocks);
+        runRowBlocks(grid().sizeX(), grid().sizeY(), [&](size_t block, int begin, int end) {
+            for (int i=begin; i<end; ++i) {
+                const EnvironmentCell *ec = mEnvironmentGrid[i];
+                if (!ec)
+                    continue;
+                state_t t= state_t( col_state(ec) );
+                short int res_time = static_cast<short int> ( col_restime(ec) );
                 if (!Model::instance()->states()->isValid(t)) {
-                    if (!error) lg->error("Initalize states from landscape file '{}': Errors detected:", settings.valueString("landscape.file"));
-                    error = true;
-                    lg->error("State: {} not valid (at {}/{})", t, grid().indexOf(cell).x(), grid().indexOf(cell).y());
+                    block_errors[block].push_back(i);
                 } else {
-                    cell->setState(t);
-                    cell->setResidenceTime(res_time);
-                    ++n_affected;
+                    Cell &cell = grid()[i];
+                    cell.setState(t);
+                    cell.setResidenceTime(res_time);
+                    ++block_affected[block];
                 }
             }
+        });
+        bool error = false;
+        int n_affected=0;
+        for (size_t b=0;b<n_blocks;++b) {
+            n_affected += block_affected[b];
+            for (int i : block_errors[b]) {
+                if (!error) lg->error("Initalize states from landscape file '{}': Errors detected:", settings.valueString("landscape.file"));
+                error = true;
+                lg->error("State: {} not valid (at {}/{})", state_t( col_state(mEnvironmentGrid[i]) ), grid().indexOf(i).x(), grid().indexOf(i).y());
+            }
+        }
         if (error) {
             throw std::logic_error("Initalize states from file: invalid states! Check the log for details.");
         }
@@ -233,36 +413,49 @@ void Landscape::setupInitialState()
         lg->debug("Loaded initial *residenceTime* grid '{}'. Dimensions: {} x {}, with cell size: {}m. ", restime_grid_file, restime_grid.sizeX(), restime_grid.sizeY(), restime_grid.cellsize());
         lg->debug("Metric rectangle with {}x{}m. Left-Right: {}m - {}m, Top-Bottom: {}m - {}m.  ", restime_grid.metricRect().width(), restime_grid.metricRect().height(), restime_grid.metricRect().left(), restime_grid.metricRect().right(), restime_grid.metricRect().top(), restime_grid.metricRect().bottom());
 
-        int n_affected=0;
-        int n_errors=0;
-        for (int i=0;i<grid().count(); ++i) {
-            if (!grid()[i].isNull()) {
+        // set the states in parallel (blocks of rows); error messages are collected per block and logged afterwards
+        size_t n_blocks = rowBlockCount(grid().sizeX(), grid().sizeY());
+        std::vector<int> block_affected(n_blocks, 0);
+        std::vector<int> block_errors(n_blocks, 0);
+        std::vector< std::vector<std::string> > block_messages(n_blocks);
+        runRowBlocks(grid().sizeX(), grid().sizeY(), [&](size_t block, int begin, int end) {
+            auto &messages = block_messages[block];
+            for (int i=begin; i<end; ++i) {
+                if (grid()[i].isNull())
+                    continue;
                 PointF p = grid().cellCenterPoint(i);
                 if (!state_grid.coordValid(p) || !restime_grid.coordValid(p)) {
-                    ++n_errors;
-                    if (n_errors<100)
-                        lg->error("Init landscape: cell with index '{}' ({}/{}) not valid in state or residence time grid.", i, p.x(), p.y());
+                    if (block_errors[block]++ < 100)
+                        messages.push_back(fmt::format("Init landscape: cell with index '{}' ({}/{}) not valid in state or residence time grid.", i, p.x(), p.y()));
+                    continue;
+                }
+                int intstate = state_grid.valueAt(p);
+                if (intstate == state_grid.nullValue()) {
+                    if (block_errors[block]++ < 120)
+                        messages.push_back(fmt::format("Init landscape: NA at {}/{}: not a valid stateId.",  p.x(), p.y()));
+                    continue;
+                }
+                state_t state = static_cast<state_t>(intstate);
+                restime_t restime = static_cast<restime_t>(restime_grid.valueAt(p));
+                if (!Model::instance()->states()->isValid(state)) {
+                    if (block_errors[block]++ < 120) // make sure we get at least some of those errors....
+                        messages.push_back(fmt::format("Init landscape: state '{}' (at {}/{}) is not a valid stateId.", state, p.x(), p.y()));
                 } else {
-                    int intstate = state_grid.valueAt(p);
-                    if (intstate == state_grid.nullValue()) {
-                        ++n_errors;
-                        if (n_errors<120)
-                            lg->error("Init landscape: NA at {}/{}: not a valid stateId.",  p.x(), p.y());
-                        continue;
-                    }
-                    state_t state = static_cast<state_t>(state_grid.valueAt(p));
-                    restime_t restime = static_cast<restime_t>(restime_grid.valueAt(p));
-                    if (!Model::instance()->states()->isValid(state)) {
-                        ++n_errors;
-                        if (n_errors<120) // make sure we get at least some of those errors....
-                            lg->error("Init landscape: state '{}' (at {}/{}) is not a valid stateId.", state, p.x(), p.y());
-                    } else {
-                        grid()[i].setResidenceTime(restime);
-                        grid()[i].setState(state);
-                        ++n_affected;
-                    }
+                    grid()[i].setResidenceTime(restime);
+                    grid()[i].setState(state);
+                    ++block_affected[block];
                 }
             }
+        });
+        int n_affected=0;
+        int n_errors=0;
+        size_t n_logged=0;
+        for (size_t b=0;b<n_blocks;++b) {
+            n_affected += block_affected[b];
+            n_errors += block_errors[b];
+            for (const auto &msg : block_messages[b])
+                if (n_logged++ < 120)
+                    lg->error("{}", msg);
         }
         if (n_errors>0)
             throw std::logic_error("Error in setting up the initial landscape scape (from grid). Check the log.");
@@ -20,6 +20,7 @@
 #define LANDSCAPE_H
 
 #include <cassert>
+#include <memory>
 
 #include "grid.h"
 #include "cell.h"
@@ -30,7 +31,15 @@ class Landscape
 {
 public:
     Landscape();
+    /// set up the landscape (setupEnvironment() and setupGrid())
     void setup();
+    /// first setup step: load the environment table and the grid of IDs. Afterwards, climateIds() is available.
+    void setupEnvironment();
+    /// second setup step: link the landscape cells to the environment (and the DEM), and set the initial state.
+    void setupGrid();
+    /// set up the landscape of a replicate model: the environment of 'source' is shared,
+    /// and the cells are a copy of the cells of 'source'.
+    void setup(const std::shared_ptr<Landscape> &source);
 
 
     // access
@@ -52,15 +61,18 @@ public:
     /// a list of all climate ids (regions) that are present in the current landscape
     const std::map<int, int> &climateIds() { return mClimateIds; }
 
-private:
+    /// set the initial state of the cells (initialState.*)
     void setupInitialState();
+private:
     Grid<Cell> mGrid;
 
+    Grid<int> mIdGrid; ///< grid with IDs of environment cells (only during setup)
     Grid<EnvironmentCell*> mEnvironmentGrid;
     std::vector<EnvironmentCell> mEnvironmentCells;
     int mNCells; ///< number of valid cells on the landsscape
 
     std::map<int, int> mClimateIds;
+    std::shared_ptr<Landscape> mSource; ///< landscape that owns the environment cells (replicate models)
 };
 
 #endif // LANDSCAPE_H
@@ -22,16 +22,33 @@
 #include "../Predictor/batchmanager.h"
 #include "modules/module.h"
 #include "expressionwrapper.h"
+#include "outputs/statechangelogout.h"
+#include "taskgraph.h"
+#include "checkpoint.h"
+#include "randomgen.h"
 
 #include <QThreadPool>
+#include <chrono>
+#include <algorithm>
 
 Model *Model::mInstance = nullptr;
+thread_local Model *Model::mCurrent = nullptr;
 
-Model::Model(const std::string &fileName, Settings *externalSettings)
+Model::Model(const std::string &fileName, Settings *externalSettings, Model *shared)
 {
-    if (mInstance!=nullptr)
-        throw std::logic_error("Creation of model: model instance ptr is not 0.");
-    mInstance = this;
+    // replicates of a replicate use the inputs of the original model
+    mShared = shared && shared->mShared ? shared->mShared : shared;
+    mNReplicates = 0;
+    mReplicateIndex = mShared ? ++mShared->mNReplicates : 0;
+    if (!mShared) {
+        if (mInstance!=nullptr)
+            throw std::logic_error("Creation of model: model instance ptr is not 0.");
+        mInstance = this;
+    } else if (mShared->year() < 0) {
+        throw std::logic_error("Creation of replicate model: the shared model is not set up.");
+    }
+    mRunState = nullptr;
+    mBatchManager = nullptr;
     mYear = -1; // not set up
 
     if (externalSettings) {
@@ -43,6 +60,13 @@ Model::Model(const std::string &fileName, Settings *externalSettings)
         mSettings.loadFromFile(fileName);
     }
     auto split_path = splitPath(fileName);
+    if (mShared) {
+        // replicates use the logging and the project folder of the shared model
+        lg_main = spdlog::get("main");
+        lg_setup = spdlog::get("setup");
+        lg_setup->info("Replicate model, config file: '{}'", fileName);
+        return;
+    }
     Tools::setupPaths( split_path.first, &mSettings );
 
     // set up logging
@@ -54,12 +78,30 @@ Model::Model(const std::string &fileName, Settings *externalSettings)
 
 Model::~Model()
 {
+    // write pending output data before logging is shut down
+    try {
+        if (mOutputManager)
+            mOutputManager->flush();
+    } catch (const std::exception &e) {
+        if (lg_main)
+            lg_main->error("Error while writing outputs: {}", e.what());
+    }
+    if (mShared)
+        return; // logging is owned by the shared model
     shutdownLogging();
     mInstance = nullptr;
 }
 
 bool Model::setup()
 {
+    // code running during the setup accesses this model with Model::instance()
+    ModelScope scope(this);
+    seedRandomGenerator();
+    if (mShared) {
+        setupReplicate();
+        return true;
+    }
+
     // general setup
     bool mt = settings().valueBool("model.multithreading", "true");
     if (mt) {
@@ -72,55 +114,353 @@ bool Model::setup()
         QThreadPool::globalInstance()->setMaxThreadCount( 1 );
         lg_setup->info("Disabled multithreading for the model.");
     }
+    setGridFileCache( settings().valueBool("model.gridCache", "false") );
+    if (gridFileCache())
+        lg_setup->debug("Enabled the binary cache for ASCII grids (model.gridCache).");
 
-    // set up outputs
+    // set up the model components. The setup steps are run as a task graph: steps that
+    // do not depend on each other (e.g. loading the climate and setting up the landscape) run concurrently.
     mOutputManager = std::shared_ptr<OutputManager>(new OutputManager());
-    mOutputManager->setup();
-
-    // set up model components
-    setupSpecies();
     mStates = std::shared_ptr<States>(new States());
-    mStates->setup();
-
     mLandscape = std::shared_ptr<Landscape>(new Landscape());
-    mLandscape->setup();
-
     mClimate = std::shared_ptr<Climate>(new Climate());
-    mClimate->setup();
 
-    mExternalSeeds.setup();
-
-    setupModules();
-
-    setupExpressionWrapper();
+    // the tasks run in worker threads, and are bound to this model
+    auto task = [this](std::function<void()> fn) { return [this, fn]() { ModelScope scope(this); fn(); }; };
+    TaskGraph setup_tasks;
+    setup_tasks.add("outputs", task([this]() { mOutputManager->setup(); }));
+    setup_tasks.add("species", task([this]() { setupSpecies(); }));
+    setup_tasks.add("states", task([this]() { mStates->setup(); }), {"species"});
+    setup_tasks.add("environment", task([this]() { mLandscape->setupEnvironment(); }));
+    // the climate requires only the climate ids of the landscape
+    setup_tasks.add("climate", task([this]() { mClimate->setup(); }), {"environment"});
+    setup_tasks.add("landscape", task([this]() { mLandscape->setupGrid(); }), {"environment", "states"});
+    setup_tasks.add("externalSeeds", task([this]() { mExternalSeeds.setup(); }), {"landscape", "states", "species"});
+    setup_tasks.add("modules", task([this]() { setupModules(); }), {"outputs", "climate", "externalSeeds"});
+    setup_tasks.add("expressions", task([this]() { setupExpressionWrapper(); }), {"modules"});
+    setup_tasks.add("neighborhood", task([this]() {
+        mStates->updateStateHistogram();
+        mNeighborhood = std::shared_ptr<NeighborhoodStats>(new NeighborhoodStats());
+        mNeighborhood->setup();
+    }), {"modules"});
+    setup_tasks.run(mt);
+
+    mYear = 0;
+    // keep a snapshot of the initial state for fast resets (see reset())
+    mInitialState.clear();
+    if (settings().valueBool("model.keepInitialState", "false")) {
+        CheckpointWriter writer;
+        writeState(writer);
+        mInitialState = writer.data();
+        lg_setup->debug("Stored the initial state of the model ({} MB).", mInitialState.size() / (1024*1024));
+    }
 
-    mStates->updateStateHistogram();
+    if (settings().hasKey("model.restore") && !settings().valueString("model.restore").empty())
+        restoreCheckpoint(Tools::path(settings().valueString("model.restore")));
 
     lg_setup->info("************************************************************");
     lg_setup->info("************   Setup completed, Ready to run  **************");
     lg_setup->info("************************************************************");
 
-    mYear = 0; // model is set up, ready to run
+    // model is set up, ready to run (mYear is 0, or the year of the restored checkpoint)
     return true;
 
 }
 
+void Model::setupReplicate()
+{
+    auto start = std::chrono::steady_clock::now();
+    checkReplicateSettings();
+
+    // read-only inputs are shared: the climate, the environment and the initial landscape
+    mSpeciesList = mShared->mSpeciesList;
+    mClimate = mShared->mClimate;
+    mExternalSeeds = mShared->mExternalSeeds;
+    // the states (which are linked to the modules of a model) and the landscape are copied
+    mStates = std::shared_ptr<States>(new States());
+    mStates->setup(*mShared->mStates);
+    mLandscape = std::shared_ptr<Landscape>(new Landscape());
+    mLandscape->setup(mShared->mLandscape);
+
+    mOutputManager = std::shared_ptr<OutputManager>(new OutputManager());
+    mOutputManager->setup();
+    setupModules();
+    // the variables of expressions are the same as in the shared model (CellWrapper)
+    if (mModules.size() != mShared->mModules.size())
+        throw std::logic_error("Setup of replicate model: the modules differ from the modules of the shared model.");
+    for (size_t i=0;i<mModules.size();++i)
+        if (mModules[i]->name() != mShared->mModules[i]->name() || mModules[i]->type() != mShared->mModules[i]->type())
+            throw logic_error_fmt("Setup of replicate model: the module '{}' differs from the modules of the shared model.", mModules[i]->name());
+
+    mStates->updateStateHistogram();
+    mNeighborhood = std::shared_ptr<NeighborhoodStats>(new NeighborhoodStats());
+    mNeighborhood->setup();
+
+    mYear = 0;
+    mInitialState.clear();
+    if (settings().valueBool("model.keepInitialState", "false")) {
+        CheckpointWriter writer;
+        writeState(writer);
+        mInitialState = writer.data();
+    }
+    if (settings().hasKey("model.restore") && !settings().valueString("model.restore").empty())
+        restoreCheckpoint(Tools::path(settings().valueString("model.restore")));
+
+    lg_setup->info("Setup of replicate model completed ({} ms).",
+                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Model::seedRandomGenerator()
+{
+    // no seed: the default seed of the generator (the same random numbers in every run); 0: seed from the clock
+    uint64_t seed = std::mt19937_64::default_seed;
+    if (settings().hasKey("model.randomSeed") && !settings().valueString("model.randomSeed").empty()) {
+        int value = settings().valueInt("model.randomSeed");
+        seed = value == 0 ? static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()) : static_cast<uint64_t>(value);
+    }
+    // replicates use different (but reproducible) random numbers
+    seed += static_cast<uint64_t>(mReplicateIndex);
+    mRandom.setSeed(seed);
+    lg_setup->debug("Random number generator: seed {} (replicate index {}).", seed, mReplicateIndex);
+}
+
+void Model::checkReplicateSettings()
+{
+    // the settings for inputs that are shared need to be identical
+    const std::vector<std::string> shared_sections = {"landscape.", "climate.", "states.", "externalSeeds.", "initialState.", "dnn.", "model.species"};
+    for (const auto &section : shared_sections) {
+        auto keys = settings().findKeys(section);
+        auto shared_keys = mShared->settings().findKeys(section);
+        for (const auto &k : shared_keys)
+            if (!contains(keys, k))
+                keys.push_back(k);
+        for (const auto &k : keys) {
+            std::string value = settings().hasKey(k) ? settings().valueString(k) : std::string();
+            std::string shared_value = mShared->settings().hasKey(k) ? mShared->settings().valueString(k) : std::string();
+            if (value != shared_value)
+                throw logic_error_fmt("Setup of replicate model: the setting '{}' ('{}') differs from the shared model ('{}').", k, value, shared_value);
+        }
+    }
+}
+
 void Model::finalizeYear()
 {
+    // the state change log records all cells that change their state
+    StateChangeLogOut *change_log = dynamic_cast<StateChangeLogOut*>(outputManager()->find("StateChangeLog"));
+    if (change_log && !change_log->enabled())
+        change_log = nullptr;
+
     // increment residence time for all pixels (updated pixels go from 0 -> 1)
     for (Cell &c : landscape()->grid()) {
         if (!c.isNull()) {
+            state_t old_state = c.stateId();
+            restime_t old_restime = c.residenceTime();
             c.update();
+            if (change_log && c.stateId() != old_state)
+                change_log->addChange(c.cellIndex(), old_state, c.stateId(), old_restime);
 
         }
     }
+    if (change_log)
+        outputManager()->run("StateChangeLog");
 
     mStates->updateStateHistogram();
+    mNeighborhood->update();
 
     outputManager()->yearEnd();
 
     stats.NPackagesTotalSent += stats.NPackagesSent;
     stats.NPackagesTotalDNN += stats.NPackagesDNN;
+
+    // write a checkpoint every n years
+    std::string checkpoint_file = settings().valueString("model.checkpoint.file", "");
+    int checkpoint_interval = settings().valueInt("model.checkpoint.interval", 10);
+    if (!checkpoint_file.empty() && checkpoint_interval > 0 && mYear % checkpoint_interval == 0)
+        saveCheckpoint(Tools::path(checkpoint_file));
+}
+
+// layout of checkpoint files: header, followed by the sections 'landscape', 'random', 'stats', and 'module:<name>'
+static const char cCheckpointMagic[8] = {'S','V','D','C','K','P','T','1'};
+static const int cCheckpointVersion = 1;
+
+void Model::saveCheckpoint(const std::string &file_name)
+{
+    auto start = std::chrono::steady_clock::now();
+    CheckpointWriter writer(file_name);
+    writeState(writer);
+    writer.commit();
+    lg_main->info("Saved checkpoint for year {} to '{}' ({} ms).", mYear, file_name,
+                  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Model::restoreCheckpoint(const std::string &file_name)
+{
+    auto start = std::chrono::steady_clock::now();
+    CheckpointReader reader(file_name);
+    readState(reader, true);
+    lg_setup->info("Restored the checkpoint '{}' (year {}, {} ms).", file_name, mYear,
+                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Model::reset(const std::map<std::string, std::string> &changed_settings)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (mInitialState.empty())
+        throw std::logic_error("Model reset: the initial state of the model is not available (set 'model.keepInitialState' to 'true').");
+
+    // inputs that are loaded during the setup can not be changed
+    const std::vector<std::string> fixed_sections = {"landscape.", "climate.", "states.", "externalSeeds.", "dnn.", "logging.", "visualization.", "model.species"};
+    for (const auto &s : changed_settings)
+        for (const auto &fixed : fixed_sections)
+            if (s.first.compare(0, fixed.size(), fixed) == 0)
+                throw logic_error_fmt("Model reset: the setting '{}' can not be changed without a new setup of the model.", s.first);
+
+    bool initial_state_changed = false;
+    bool seed_changed = false;
+    std::vector<Module*> changed_modules;
+    for (const auto &s : changed_settings) {
+        mSettings.setValue(s.first, s.second);
+        if (s.first == "model.randomSeed")
+            seed_changed = true;
+        lg_setup->debug("Model reset: set '{}' to '{}'.", s.first, s.second);
+        if (s.first.compare(0, 13, "initialState.") == 0)
+            initial_state_changed = true;
+        if (s.first.compare(0, 8, "modules.") == 0) {
+            Module *m = module(s.first.substr(8, s.first.find('.', 8) - 8));
+            if (m && !contains(changed_modules, m))
+                changed_modules.push_back(m);
+        }
+    }
+
+    // restore the landscape and the modules (the random number generator continues, i.e. replicates differ,
+    // unless a new seed is set)
+    CheckpointReader reader(mInitialState, "initial state");
+    readState(reader, false);
+    if (seed_changed)
+        seedRandomGenerator();
+    if (initial_state_changed) {
+        mLandscape->setupInitialState();
+        mStates->updateStateHistogram();
+        mNeighborhood->update();
+    }
+    for (auto *m : changed_modules)
+        m->updateParameters();
+
+    // the outputs start again with new files (otherwise the years would be appended a second time)
+    mOutputManager->reset();
+
+    stats = SystemStats();
+    lg_main->info("Model reset to the initial state ({} changed settings, {} ms).", changed_settings.size(),
+                  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Model::writeState(CheckpointWriter &writer)
+{
+    writer.writeArray(cCheckpointMagic, 8);
+    writer.write(cCheckpointVersion);
+    writer.write(mYear);
+    const Grid<Cell> &grid = mLandscape->grid();
+    writer.write(grid.sizeX());
+    writer.write(grid.sizeY());
+    writer.write(mLandscape->NCells());
+
+    // the cells of the landscape (only cells within the project area), column-wise
+    writer.beginSection("landscape");
+    std::vector<state_t> states; std::vector<restime_t> restimes;
+    std::vector<int> next_updates; std::vector<state_t> next_states;
+    states.reserve(static_cast<size_t>(mLandscape->NCells()));
+    restimes.reserve(states.capacity()); next_updates.reserve(states.capacity()); next_states.reserve(states.capacity());
+    for (const Cell *c = grid.begin(); c!=grid.end(); ++c)
+        if (!c->isNull()) {
+            states.push_back(c->stateId());
+            restimes.push_back(c->residenceTime());
+            next_updates.push_back(c->nextUpdate());
+            next_states.push_back(c->nextStateId());
+        }
+    writer.writeVector(states);
+    writer.writeVector(restimes);
+    writer.writeVector(next_updates);
+    writer.writeVector(next_states);
+    writer.endSection();
+
+    writer.beginSection("random");
+    writer.writeString(mRandom.state());
+    writer.endSection();
+
+    writer.beginSection("stats");
+    writer.write(static_cast<uint64_t>(stats.NPackagesTotalSent));
+    writer.write(static_cast<uint64_t>(stats.NPackagesTotalDNN));
+    writer.endSection();
+
+    for (const auto &module : mModules) {
+        writer.beginSection("module:" + module->name());
+        module->saveCheckpoint(writer);
+        writer.endSection();
+    }
+}
+
+void Model::readState(CheckpointReader &reader, bool restore_random)
+{
+    const std::string &file_name = reader.fileName();
+    char magic[8];
+    reader.readArray(magic, 8);
+    if (!std::equal(magic, magic+8, cCheckpointMagic))
+        throw logic_error_fmt("Restore checkpoint: '{}' is not a checkpoint file.", file_name);
+    int version = reader.read<int>();
+    if (version != cCheckpointVersion)
+        throw logic_error_fmt("Restore checkpoint: the version of '{}' ({}) is not supported (expected: {}).", file_name, version, cCheckpointVersion);
+    int year = reader.read<int>();
+    int size_x = reader.read<int>();
+    int size_y = reader.read<int>();
+    int n_cells = reader.read<int>();
+    Grid<Cell> &grid = mLandscape->grid();
+    if (size_x != grid.sizeX() || size_y != grid.sizeY() || n_cells != mLandscape->NCells())
+        throw logic_error_fmt("Restore checkpoint: the landscape in '{}' ({} x {}, {} cells) does not match the current landscape ({} x {}, {} cells).",
+                              file_name, size_x, size_y, n_cells, grid.sizeX(), grid.sizeY(), mLandscape->NCells());
+
+    std::vector<std::string> restored_modules;
+    while (!reader.atEnd()) {
+        std::string section = reader.beginSection();
+        if (section == "landscape") {
+            auto states = reader.readVector<state_t>();
+            auto restimes = reader.readVector<restime_t>();
+            auto next_updates = reader.readVector<int>();
+            auto next_states = reader.readVector<state_t>();
+            size_t n = states.size();
+            if (n != static_cast<size_t>(n_cells) || restimes.size()!=n || next_updates.size()!=n || next_states.size()!=n)
+                throw logic_error_fmt("Restore checkpoint: invalid landscape data in '{}'.", file_name);
+            size_t i = 0;
+            for (Cell *c = grid.begin(); c!=grid.end(); ++c)
+                if (!c->isNull()) {
+                    if (states[i]!=0 && !mStates->isValid(states[i]))
+                        throw logic_error_fmt("Restore checkpoint: the state {} (cell {}) is not a valid state.", states[i], c->cellIndex());
+                    c->restore(states[i], restimes[i], next_updates[i], next_states[i]);
+                    ++i;
+                }
+        } else if (section == "random" && restore_random) {
+            mRandom.setState(reader.readString());
+        } else if (section == "stats") {
+            stats.NPackagesTotalSent = static_cast<size_t>(reader.read<uint64_t>());
+            stats.NPackagesTotalDNN = static_cast<size_t>(reader.read<uint64_t>());
+        } else if (section.compare(0, 7, "module:") == 0 && module(section.substr(7))) {
+            module(section.substr(7))->restoreCheckpoint(reader);
+            restored_modules.push_back(section.substr(7));
+        } else {
+            if (section != "random")
+                lg_setup->warn("Restore checkpoint: the section '{}' of '{}' is ignored (e.g., the module is not active).", section, file_name);
+            reader.skipSection();
+            continue;
+        }
+        reader.endSection();
+    }
+    for (const auto &m : mModules)
+        if (!contains(restored_modules, m->name()))
+            lg_setup->warn("Restore checkpoint: the module '{}' is not part of the checkpoint '{}' and keeps its current state.", m->name(), file_name);
+
+    // update derived data
+    mYear = year;
+    mStates->updateStateHistogram();
+    mNeighborhood->update();
 }
 
 void Model::runModules()
@@ -249,15 +589,16 @@ void Model::setupSpecies()
 
 void Model::setupModules()
 {
-    // reset module list
-    Module::clearModuleNames();
+    // reset module list (the names of the modules of replicates are already known)
+    if (!mShared)
+        Module::clearModuleNames();
 
     auto module_list = settings().findKeys("modules.", true);
     for (const auto &s : module_list ) {
         if (settings().valueBool("modules." + s + ".enabled", "false")) {
             auto module_type = settings().valueString("modules." + s + ".type", "unknown");
             lg_setup->info("Attempting to create enabled module '{}':", s);
-            std::shared_ptr<Module> module = Module::moduleFactory(s, module_type);
+            std::shared_ptr<Module> module = Module::moduleFactory(s, module_type, !mShared);
             mModules.push_back(module);
             module->setup();
 
@@ -267,7 +608,7 @@ void Model::setupModules()
     // update the states to incorporate new modules
     Model::instance()->states()->updateStateHandlers();
 
-    lg_setup->info("Setup of modules completed, {} active modules: {}", Module::moduleNames().size(),  join(Module::moduleNames(), ","));
+    lg_setup->info("Setup of modules completed, {} active modules: {}", mModules.size(),  join(Module::moduleNames(), ","));
 
 }
 
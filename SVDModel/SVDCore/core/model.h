@@ -21,6 +21,7 @@
 // system
 #include <memory>
 #include <functional>
+#include <atomic>
 
 #include "spdlog/spdlog.h"
 
@@ -30,14 +31,23 @@
 #include "climate.h"
 #include "landscape.h"
 #include "externalseeds.h"
+#include "neighborhoodstats.h"
+#include "randomgen.h"
 #include "outputs/outputmanager.h"
 
+class CheckpointWriter; // forward
+class CheckpointReader; // forward
+class BatchManager; // forward
+
 class Model
 {
 public:
     /// creates a model and loads the settings from the given configuration file.
     /// The content of externalSettings is used for the settings (if present).
-    Model(const std::string &fileName, Settings *externalSettings=nullptr);
+    /// If 'shared' is provided (an already set up model), the model is a replicate: the read-only inputs (climate,
+    /// environment, states, the initial landscape, DNN tensor definitions) are shared with 'shared', and the
+    /// replicate has its own landscape state, modules and outputs. Replicates need to be deleted before 'shared'.
+    Model(const std::string &fileName, Settings *externalSettings=nullptr, Model *shared=nullptr);
     ~Model();
     /// sets up the model components (such as states, climate, landscape) from the config file 'fileName'
     /// returns true on success
@@ -48,19 +58,46 @@ public:
 
     void runModules();
 
+    // checkpoints
+    /// write the state of the simulation (landscape, modules, random generator, year) to the binary file 'file_name'
+    void saveCheckpoint(const std::string &file_name);
+    /// restore the state of the simulation from 'file_name'. The model needs to be set up with the same configuration.
+    void restoreCheckpoint(const std::string &file_name);
+    /// reset the landscape and the modules to the state after setup (requires 'model.keepInitialState').
+    /// 'changed_settings' (key/value) are applied before; changed module settings are applied with Module::updateParameters(),
+    /// and changes of 'initialState.*' re-initialize the landscape. Inputs loaded during setup (landscape, climate, states, ...)
+    /// can not be changed. The outputs are set up again (new output files).
+    void reset(const std::map<std::string, std::string> &changed_settings = {});
+
     // callbacks
     void setProcessEventsCallback( std::function<void()> event) { mProcessEvents = event; }
     void processEvents() { if (mProcessEvents) mProcessEvents(); }
     const ModelRunState &state() const { return mState; }
 
     // access
-    /// access to the currently avaialable global model
+    /// access to the currently avaialable model
     /// this allows accessing the model with Model::instance()->....
+    /// This is the model bound to the current thread (see ModelScope), or the global (first) model.
     static Model *instance() {
-        assert(mInstance!=nullptr);
-        return mInstance; }
+        Model *model = mCurrent ? mCurrent : mInstance;
+        assert(model!=nullptr);
+        return model; }
     /// check if a Model object is available
-    static bool hasInstance() { return mInstance!=nullptr; }
+    static bool hasInstance() { return mCurrent!=nullptr || mInstance!=nullptr; }
+    /// true if the model is a replicate that shares the inputs of another model
+    bool isReplicate() const { return mShared != nullptr; }
+    /// the model that provides the inputs of a replicate (nullptr if the model is not a replicate)
+    Model *sharedModel() const { return mShared; }
+    /// the index of a replicate (1, 2, ... in the order of creation; 0 for the model providing the inputs)
+    int replicateIndex() const { return mReplicateIndex; }
+    /// the random number generator of the model (used by drandom(), nrandom(), irandom())
+    RandomGenerator &randomGenerator() { return mRandom; }
+
+    /// the run state and the batch manager of the model (nullptr: the global instances are used)
+    RunState *runState() const { return mRunState; }
+    void setRunState(RunState *run_state) { mRunState = run_state; }
+    BatchManager *batchManager() const { return mBatchManager; }
+    void setBatchManager(BatchManager *batch_manager) { mBatchManager = batch_manager; }
 
     /// the current time step of the simulation
     /// year=0 after setup, and incremented whenever a new step starts, i.e. first sim. year=1, 2nd year=2, ...
@@ -72,9 +109,13 @@ public:
     std::shared_ptr<Landscape> &landscape() { return mLandscape; }
     std::shared_ptr<Climate> &climate() { return mClimate; }
     const ExternalSeeds &externalSeeds() {return mExternalSeeds; }
+    /// state frequencies in the neighborhood of cells
+    std::shared_ptr<NeighborhoodStats> &neighborhood() { return mNeighborhood; }
 
     /// return ptr to a module with the given name, or nullptr if not available
     Module *module(const std::string &name);
+    /// the list of active modules
+    const std::vector< std::shared_ptr<Module> > &modules() const { return mModules; }
 
     /// access to the output machinery
     std::shared_ptr<OutputManager> &outputManager() { return mOutputManager; }
@@ -97,11 +138,25 @@ private:
     // setup functions
     void setupSpecies();
     void setupModules();
+    /// setup of a replicate model (using the inputs of mShared)
+    void setupReplicate();
+    void checkReplicateSettings();
 
     void setupExpressionWrapper();
+    /// seed the random number generator ('model.randomSeed' plus the replicate index)
+    void seedRandomGenerator();
+
+    // checkpoints
+    void writeState(CheckpointWriter &writer);
+    void readState(CheckpointReader &reader, bool restore_random);
 
     // helpers
     Settings mSettings;
+    Model *mShared; ///< the model providing the inputs of a replicate (nullptr for normal models)
+    int mReplicateIndex;
+    std::atomic<int> mNReplicates; ///< number of replicates created from this model
+    RunState *mRunState;
+    BatchManager *mBatchManager;
 
     // callbacks
     std::function<void()> mProcessEvents;
@@ -109,12 +164,15 @@ private:
 
     // model state
     int mYear;
+    RandomGenerator mRandom;
+    std::string mInitialState; ///< snapshot of the state after setup (see reset())
     // model components
     std::vector<std::string> mSpeciesList;
     std::shared_ptr<States> mStates;
     std::shared_ptr<Climate> mClimate;
     std::shared_ptr<Landscape> mLandscape;
     ExternalSeeds mExternalSeeds;
+    std::shared_ptr<NeighborhoodStats> mNeighborhood;
     std::shared_ptr<OutputManager> mOutputManager;
     // modules
     std::vector< std::shared_ptr<Module> > mModules;
@@ -123,6 +181,22 @@ private:
     std::shared_ptr<spdlog::logger> lg_setup;
     // model instance
     static Model *mInstance;
+    static thread_local Model *mCurrent; ///< the model bound to the current thread
+    friend class ModelScope;
+};
+
+/// ModelScope binds a model to the current thread: while the object lives,
+/// Model::instance() returns 'model' in this thread. Worker tasks that
+/// run code of a model create a ModelScope with the model of the caller.
+class ModelScope
+{
+public:
+    explicit ModelScope(Model *model): mPrevious(Model::mCurrent) { Model::mCurrent = model; }
+    ~ModelScope() { Model::mCurrent = mPrevious; }
+    ModelScope(const ModelScope &) = delete;
+    ModelScope &operator=(const ModelScope &) = delete;
+private:
+    Model *mPrevious;
 };
 
 #endif // MODEL_H
@@ -0,0 +1,171 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "neighborhoodstats.h"
+
+#include <algorithm>
+#include <map>
+
+#include "model.h"
+#include "cell.h"
+#include "strtools.h"
+
+/** @class NeighborhoodStats
+  NeighborhoodStats maintains the number of cells of a given state in the neighborhood of every cell.
+  The neighborhoods are defined by Cell (local: 8 cells, intermediate: a circle with a radius of 3 cells). Every neighborhood
+  is a set of contiguous row segments; the counts are derived from cumulative sums per row, i.e.
+  the costs per cell do not depend on the size of the neighborhood.
+
+  Counts are kept only for states that are actually requested (e.g. by localNB() in expressions).
+  Requesting a state for the first time calculates the counts immediately (thread safe), and update()
+  re-calculates the counts of all tracked states after the states of cells changed.
+  Note that the denominator is always the full number of neighbors (also at the edge of the landscape),
+  as in Cell::stateFrequencyLocal().
+  */
+
+NeighborhoodStats::NeighborhoodStats(): mNLocal(0.), mNIntermediate(0.), mNStates(0)
+{
+}
+
+NeighborhoodStats::~NeighborhoodStats()
+{
+}
+
+void NeighborhoodStats::setup()
+{
+    mLocalSpans = buildSpans(Cell::localNeighbors());
+    mIntermediateSpans = buildSpans(Cell::mediumNeighbors());
+    mNLocal = static_cast<double>(Cell::localNeighbors().size());
+    mNIntermediate = static_cast<double>(Cell::mediumNeighbors().size());
+
+    mNStates = Model::instance()->states()->stateHistogram().size();
+    mCounts.reset(new std::atomic<SStateCounts*>[mNStates]);
+    for (size_t i=0;i<mNStates;++i)
+        mCounts[i].store(nullptr);
+    mStorage.clear();
+    mTracked.clear();
+    spdlog::get("setup")->debug("Neighborhood statistics: {} state ids, local neighborhood: {} cells in {} rows, intermediate neighborhood: {} cells in {} rows.",
+                                mNStates, mNLocal, mLocalSpans.size(), mNIntermediate, mIntermediateSpans.size());
+}
+
+void NeighborhoodStats::update()
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    for (size_t i=0;i<mTracked.size();++i)
+        calculate(mTracked[i], *mStorage[i]);
+}
+
+double NeighborhoodStats::globalFrequency(state_t stateId) const
+{
+    const auto &hist = Model::instance()->states()->stateHistogram();
+    if (stateId<0 || static_cast<size_t>(stateId)>=hist.size())
+        return 0.;
+    return hist[static_cast<size_t>(stateId)] / static_cast<double>( Model::instance()->landscape()->NCells() );
+}
+
+NeighborhoodStats::SStateCounts *NeighborhoodStats::track(state_t stateId)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    size_t idx = static_cast<size_t>(stateId);
+    SStateCounts *c = mCounts[idx].load(std::memory_order_relaxed);
+    if (c)
+        return c; // another thread was faster
+
+    std::unique_ptr<SStateCounts> counts(new SStateCounts());
+    calculate(stateId, *counts);
+    c = counts.get();
+    mStorage.push_back(std::move(counts));
+    mTracked.push_back(stateId);
+    mCounts[idx].store(c, std::memory_order_release);
+    spdlog::get("main")->debug("Neighborhood statistics: tracking state {} ({} states tracked).", stateId, mTracked.size());
+    return c;
+}
+
+void NeighborhoodStats::calculate(state_t stateId, SStateCounts &counts)
+{
+    auto &grid = Model::instance()->landscape()->grid();
+    const int sx = grid.sizeX();
+    const int sy = grid.sizeY();
+    // cumulative sums per row: row[x] is the number of cells with 'stateId' left of x
+    mRowSums.resize(static_cast<size_t>((sx+1)*sy));
+    for (int y=0;y<sy;++y) {
+        int *row = &mRowSums[static_cast<size_t>(y*(sx+1))];
+        row[0] = 0;
+        for (int x=0;x<sx;++x)
+            row[x+1] = row[x] + (grid.valueAtIndex(x,y).stateId() == stateId ? 1 : 0);
+    }
+    if (counts.local.isEmpty()) {
+        counts.local.setup(grid.metricRect(), grid.cellsize());
+        counts.intermediate.setup(grid.metricRect(), grid.cellsize());
+    }
+    countSpans(mLocalSpans, counts.local);
+    countSpans(mIntermediateSpans, counts.intermediate);
+}
+
+void NeighborhoodStats::countSpans(const std::vector<SSpan> &spans, Grid<unsigned char> &target)
+{
+    const int sx = target.sizeX();
+    const int sy = target.sizeY();
+    for (int y=0;y<sy;++y)
+        for (int x=0;x<sx;++x) {
+            int n = 0;
+            for (const auto &s : spans) {
+                int yy = y + s.dy;
+                if (yy<0 || yy>=sy)
+                    continue;
+                int x1 = std::max(x + s.dx_min, 0);
+                int x2 = std::min(x + s.dx_max, sx-1);
+                if (x1>x2)
+                    continue;
+                const int *row = &mRowSums[static_cast<size_t>(yy*(sx+1))];
+                n += row[x2+1] - row[x1];
+                if (s.dy==0 && s.dx_min<=0 && s.dx_max>=0)
+                    n -= row[x+1] - row[x]; // the focal cell is not part of the neighborhood
+            }
+            target.valueAtIndex(x,y) = static_cast<unsigned char>(n);
+        }
+}
+
+std::vector<NeighborhoodStats::SSpan> NeighborhoodStats::buildSpans(const std::vector<Point> &neighbors)
+{
+    if (neighbors.size()>255)
+        throw std::logic_error("NeighborhoodStats: too many cells in neighborhood (max. 255).");
+    std::map<int, SSpan> rows;
+    std::map<int, int> n_cells;
+    for (const auto &p : neighbors) {
+        if (p.x()==0 && p.y()==0)
+            throw std::logic_error("NeighborhoodStats: the focal cell must not be part of the neighborhood.");
+        auto it = rows.find(p.y());
+        if (it == rows.end())
+            rows[p.y()] = SSpan{p.y(), p.x(), p.x()};
+        else {
+            it->second.dx_min = std::min(it->second.dx_min, p.x());
+            it->second.dx_max = std::max(it->second.dx_max, p.x());
+        }
+        n_cells[p.y()]++;
+    }
+    std::vector<SSpan> spans;
+    for (const auto &r : rows) {
+        const SSpan &s = r.second;
+        int expected = s.dx_max - s.dx_min + 1 - (s.dy==0 && s.dx_min<=0 && s.dx_max>=0 ? 1 : 0);
+        if (n_cells[s.dy] != expected)
+            throw logic_error_fmt("NeighborhoodStats: the neighborhood must consist of contiguous rows (row {}: {} cells, expected {}).", s.dy, n_cells[s.dy], expected);
+        spans.push_back(s);
+    }
+    return spans;
+}
@@ -0,0 +1,96 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef NEIGHBORHOODSTATS_H
+#define NEIGHBORHOODSTATS_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+#include "grid.h"
+#include "states.h"
+
+/**
+ * @brief The NeighborhoodStats class provides the frequency of states in the neighborhood of cells.
+ * The counts are kept in grids (one per state) for the states that are actually used (e.g. by the expression
+ * functions localNB() and intermediateNB()). A state is tracked when it is requested the first time, and the
+ * counts of all tracked states are updated once a year (update()) after the states of cells changed.
+ */
+class NeighborhoodStats
+{
+public:
+    NeighborhoodStats();
+    ~NeighborhoodStats();
+    /// set up the neighborhood definitions; requires the landscape and the states
+    void setup();
+    /// re-calculate the counts of all tracked states. Call after the states of cells changed (e.g. at the end of the year).
+    void update();
+
+    /// frequency (0..1) of cells with 'stateId' in the local neighborhood (8 cells) of the cell with 'cellIndex'
+    double localFrequency(int cellIndex, state_t stateId) {
+        SStateCounts *c = counts(stateId);
+        return c && cellIndex>=0 ? c->local[cellIndex] / mNLocal : 0.; }
+    /// frequency (0..1) of cells with 'stateId' in the intermediate neighborhood (radius of 3 cells) of the cell with 'cellIndex'
+    double intermediateFrequency(int cellIndex, state_t stateId) {
+        SStateCounts *c = counts(stateId);
+        return c && cellIndex>=0 ? c->intermediate[cellIndex] / mNIntermediate : 0.; }
+    /// frequency (0..1) of cells with 'stateId' on the landscape (based on States::stateHistogram())
+    double globalFrequency(state_t stateId) const;
+
+    /// number of states for which neighborhood counts are maintained
+    size_t trackedStates() const { return mStorage.size(); }
+
+private:
+    struct SStateCounts {
+        Grid<unsigned char> local; ///< number of cells with the state in the local neighborhood
+        Grid<unsigned char> intermediate; ///< number of cells with the state in the intermediate neighborhood
+    };
+    /// a neighborhood consists of rows of cells (spans); cells of a span are contiguous, but the focal cell is excluded
+    struct SSpan {
+        int dy; ///< row (relative to the focal cell)
+        int dx_min; ///< first column (relative)
+        int dx_max; ///< last column (relative)
+    };
+    /// get the counts for 'stateId' (start tracking the state if necessary); nullptr if the state id is invalid
+    SStateCounts *counts(state_t stateId) {
+        if (stateId<0 || static_cast<size_t>(stateId)>=mNStates)
+            return nullptr;
+        SStateCounts *c = mCounts[static_cast<size_t>(stateId)].load(std::memory_order_acquire);
+        return c ? c : track(stateId);
+    }
+    SStateCounts *track(state_t stateId);
+    /// calculate the neighborhood counts of 'stateId' for the full landscape
+    void calculate(state_t stateId, SStateCounts &counts);
+    void countSpans(const std::vector<SSpan> &spans, Grid<unsigned char> &target);
+    static std::vector<SSpan> buildSpans(const std::vector<Point> &neighbors);
+
+    std::vector<SSpan> mLocalSpans;
+    std::vector<SSpan> mIntermediateSpans;
+    double mNLocal; ///< number of cells in the local neighborhood
+    double mNIntermediate; ///< number of cells in the intermediate neighborhood
+    size_t mNStates; ///< size of the state index (max. state id + 1)
+    std::unique_ptr<std::atomic<SStateCounts*>[]> mCounts; ///< counts per state id (nullptr: state not tracked)
+    std::vector<std::unique_ptr<SStateCounts> > mStorage; ///< counts of the tracked states
+    std::vector<state_t> mTracked; ///< ids of the tracked states
+    std::vector<int> mRowSums; ///< buffer: cumulative number of cells with the state per row
+    std::mutex mMutex;
+};
+
+#endif // NEIGHBORHOODSTATS_H
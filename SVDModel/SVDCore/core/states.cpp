@@ -79,6 +79,16 @@ void States::setup()
 
 }
 
+void States::setup(const States &source)
+{
+    mStates = source.mStates;
+    mStateSet = source.mStateSet;
+    mHandlers.clear();
+    for (auto &s : mStates)
+        s.setModule(nullptr);
+    mStateHistogram.resize(source.mStateHistogram.size());
+}
+
 bool States::loadProperties(const std::string &filename)
 {
     FileReader rdr(filename);
@@ -85,6 +85,8 @@ class States
 public:
     States();
     void setup();
+    /// set up the states as a copy of 'source' (replicate models); module handlers are not copied.
+    void setup(const States &source);
 
     /// load properties from a text file (stateId is the key)
     bool loadProperties(const std::string &filename);
@@ -28,6 +28,12 @@
 #include "expression.h"
 
 TransitionMatrix::TransitionMatrix()
+{
+    mMinState = 0; mNStates = 0;
+    mMinKey = 0; mNKeys = 0;
+}
+
+TransitionMatrix::~TransitionMatrix()
 {
 
 }
@@ -42,6 +48,12 @@ bool TransitionMatrix::load(const std::string &filename)
     auto ip = rdr.columnIndex("p");
     auto iexpr = rdr.columnIndex("expression");
     int n=0;
+    // items per (state, key), in the order of the file
+    std::map< std::pair<state_t, int>, std::vector<size_t> > rows;
+    std::vector<state_t> targets;
+    std::vector<double> probs;
+    std::vector<Expression*> exprs;
+    mExpressions.clear();
     while (rdr.next()) {
         // read line
         state_t id = state_t( rdr.value(is) );
@@ -51,12 +63,15 @@ bool TransitionMatrix::load(const std::string &filename)
         if (p<0. || p>1.)
             throw logic_error_fmt("TransitionMatrix: invalid probability {}. Allowed is the range 0..1", p);
 
-        auto &e = mTM[ {id, key} ];
-        e.push_back(STransitionItem(target, p));
+        rows[ {id, key} ].push_back(targets.size());
+        targets.push_back(target);
+        probs.push_back(p);
+        exprs.push_back(nullptr);
         if (iexpr != std::numeric_limits<std::size_t>::max() )
             if (!rdr.valueString(iexpr).empty()) {
                 //CellWrapper wrap(nullptr);
-                e.back().expr = std::unique_ptr<Expression>(new Expression(rdr.valueString(iexpr)));
+                mExpressions.push_back(std::unique_ptr<Expression>(new Expression(rdr.valueString(iexpr))));
+                exprs.back() = mExpressions.back().get();
                 //e.back().expr->parse(&wrap); // parse immediately
             }
         ++n;
@@ -64,63 +79,169 @@ bool TransitionMatrix::load(const std::string &filename)
 
     // TODO: check transition matrix: states have to be valid, p should sum up to 1
 
-    spdlog::get("setup")->debug("Loaded transition matrix for {} states from file '{}' (processed {} records).", mTM.size(), filename, n);
+    // store the items in the order of the rows
+    mTarget.clear(); mProb.clear(); mExpr.clear();
+    for (const auto &r : rows)
+        for (size_t i : r.second) {
+            mTarget.push_back(targets[i]);
+            mProb.push_back(probs[i]);
+            mExpr.push_back(exprs[i]);
+        }
+    compile(rows);
+
+    spdlog::get("setup")->debug("Loaded transition matrix for {} states from file '{}' (processed {} records).", rows.size(), filename, n);
     return true;
 }
 
-state_t TransitionMatrix::transition(state_t stateId, int key, CellWrapper *cell)
+void TransitionMatrix::compile(std::map<std::pair<state_t, int>, std::vector<size_t> > &rows)
 {
-    auto it = mTM.find({stateId, key});
-    if (it == mTM.end()) {
-        throw logic_error_fmt("TransitionMatrix: no valid transitions found for state {}, key {}", stateId, key);
+    mIndex.clear(); mSparseKeys.clear(); mRowStart.clear(); mRowHasExpr.clear();
+    mNStates = mNKeys = 0;
+    if (rows.empty())
+        return;
+
+    // dense index: all combinations of states and keys in the range of the loaded values
+    state_t max_state = rows.begin()->first.first;
+    int min_key = rows.begin()->first.second, max_key = min_key;
+    mMinState = max_state;
+    for (const auto &r : rows) {
+        mMinState = std::min(mMinState, r.first.first);
+        max_state = std::max(max_state, r.first.first);
+        min_key = std::min(min_key, r.first.second);
+        max_key = std::max(max_key, r.first.second);
     }
-
-    const auto &prob = it->second;
-    if (prob.size() == 1)
-        return prob.front().state;
-    // choose a state probabilistically
-    bool has_expr = false;
-    double p_sum = 0.;
-    for (const auto &item : prob) {
-        p_sum+=item.prob;
-        if (item.expr) {
-            has_expr=true;
-            if (!cell)
-                logic_error_fmt("TransitionMatrix: a transition with an expression: {}, state {} key {} is used, but there is no valid cell.", item.expr->expression(), stateId, key);
-
-        }
+    mMinKey = min_key;
+    mNStates = max_state - mMinState + 1;
+    // use the dense table only if it is not much larger than the number of rows
+    double n_dense = static_cast<double>(mNStates) * (static_cast<double>(max_key) - static_cast<double>(min_key) + 1.);
+    if (n_dense > 65536. && n_dense > 8. * rows.size()) {
+        // the rows are ordered by (state, key), i.e. the position in the list is the row
+        mSparseKeys.reserve(rows.size());
+        for (const auto &r : rows)
+            mSparseKeys.push_back(r.first);
+        spdlog::get("setup")->debug("TransitionMatrix: sparse index for {} rows (range of keys {} - {}).", rows.size(), min_key, max_key);
+    } else {
+        mNKeys = max_key - min_key + 1;
+        mIndex.assign(static_cast<size_t>(mNStates * mNKeys), -1);
     }
 
-    // special case:
-    if (has_expr) {
-        // we need to run the expressions and store their result
-        std::vector<double> ps(prob.size());
-        double *cp = &ps.front();
-        p_sum = 0.;
-        for (const auto &item : prob) {
-            *cp = item.prob;
-            if (item.expr) {
-                *cp *= std::max( item.expr->calculate(*cell), 0.); // multiply base probability with result of the expression, do not allow negative probability
-            }
-            p_sum+= *cp++;
+    // rows and alias tables
+    mAliasProb.assign(mTarget.size(), 1.);
+    mAlias.assign(mTarget.size(), 0);
+    std::vector<int> small, large;
+    std::vector<double> q;
+    int start = 0;
+    for (const auto &r : rows) {
+        if (mSparseKeys.empty())
+            mIndex[static_cast<size_t>((r.first.first - mMinState) * mNKeys + (r.first.second - mMinKey))] = static_cast<int>(mRowStart.size());
+        mRowStart.push_back(start);
+        int n = static_cast<int>(r.second.size());
+        bool has_expr = false;
+        double p_sum = 0.;
+        for (int i=start; i<start+n; ++i) {
+            has_expr |= mExpr[static_cast<size_t>(i)] != nullptr;
+            p_sum += mProb[static_cast<size_t>(i)];
         }
-        double p = nrandom(0, p_sum);
-        p_sum = 0.;
-        for (size_t i=0;i<ps.size();++i) {
-            p_sum += ps[i];
-            if (p < p_sum)
-                return prob[i].state;
+        mRowHasExpr.push_back(has_expr);
+
+        // Vose's alias method: scaled probabilities (mean = 1) are split into 'small' (<1) and 'large' (>=1)
+        if (!has_expr && n>1 && p_sum>0.) {
+            q.resize(static_cast<size_t>(n));
+            small.clear(); large.clear();
+            for (int i=0;i<n;++i) {
+                q[i] = mProb[static_cast<size_t>(start+i)] * n / p_sum;
+                mAlias[static_cast<size_t>(start+i)] = i;
+                if (q[i] < 1.) small.push_back(i); else large.push_back(i);
+            }
+            while (!small.empty() && !large.empty()) {
+                int s = small.back(); small.pop_back();
+                int l = large.back(); large.pop_back();
+                mAliasProb[static_cast<size_t>(start+s)] = q[s];
+                mAlias[static_cast<size_t>(start+s)] = l;
+                q[l] = (q[l] + q[s]) - 1.;
+                if (q[l] < 1.) small.push_back(l); else large.push_back(l);
+            }
+            // remaining items (numerical rest) are always kept
+            for (int i : small) mAliasProb[static_cast<size_t>(start+i)] = 1.;
+            for (int i : large) mAliasProb[static_cast<size_t>(start+i)] = 1.;
         }
+        if (!has_expr && p_sum<=0.)
+            mAliasProb[static_cast<size_t>(start)] = -1.; // marker: no valid target
+        start += n;
+    }
+    mRowStart.push_back(start);
+}
 
+int TransitionMatrix::sparseRowIndex(state_t stateId, int key) const
+{
+    const std::pair<state_t, int> k(stateId, key);
+    auto it = std::lower_bound(mSparseKeys.begin(), mSparseKeys.end(), k);
+    if (it == mSparseKeys.end() || *it != k)
+        return -1;
+    return static_cast<int>(it - mSparseKeys.begin());
+}
+
+state_t TransitionMatrix::transition(state_t stateId, int key, CellWrapper *cell)
+{
+    int row = rowIndex(stateId, key);
+    if (row < 0) {
+        throw logic_error_fmt("TransitionMatrix: no valid transitions found for state {}, key {}", stateId, key);
+    }
+
+    const int start = mRowStart[static_cast<size_t>(row)];
+    const int n = mRowStart[static_cast<size_t>(row)+1] - start;
+    if (n == 1)
+        return mTarget[static_cast<size_t>(start)];
+
+    if (!mRowHasExpr[static_cast<size_t>(row)]) {
+        // choose a state probabilistically (alias method: one random number, constant time)
+        if (mAliasProb[static_cast<size_t>(start)] < 0.)
+            throw logic_error_fmt("TransitionMatrix: no valid target found for state {}, key {}", stateId, key);
+        double u = nrandom(0, n);
+        int i = std::min(static_cast<int>(u), n-1);
+        size_t idx = static_cast<size_t>(start + i);
+        if (u - i < mAliasProb[idx])
+            return mTarget[idx];
+        return mTarget[static_cast<size_t>(start + mAlias[idx])];
     }
 
+    // special case: we need to run the expressions and store their result
+    if (!cell)
+        throw logic_error_fmt("TransitionMatrix: a transition with an expression is used for state {} key {}, but there is no valid cell.", stateId, key);
+
+    const int stack_size = 64;
+    double stack_buffer[stack_size];
+    std::vector<double> heap_buffer;
+    double *ps = stack_buffer;
+    if (n > stack_size) {
+        heap_buffer.resize(static_cast<size_t>(n));
+        ps = heap_buffer.data();
+    }
+    double p_sum = 0.;
+    for (int i=0;i<n;++i) {
+        size_t idx = static_cast<size_t>(start + i);
+        ps[i] = mProb[idx];
+        if (mExpr[idx])
+            ps[i] *= std::max( mExpr[idx]->calculate(*cell), 0.); // multiply base probability with result of the expression, do not allow negative probability
+        p_sum += ps[i];
+    }
     double p = nrandom(0, p_sum);
     p_sum = 0.;
-
-    for (const auto &item : prob) {
-        p_sum+=item.prob;
+    for (int i=0;i<n;++i) {
+        p_sum += ps[i];
+        if (p < p_sum)
+            return mTarget[static_cast<size_t>(start + i)];
+    }
+    // all expressions are 0: choose a target using the base probabilities
+    p_sum = 0.;
+    for (int i=0;i<n;++i)
+        p_sum += mProb[static_cast<size_t>(start + i)];
+    p = nrandom(0, p_sum);
+    p_sum = 0.;
+    for (int i=0;i<n;++i) {
+        p_sum += mProb[static_cast<size_t>(start + i)];
         if (p < p_sum)
-            return item.state;
+            return mTarget[static_cast<size_t>(start + i)];
     }
     throw logic_error_fmt("TransitionMatrix: no valid target found for state {}, key {}", stateId, key);
 }
@@ -20,16 +20,25 @@
 #define TRANSITIONMATRIX_H
 #include <map>
 #include <vector>
+#include <memory>
 
 #include "states.h"
 
 class CellWrapper; // forward
 class Expression; // forward
 
+/** TransitionMatrix stores probabilities of transitions from a state (and a numeric key) to target states.
+ *  After loading, the matrix is compiled into a compact representation: an index (state, key) -> row,
+ *  and the rows (target states, probabilities) stored in contiguous arrays (CSR).
+ *  The index is a dense table over the range of states and keys; if that table would be mostly empty
+ *  (e.g. for a few widely spread keys), a sorted list of the (state, key) pairs is searched instead.
+ *  For rows without expressions, a table for the alias method (Walker) allows sampling in constant time.
+ */
 class TransitionMatrix
 {
 public:
     TransitionMatrix();
+    ~TransitionMatrix();
     bool load(const std::string &filename);
 
     // access
@@ -37,17 +46,40 @@ public:
     /// choose a next state from the transition matrix
     state_t transition(state_t stateId, int key=0, CellWrapper *cell=0);
     /// check if the state stateId has stored transition values
-    bool isValid(state_t stateId, int key=0) { return mTM.find({stateId, key}) != mTM.end(); }
+    bool isValid(state_t stateId, int key=0) const { return rowIndex(stateId, key) >= 0; }
 private:
-    struct STransitionItem {
-      STransitionItem(state_t astate, double aprob): state(astate), prob(aprob) {}
-      state_t state;
-      double prob;
-      std::unique_ptr<Expression> expr;
-    };
-    /// storage for transition matrix: key: state + numerical key, content: list of target states + probabilties
-    std::map< std::pair<state_t, int>,
-              std::vector< STransitionItem > > mTM;
+    /// build the index and the alias tables from the loaded items
+    void compile(std::map< std::pair<state_t, int>, std::vector<size_t> > &rows);
+    /// row of the (state, key) combination, or -1
+    inline int rowIndex(state_t stateId, int key) const {
+        if (!mSparseKeys.empty())
+            return sparseRowIndex(stateId, key);
+        int is = stateId - mMinState, ik = key - mMinKey;
+        if (is < 0 || is >= mNStates || ik < 0 || ik >= mNKeys)
+            return -1;
+        return mIndex[static_cast<size_t>(is * mNKeys + ik)];
+    }
+    int sparseRowIndex(state_t stateId, int key) const;
+    // dense index (state, key) -> row
+    state_t mMinState;
+    int mNStates;
+    int mMinKey;
+    int mNKeys;
+    std::vector<int> mIndex;
+    // sparse index: the sorted (state, key) pairs; the position is the row
+    std::vector< std::pair<state_t, int> > mSparseKeys;
+
+    // rows (CSR): items of row r are stored at mRowStart[r] .. mRowStart[r+1]-1
+    std::vector<int> mRowStart;
+    std::vector<bool> mRowHasExpr; ///< true if at least one item of the row has an expression
+    std::vector<state_t> mTarget; ///< target state
+    std::vector<double> mProb; ///< base probability
+    std::vector<Expression*> mExpr; ///< expression of the item (or nullptr)
+    // alias tables (for rows without expressions)
+    std::vector<double> mAliasProb; ///< probability to keep the item (otherwise use mAlias)
+    std::vector<int> mAlias; ///< alias (index within the row)
+
+    std::vector< std::unique_ptr<Expression> > mExpressions; ///< storage of expressions
 };
 
 #endif // TRANSITIONMATRIX_H
@@ -17,8 +17,10 @@
 **    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ********************************************************************************************/
 #include "modelrunstate.h"
+#include "model.h"
 
 #include <mutex>
+#include <condition_variable>
 #include <sstream>
 
 #include "spdlog/spdlog.h"
@@ -69,19 +71,41 @@ ModelRunState::State ModelRunState::combine(const ModelRunState &model, const Mo
     return model.state();
 }
 
+static std::mutex runstate_wait_mutex;
+static std::condition_variable runstate_changed;
+
 void ModelRunState::update()
 {
     // notify parent state....
     RunState::instance()->update(this);
+    // wake up threads waiting for a state change (see RunState::waitWhile())
+    { std::lock_guard<std::mutex> guard(runstate_wait_mutex); }
+    runstate_changed.notify_all();
 }
 
 RunState::RunState()
 {
-    mInstance = this;
+    // the first run state is the global run state; run states of replicates are set with Model::setRunState()
+    if (mInstance==nullptr)
+        mInstance = this;
     mInUpdate = false;
     clear();
 }
 
+RunState::~RunState()
+{
+    if (mInstance==this)
+        mInstance = nullptr;
+}
+
+RunState *RunState::instance()
+{
+    if (Model::hasInstance() && Model::instance()->runState())
+        return Model::instance()->runState();
+    assert(mInstance!=nullptr);
+    return mInstance;
+}
+
 void RunState::clear()
 {
     mCancel=false;
@@ -122,6 +146,12 @@ std::string RunState::asString() const
     return s.str();
 }
 
+void RunState::waitWhile(const ModelRunState &state, ModelRunState::State s)
+{
+    std::unique_lock<std::mutex> lock(runstate_wait_mutex);
+    runstate_changed.wait(lock, [&state, s]() { return state != s; });
+}
+
 void RunState::setError(std::string error_message, ModelRunState &state)
 {
     mErrorMessage = error_message;
@@ -59,8 +59,10 @@ private:
 class RunState {
 public:
     RunState();
+    ~RunState();
     void clear();
-    static RunState *instance() { assert(mInstance!=nullptr); return mInstance; }
+    /// the run state of the current model (see Model::runState()), or the global run state
+    static RunState *instance();
     ModelRunState &modelState()  { return mModel; }
     ModelRunState &dnnState()  { return mDNN; }
     ModelRunState &state() { return mTotal; }
@@ -73,6 +75,8 @@ public:
     void setCancel(bool cnc) { mCancel=cnc; }
 
     void setError(std::string error_message, ModelRunState &state);
+    /// block the calling thread as long as 'state' is 's' (e.g., wait for the other thread to finish the setup)
+    void waitWhile(const ModelRunState &state, ModelRunState::State s);
 
     // semantic queries
     bool isError() const { return mModel.in({ModelRunState::Error, ModelRunState::ErrorDuringSetup}); }
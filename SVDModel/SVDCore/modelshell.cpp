@@ -43,6 +43,8 @@ ModelShell::ModelShell(QObject *parent)
     mAbort = false;
 
     mModel = nullptr;
+    mSharedModel = nullptr;
+    mRunState = nullptr;
     mPackagesBuilt = 0;
     mPackageId = 0;
 
@@ -62,9 +64,12 @@ ModelShell::~ModelShell()
 
 void ModelShell::destroyModel()
 {
-    if (!mModel && Model::hasInstance())
+    if (!mModel && !mSharedModel && Model::hasInstance())
         mModel = Model::instance(); // hackish way to make sure the global model is deleted
 
+    // wait for module batches that are still running
+    mModulePool.waitForDone();
+
     if (mModel) {
         lg.reset(); // delete link to the logging stream
         Model *m = mModel;
@@ -153,11 +158,13 @@ std::string ModelShell::run_test_op(std::string what)
 void ModelShell::createModel(QString fileName, Settings *settings)
 {
     try {
-        setState(ModelRunState::Creating);
-        if (Model::hasInstance())
+        if (mModel || (!mSharedModel && Model::hasInstance()))
             destroyModel();
 
-        mModel = new Model(fileName.toStdString(), settings);
+        mModel = new Model(fileName.toStdString(), settings, mSharedModel);
+        mModel->setRunState(mRunState);
+        ModelScope scope(mModel);
+        setState(ModelRunState::Creating);
         mModel->setProcessEventsCallback( std::bind(&ModelShell::processEvents, this) );
         mCellsProcesssed=0;
 
@@ -171,6 +178,7 @@ void ModelShell::createModel(QString fileName, Settings *settings)
 
 void ModelShell::setup()
 {
+    ModelScope scope(mModel);
     try {
         if (!model())
             throw std::logic_error("ModelShell::setup: model is NULL");
@@ -183,10 +191,10 @@ void ModelShell::setup()
 
             // setup successful
             lg = spdlog::get("main");
-            while (RunState::instance()->dnnState() == ModelRunState::Creating) {
+            mModulePool.setMaxThreadCount(QThreadPool::globalInstance()->maxThreadCount());
+            if (RunState::instance()->dnnState() == ModelRunState::Creating) {
                 lg->debug("waiting for DNN thread...");
-                QThread::msleep(50);
-                QCoreApplication::processEvents();
+                RunState::instance()->waitWhile(RunState::instance()->dnnState(), ModelRunState::Creating);
             }
             setState( ModelRunState::ReadyToRun );
         }
@@ -199,8 +207,33 @@ void ModelShell::setup()
     }
 }
 
+void ModelShell::reset(Settings *changed_settings)
+{
+    ModelScope scope(mModel);
+    try {
+        if (!model())
+            throw std::logic_error("ModelShell::reset: model is NULL");
+
+        // wait for module batches that are still running
+        mModulePool.waitForDone();
+
+        std::map<std::string, std::string> changes;
+        if (changed_settings)
+            for (const auto &key : changed_settings->findKeys(""))
+                changes[key] = changed_settings->valueString(key);
+        model()->reset(changes);
+        setState( ModelRunState::ReadyToRun );
+
+    } catch (const std::exception &e) {
+        if (spdlog::get("main"))
+            spdlog::get("main")->error("An error occurred: {}", e.what());
+        setState( ModelRunState::Error, QString(e.what()));
+    }
+}
+
 void ModelShell::runOneStep(int current_step)
 {
+    ModelScope scope(mModel);
     setState(ModelRunState::Running);
     try {
         spdlog::get("main")->info("Run year {}.", current_step);
@@ -260,6 +293,7 @@ void ModelShell::setState(ModelRunState::State new_state, QString msg)
 static QMutex lock_processed_package;
 void ModelShell::processedPackage(Batch *batch)
 {
+    ModelScope scope(mModel);
     mModel->stats.NPackagesDNN++;
     if (RunState::instance()->cancel() || batch->hasError()) {
         mPackagesProcessed++;
@@ -273,10 +307,13 @@ void ModelShell::processedPackage(Batch *batch)
     try {
 
         // TODO: this is a bit too much: some handling in derived batch types (DNN), some in modules (handlers)
-        batch->processResults();
+        // batches of modules are already processed in the module thread pool (see processModuleBatch())
+        if (batch->type()==Batch::DNN)
+            batch->processResults();
 
         if (batch->module()) {
-            batch->module()->processBatch(batch);
+            if (batch->type()==Batch::DNN)
+                batch->module()->processBatch(batch);
             mCellsProcesssed += batch->usedSlots();
         }
 
@@ -309,6 +346,7 @@ void ModelShell::processedPackage(Batch *batch)
 
 void ModelShell::allPackagesBuilt()
 {
+    ModelScope scope(mModel);
     try{
 
         if (!BatchManager::instance()->slotsRequested()) {
@@ -341,7 +379,7 @@ void ModelShell::internalRun()
         // check for each cell if we need to do something; if yes, then
         // fill a InferenceData item within a batch of data
         // allPackagesBuilt() is called when completed
-        packageFuture = QtConcurrent::map(mModel->landscape()->grid(), [this](Cell &cell){ this->evaluateCell(&cell); });
+        packageFuture = QtConcurrent::map(mModel->landscape()->grid(), [this](Cell &cell){ ModelScope scope(mModel); this->evaluateCell(&cell); });
         packageWatcher.setFuture(packageFuture);
 
         // run the modules
@@ -489,19 +527,52 @@ void ModelShell::sendBatch(Batch *batch)
         lg->debug("sending package {} [{}] to Inference (built total: {})", mPackageId, static_cast<void*>(batch), mPackagesBuilt);
         emit newPackage(batch);
     } else {
-        // directly call the function (in a thread)
-        processedPackage(batch);
-//        QtConcurrent::run([](ModelShell *shell, Batch *batch) {
-//            // do some work!! module->run(batch) ??
-//            if (!QMetaObject::invokeMethod(shell, "processedPackage", Qt::DirectConnection, // Qt::QueuedConnection,
-//                                           Q_ARG(Batch*, batch)) ) {
-//                batch->setError(true);
-//            }
+        // process the batch of the module in a thread, processedPackage() is called afterwards (model thread)
+        lg->debug("sending package {} [{}] to module thread pool (built total: {})", batch->packageId(), static_cast<void*>(batch), mPackagesBuilt);
+        batch->changeState(Batch::Finished); // the batch is not filled any more (until processedPackage())
+        // the batch is seeded in the thread of the ModelShell (sendBatch() is called from the cell threads)
+        if (!QMetaObject::invokeMethod(this, "startModuleBatch", Qt::AutoConnection,
+                                       Q_ARG(Batch*, batch)) ) {
+            lg->error("ModelShell: cannot invoke startModuleBatch() for package {}.", batch->packageId());
+        }
+    }
+
+}
 
-//        }, this, batch);
+/// seed the random numbers of the batch from the generator of the model (thread of the ModelShell, in the
+/// order of the batches), and process the batch in the module thread pool with its own generator.
+void ModelShell::startModuleBatch(Batch *batch)
+{
+    ModelScope scope(mModel);
+    batch->random().setSeed(mModel->randomGenerator().randRaw());
+    QtConcurrent::run(&mModulePool, [this, batch]() {
+        ModelScope scope(mModel);
+        RandomScope random_scope(&batch->random());
+        this->processModuleBatch(batch);
+    });
+}
 
+/// process a batch of a module (e.g. the MatrixModule). The function runs in the module thread pool.
+/// The completion is handled by processedPackage(), which is called in the thread of the ModelShell.
+void ModelShell::processModuleBatch(Batch *batch)
+{
+    if (!RunState::instance()->cancel() && !batch->hasError()) {
+        try {
+            batch->processResults();
+            if (batch->module())
+                batch->module()->processBatch(batch);
+
+        } catch(const std::exception &e) {
+            batch->setError(true);
+            RunState::instance()->setError("An error occured while processing the batch", RunState::instance()->modelState());
+            lg->error("An error occured while processing the batch: {}", e.what());
+        }
     }
 
+    if (!QMetaObject::invokeMethod(this, "processedPackage", Qt::QueuedConnection,
+                                   Q_ARG(Batch*, batch)) ) {
+        lg->error("ModelShell: cannot invoke processedPackage() for package {}.", batch->packageId());
+    }
 }
 
 
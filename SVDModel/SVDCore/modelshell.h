@@ -23,6 +23,7 @@
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QtConcurrent>
+#include <QThreadPool>
 
 #include "modelrunstate.h"
 #include "spdlog/spdlog.h"
@@ -46,6 +47,8 @@ public:
     void destroyModel();
 
     Model *model() { return mModel; }
+    /// the shell creates a replicate of 'shared' (see Model::Model()), which uses 'run_state' (if provided)
+    void setSharedModel(Model *shared, RunState *run_state=nullptr) { mSharedModel = shared; mRunState = run_state; }
 
     // test function
     std::string run_test_op(std::string what);
@@ -65,6 +68,8 @@ signals:
 public slots:
     void createModel(QString fileName, Settings *settings=nullptr);
     void setup();
+    /// reset the model to the state after setup (see Model::reset()), settings in 'changed_settings' are applied
+    void reset(Settings *changed_settings=nullptr);
     void runOneStep(int current_step);
     void run(int n_steps);
     void abort();
@@ -72,6 +77,8 @@ public slots:
 
     void processedPackage(Batch *batch);
     void allPackagesBuilt();
+    /// start the processing of a batch of a module in the module thread pool
+    void startModuleBatch(Batch *batch);
 
 private:
     void internalRun();
@@ -80,6 +87,7 @@ private:
     std::pair<Batch *, size_t> getSlot(Cell *cell, Module *module);
     bool checkBatch(Batch *batch);
     void sendBatch(Batch *batch);
+    void processModuleBatch(Batch *batch);
     void sendPendingBatches();
     void finalizeCycle();
     void cancel();
@@ -90,6 +98,8 @@ private:
     void setState(ModelRunState::State new_state, QString msg=QString());
     bool mAbort;
     Model *mModel;
+    Model *mSharedModel; ///< the model providing the inputs for replicates
+    RunState *mRunState; ///< the run state of a replicate
 
     int mPackagesBuilt;
     int mPackagesProcessed;
@@ -101,6 +111,9 @@ private:
 
     QFutureWatcher<void> packageWatcher;
     QFuture<void> packageFuture;
+    /// separate thread pool for batches of modules (the global pool is busy with evaluateCell() and
+    /// waiting for free batches; module batches must be able to run nonetheless)
+    QThreadPool mModulePool;
 
     // loggers
     std::shared_ptr<spdlog::logger> lg;
@@ -22,11 +22,23 @@
 #include "model.h"
 #include "filereader.h"
 #include "randomgen.h"
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <QtConcurrent>
+#include <cmath>
+#include <limits>
 
 #ifndef M_PI
 #define M_PI 3.141592653589793
 #endif
 
+// direction codes (1..8, N, E, S, W, NE, SE, SW, NW): offsets to the neighbor, direction in degrees, and distance (m)
+static const int fire_dx[8] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+static const int fire_dy[8] = { 1, 0, -1, 0, 1, -1, -1, 1 };
+static const double fire_directions[8]= {0., 90., 180., 270., 45., 135., 225., 315. };
+static const double fire_pixel_size[8] = {100., 100., 100., 100., 141.421356, 141.421356, 141.421356, 141.421356 };
+
 FireModule::FireModule(std::string module_name): Module(module_name, State::None)
 {
 
@@ -74,13 +86,7 @@ void FireModule::setup()
     lg->debug("Loaded {} ignitions from '{}'", mIgnitions.size(), filename);
 
     // set up parameters
-    mExtinguishProb = settings.valueDouble("modules.fire.extinguishProb");
-    mSpreadToDistProb = 1. - settings.valueDouble("modules.fire.spreadDistProb");
-    std::string firesize_multiplier = settings.valueString("modules.fire.fireSizeMultiplier");
-    if (firesize_multiplier.size()>0) {
-        mFireSizeMultiplier.setExpression(firesize_multiplier);
-        lg->info("fireSizeMultiplier is active (value: {}). The maximum fire size of fires will be scaled with this function (variable: max fire size (ha)).", mFireSizeMultiplier.expression());
-    }
+    updateParameters();
 
 
     // setup of the fire grid (values per cell)
@@ -88,15 +94,31 @@ void FireModule::setup()
     mGrid.setup(grid.metricRect(), grid.cellsize());
     lg->debug("Created fire grid {} x {} cells.", mGrid.sizeX(), mGrid.sizeY());
 
+    setupSlopeFactors();
+
     lg->info("Setup of FireModule '{}' complete.", name());
 
     lg = spdlog::get("modules");
 
 }
 
+void FireModule::updateParameters()
+{
+    const Settings &settings = Model::instance()->settings();
+    mExtinguishProb = settings.valueDouble("modules.fire.extinguishProb");
+    mSpreadToDistProb = 1. - settings.valueDouble("modules.fire.spreadDistProb");
+    std::string firesize_multiplier = settings.valueString("modules.fire.fireSizeMultiplier");
+    mFireSizeMultiplier.setExpression(firesize_multiplier);
+    if (!mFireSizeMultiplier.isEmpty())
+        lg->info("fireSizeMultiplier is active (value: {}). The maximum fire size of fires will be scaled with this function (variable: max fire size (ha)).", mFireSizeMultiplier.expression());
+
+    for (int i=0;i<8;++i)
+        mLogSpreadToDistProb[i] = log(mSpreadToDistProb) * fire_pixel_size[i];
+}
+
 std::vector<std::pair<std::string, std::string> > FireModule::moduleVariableNames() const
 {
-    return {{"fireSpread", "progress of the last fire (value is the iteration)"},
+    return {{"fireSpread", "progress of the fires of the last year (value is the iteration)"},
         {"fireNFires", "cumulative number of fires"},
         {"fireNHighSeverity", "cumulative number of high severity fires"},
         {"fireLastBurn", "the year of the last fire on a cell (or 0 if never burned)"}};
@@ -124,7 +146,13 @@ void FireModule::run()
     // check if we have ignitions
     auto &grid = Model::instance()->landscape()->grid();
     auto range = mIgnitions.equal_range(Model::instance()->year());
-    int n_ignited=0;
+
+    // clear the spread flag for the cells of the last year
+    for (int i : mTouched)
+        mGrid[i].spread = 0.f;
+    mTouched.clear();
+
+    std::vector<SFireEvent> fires;
     for (auto i=range.first; i!=range.second; ++i) {
         SIgnition &ignition = i->second;
         lg->debug("FireModule: ignition at {}/{} with max-size {} ha.", ignition.x, ignition.y, ignition.max_size);
@@ -137,10 +165,71 @@ void FireModule::run()
             lg->debug("Ignition point not in project area. Skipping.");
             continue;
         }
-        ++n_ignited;
-        fireSpread(ignition);
+        fires.push_back(SFireEvent());
+        SFireEvent &fire = fires.back();
+        fire.ignition = &ignition;
+        fire.index = grid.indexAt(PointF(ignition.x, ignition.y));
+        double size_multiplier = 1.;
+        if (!mFireSizeMultiplier.isEmpty()) {
+            size_multiplier = mFireSizeMultiplier.calculate(ignition.max_size);
+            lg->debug("Modified fire size from '{}' to '{}' (fireSizeMultiplier).", ignition.max_size, ignition.max_size*size_multiplier);
+        }
+        fire.max_ha = static_cast<int>(ignition.max_size * size_multiplier);
+        // the fire spreads at most one cell per round, and burns at least one cell per round:
+        // all cells affected by the fire are within a distance of 'max_ha' cells from the ignition point
+        int radius = std::max(fire.max_ha, 0) + 1;
+        fire.xmin = std::max(fire.index.x() - radius, 0);
+        fire.xmax = std::min(fire.index.x() + radius, grid.sizeX()-1);
+        fire.ymin = std::max(fire.index.y() - radius, 0);
+        fire.ymax = std::min(fire.index.y() + radius, grid.sizeY()-1);
+        // each fire draws from its own generator: the random numbers do not depend on the order of execution
+        fire.random.setSeed(RandomGenerator::current().randRaw());
+    }
+
+    // assign fires to waves: a fire runs after all fires with an overlapping footprint that
+    // were ignited before (ignition order); fires within the same wave do not interact and run in parallel
+    std::vector< std::vector<SFireEvent*> > waves;
+    std::vector<size_t> wave_of(fires.size());
+    for (size_t i=0;i<fires.size();++i) {
+        size_t wave = 0;
+        for (size_t j=0;j<i;++j)
+            if (wave_of[j] >= wave && fires[i].overlaps(fires[j]))
+                wave = wave_of[j] + 1;
+        wave_of[i] = wave;
+        if (waves.size() <= wave)
+            waves.resize(wave + 1);
+        waves[wave].push_back(&fires[i]);
+    }
+
+    Model *model = Model::instance();
+    for (auto &wave : waves) {
+        if (wave.size()==1) {
+            RandomScope random_scope(&wave.front()->random);
+            fireSpread(*wave.front());
+        } else {
+            QtConcurrent::blockingMap(wave, [this, model](SFireEvent *fire) {
+                ModelScope scope(model);
+                RandomScope random_scope(&fire->random);
+                // exceptions are re-thrown on the model thread
+                try { this->fireSpread(*fire); }
+                catch (...) { fire->error = std::current_exception(); }
+            });
+        }
+        for (auto *fire : wave)
+            if (fire->error)
+                std::rethrow_exception(fire->error);
     }
-    lg->info("FireModule: end of year. #ignitions: {}.", n_ignited);
+
+    // the spread flags and statistics of the fires (in the order of ignition)
+    for (auto &fire : fires) {
+        for (const auto &f : fire.spread)
+            if (f.second != 0.f) {
+                mGrid[f.first].spread = f.second;
+                mTouched.push_back(f.first);
+            }
+        mStats.push_back(fire.stat);
+    }
+    lg->info("FireModule: end of year. #ignitions: {} (processed in {} parallel steps).", fires.size(), waves.size());
 
     // fire output
     Model::instance()->outputManager()->run("Fire");
@@ -148,79 +237,85 @@ void FireModule::run()
 }
 
 
-void FireModule::fireSpread(const FireModule::SIgnition &ign)
+void FireModule::saveCheckpoint(CheckpointWriter &writer) const
 {
-    auto &grid = Model::instance()->landscape()->grid();
-    Point index = grid.indexAt(PointF(ign.x, ign.y));
+    writer.write(mGrid.sizeX());
+    writer.write(mGrid.sizeY());
+    writer.writeArray(mGrid.begin(), static_cast<size_t>(mGrid.count()));
+    writer.writeVector(mTouched);
+    writer.writeVector(mStats);
+}
 
-    // clear the spread flag for all cells
-    std::for_each(mGrid.begin(), mGrid.end(), [](SFireCell &c) { c.spread=0.f; });
+void FireModule::restoreCheckpoint(CheckpointReader &reader)
+{
+    int size_x = reader.read<int>();
+    int size_y = reader.read<int>();
+    if (size_x != mGrid.sizeX() || size_y != mGrid.sizeY())
+        throw logic_error_fmt("Fire module: the fire grid in the checkpoint ({} x {}) does not match the landscape ({} x {}).", size_x, size_y, mGrid.sizeX(), mGrid.sizeY());
+    reader.readArray(mGrid.begin(), static_cast<size_t>(mGrid.count()));
+    mTouched = reader.readVector<int>();
+    mStats = reader.readVector<SFireStat>();
+    lg->debug("Fire module: restored the fire grid and {} fire events from the checkpoint.", mStats.size());
+}
 
-    mGrid[index].spread = 1.f; // initial value
-    double size_multiplier = 1.;
-    if (!mFireSizeMultiplier.isEmpty()) {
-        size_multiplier = mFireSizeMultiplier.calculate(ign.max_size);
-        lg->debug("Modified fire size from '{}' to '{}' (fireSizeMultiplier).", ign.max_size, ign.max_size*size_multiplier);
-    }
-    int max_ha = static_cast<int>(ign.max_size * size_multiplier);
+void FireModule::fireSpread(SFireEvent &fire)
+{
+    const SIgnition &ign = *fire.ignition;
+    Point index = fire.index;
+    int max_ha = fire.max_ha;
+
+    fire.spread[mGrid.index(index)] = 1.f; // initial value
+    // the effect of wind is the same for all cells of the fire event
+    for (int i=0;i<8;++i)
+        fire.wind_factors[i] = calcWindFactor(ign, fire_directions[i]);
     int n_ha = 0;
     int n_highseverity_ha = 0;
-    int grid_max_x = grid.sizeX()-1, grid_max_y=grid.sizeY()-1;
 
-    int ixmin=std::max(index.x() - 1,0);
-    int ixmax = std::min(index.x() + 1, grid_max_x);
-    int iymin = std::max(index.y() - 1, 0);
-    int iymax = std::min(index.y() + 1, grid_max_y);
-
-    int ixmin2=ixmin, ixmax2=ixmax, iymin2=iymin, iymax2=iymax;
     int n_burned_in_round, n_rounds = 1;
 
-    if (!burnCell(index.x(), index.y(), n_highseverity_ha, n_rounds)) {
+    if (!burnCell(index.x(), index.y(), n_highseverity_ha, n_rounds, fire.spread[mGrid.index(index)])) {
         lg->debug("Fire: not spreading, stopped at ignition point.");
     } else {
         ++n_ha; // one cell already burned
+        if (fire.spread[mGrid.index(index)] == 1.f)
+            fire.frontier.push_back(mGrid.index(index));
         while (n_ha <= max_ha) {
             n_burned_in_round=0;
             // calculate spread probabilities based on wind and slope from currently burning px
-            for (int iy=iymin; iy<=iymax; ++iy)
-                for (int ix=ixmin; ix<=ixmax; ++ix) {
-                    if (mGrid(ix, iy).spread == 1.f) {
-                        // value = 1.f -> the cell burned and is spreading
-                        float elev_origin = Model::instance()->landscape()->grid()(ix,iy).elevation();
-                        // direction codes: (1..8, N, E, S, W, NE, SE, SW, NW)
-                        calculateSpreadProbability(ign, Point(ix-1, iy+1), elev_origin, 8); // NW
-                        calculateSpreadProbability(ign, Point(ix  , iy+1), elev_origin, 1); // N
-                        calculateSpreadProbability(ign, Point(ix+1, iy+1), elev_origin, 5); // NE
-                        calculateSpreadProbability(ign, Point(ix+1, iy  ), elev_origin, 2); // E
-                        calculateSpreadProbability(ign, Point(ix+1, iy-1), elev_origin, 6); // SE
-                        calculateSpreadProbability(ign, Point(ix  , iy-1), elev_origin, 3); // S
-                        calculateSpreadProbability(ign, Point(ix-1, iy-1), elev_origin, 7); // SW
-                        calculateSpreadProbability(ign, Point(ix-1, iy  ), elev_origin, 4); // W
-                        // the cell has spread, mark the iteration
-                        mGrid.valueAtIndex(ix, iy).spread = static_cast<float>(n_rounds + 1);
-                    }
+            // (only the cells at the fire front, i.e. the cells that burned in the last round)
+            fire.candidates.clear();
+            for (int i : fire.frontier) {
+                Point p = mGrid.indexOf(i);
+                const SFireSlopeFactors &slope = (*mSlopeFactors)[i];
+                // direction codes: (1..8, N, E, S, W, NE, SE, SW, NW)
+                for (int d=1; d<=8; ++d) {
+                    Point neighbor(p.x() + fire_dx[d-1], p.y() + fire_dy[d-1]);
+                    if (calculateSpreadProbability(fire, slope, neighbor, d))
+                        fire.candidates.push_back(mGrid.index(neighbor));
                 }
-            for (int iy=iymin; iy<=iymax; ++iy) {
-                for (int ix=ixmin; ix<=ixmax; ++ix) {
-                    float &p_spread = mGrid.valueAtIndex(ix, iy).spread;
-                    if (p_spread < 1.f && p_spread > 0.f) {
-                        // the cell is spreading, calculate the probability and decide using a random number
-                        if (drandom() < p_spread) {
-                            if (burnCell(ix, iy, n_highseverity_ha, n_rounds)) {
-                                // the cell really burned, potentially increase the bounding box (if the cell is also spreading)
-                                ixmin2 = std::max(std::min(ixmin2, ix-1), 0);
-                                ixmax2 = std::min(std::max(ixmax2, ix+1), grid_max_x);
-                                iymin2 = std::max(std::min(iymin2, iy-1), 0);
-                                iymax2 = std::min(std::max(iymax2, iy+1), grid_max_y);
-                                n_ha++;
-                                n_burned_in_round++;
-                            } else {
-                                p_spread = 0.; // did not burn, reset
-                            }
-                        } else {
-                            p_spread = 0.; // did not burn, reset
-                        }
+                // the cell has spread, mark the iteration
+                fire.spread[i] = static_cast<float>(n_rounds + 1);
+            }
+            // process the candidate cells in the order of the grid (same sequence of random numbers
+            // as a scan over the full grid)
+            std::sort(fire.candidates.begin(), fire.candidates.end());
+            fire.next_frontier.clear();
+            for (int i : fire.candidates) {
+                float &p_spread = fire.spread[i];
+                // the cell is spreading, calculate the probability and decide using a random number
+                if (drandom() < p_spread) {
+                    Point p = mGrid.indexOf(i);
+                    if (burnCell(p.x(), p.y(), n_highseverity_ha, n_rounds, p_spread)) {
+                        // the cell really burned
+                        if (p_spread == 1.f)
+                            fire.next_frontier.push_back(i);
+                        n_ha++;
+                        n_burned_in_round++;
+                    } else {
+                        p_spread = 0.; // did not burn, reset
                     }
+                } else {
+                    p_spread = 0.; // did not burn, reset
                 }
             }
 
@@ -229,15 +324,15 @@ void FireModule::fireSpread(const FireModule::SIgnition &ign)
                 break;
             }
             n_rounds++;
-            ixmin = ixmin2; ixmax = ixmax2; iymin = iymin2; iymax = iymax2;
+            fire.frontier.swap(fire.next_frontier);
             if (lg->should_log(spdlog::level::debug))
-                lg->debug("Round {}, burned: {} ha, max-size: {} ha, rectangle: {}/{}-{}/{}", n_rounds, n_ha, max_ha, ixmin, iymin, ixmax, iymax);
+                lg->debug("Round {}, burned: {} ha, max-size: {} ha, burning cells: {}", n_rounds, n_ha, max_ha, fire.frontier.size());
 
         } // end while
     } // end if (fire at ignition point)
 
     lg->info("FireEvent. total burned (ha): {}, high severity (ha): {}, max-fire-size (ha): {}", n_ha, n_highseverity_ha, max_ha);
-    SFireStat stat;
+    SFireStat &stat = fire.stat;
     stat.year = Model::instance()->year();
     stat.Id = ign.Id;
     stat.x = ign.x;
@@ -245,18 +340,17 @@ void FireModule::fireSpread(const FireModule::SIgnition &ign)
     stat.max_size = static_cast<int>(ign.max_size);
     stat.ha_burned = n_ha;
     stat.ha_high_severity = n_highseverity_ha;
-    mStats.push_back(stat);
 }
 
 
 // examine a single cell and eventually burn.
-bool FireModule::burnCell(int ix, int iy, int &rHighSeverity, int round)
+bool FireModule::burnCell(int ix, int iy, int &rHighSeverity, int round, float &rSpread)
 {
     auto &grid = Model::instance()->landscape()->grid();
     auto &c = mGrid[Point(ix, iy)];
     auto &s = grid[Point(ix, iy)];
     if (s.isNull()) {
-        c.spread = -1.f;
+        rSpread = -1.f;
         if (round==1)
             lg->debug("Stopped at ignition: invalid cell!");
         return false;
@@ -281,7 +375,7 @@ bool FireModule::burnCell(int ix, int iy, int &rHighSeverity, int round)
     if (pBurn == 0. || pBurn < drandom()) {
         if (round==1)
             lg->debug("Stopped at ignition: State: {} burn-prob: {}", s.state()->asString(), pBurn);
-        c.spread = -1.f;
+        rSpread = -1.f;
         return false;
     }
 
@@ -306,13 +400,13 @@ bool FireModule::burnCell(int ix, int iy, int &rHighSeverity, int round)
     // fire extinction: a cell that burned can go out (i.e. spread no further)
     if (round>5) {
         if (drandom() < mExtinguishProb ) {
-            c.spread = -1.f;
+            rSpread = -1.f;
             return true; // this cell burned
         }
     }
 
 
-    c.spread = 1.f; // this cell spreads
+    rSpread = 1.f; // this cell spreads
     return true;
 }
 
@@ -384,59 +478,74 @@ double FireModule::calcWindFactor(const SIgnition &fire_event, const double dire
 }
 
 
-/** calculates probability of spread from one pixel to one neighbor.
-    In this functions the effect of the terrain, the wind and others are used to estimate a probability.
-    @param fire_data reference to the variables valid for the current resource unit
-    @param height elevation (m) of the origin point
-    @param pixel_from pointer to the origin point in the fire grid
-    @param pixel_to pointer to the target pixel
-    @param direction codes the direction from the origin point (1..8, N, E, S, W, NE, SE, SW, NW)
-  */
-void FireModule::calculateSpreadProbability(const SIgnition &fire_event,  const Point &point, const float origin_elevation,  const int direction)
+/// calculate the slope factors for all cells and the 8 directions.
+/// The slope is derived from the elevation of the cell and the neighboring cell.
+/// Replicates use the slope factors of the model that provides the landscape.
+void FireModule::setupSlopeFactors()
 {
+    if (Model *shared = Model::instance()->sharedModel())
+        if (auto *fire = dynamic_cast<FireModule*>(shared->module(name())))
+            if (fire->mSlopeFactors) {
+                mSlopeFactors = fire->mSlopeFactors;
+                return;
+            }
 
-    if (!mGrid.isIndexValid(point) || Model::instance()->landscape()->grid()[point].isNull())
-        return;
-
-    auto & fire_cell = mGrid[point];
-
-    if (fire_cell.spread<0.f || fire_cell.spread>=1.f)
-        return;
-
-    const double directions[8]= {0., 90., 180., 270., 45., 135., 225., 315. };
-    double spread_metric; // distance that fire supposedly spreads
-
-    // calculate the slope from the curent point (pixel_from) to the spreading cell (pixel_to)
-    float h_to = Model::instance()->landscape()->grid()[point].elevation();
-    if (h_to==0.f) {
-        lg->debug("Invalid elevation (value = 0) at point '{}m/{}m'", mGrid.cellCenterPoint(point).x(), mGrid.cellCenterPoint(point).y());
-        return;
+    auto &grid = Model::instance()->landscape()->grid();
+    std::shared_ptr< Grid<SFireSlopeFactors> > factors(new Grid<SFireSlopeFactors>());
+    factors->setup(grid.metricRect(), grid.cellsize());
+    int n_invalid = 0;
+    for (int i=0;i<grid.count();++i) {
+        SFireSlopeFactors &sf = (*factors)[i];
+        Point p = grid.indexOf(i);
+        float elev_origin = grid[i].elevation();
+        for (int d=0;d<8;++d) {
+            Point neighbor(p.x() + fire_dx[d], p.y() + fire_dy[d]);
+            sf.factor[d] = SFireSlopeFactors::cInvalid;
+            if (grid[i].isNull() || !grid.isIndexValid(neighbor) || grid[neighbor].isNull())
+                continue;
+            float h_to = grid[neighbor].elevation();
+            if (h_to==0.f) {
+                ++n_invalid;
+                continue;
+            }
+            double slope = (h_to - elev_origin) / fire_pixel_size[d];
+            sf.setValue(d, calcSlopeFactor( slope )); // slope factor (upslope / downslope)
+        }
     }
-    double pixel_size = 100.;
-    // if we spread diagonal, the distance is longer:
-    if (direction>4)
-        pixel_size *= 1.41421356;
-
-    double slope = (h_to - origin_elevation) / pixel_size;
+    mSlopeFactors = factors;
+    if (n_invalid>0)
+        lg->debug("Fire: {} neighbor relations with invalid elevation (value = 0); no spread to these cells.", n_invalid);
+}
 
-    double r_wind, r_slope; // metric distance for spread
-    r_slope = calcSlopeFactor( slope ); // slope factor (upslope / downslope)
+/** calculates probability of spread from one pixel to one neighbor.
+    In this functions the effect of the terrain (precalculated slope factors), the wind and others are used to estimate a probability.
+    @param fire the fire event
+    @param origin slope factors of the origin point
+    @param point the target pixel
+    @param direction codes the direction from the origin point (1..8, N, E, S, W, NE, SE, SW, NW)
+    @return true if the cell is a new candidate for spreading (i.e. the spread flag was 0 before)
+  */
+bool FireModule::calculateSpreadProbability(SFireEvent &fire, const SFireSlopeFactors &origin,  const Point &point,  const int direction)
+{
+    // r_slope is NaN if the target is outside of the landscape or has an invalid elevation
+    double r_slope = origin.value(direction-1);
+    if (std::isnan(r_slope))
+        return false;
 
-    r_wind = calcWindFactor(fire_event, directions[direction-1]); // metric distance from wind
+    float &spread = fire.spread[mGrid.index(point)];
 
-    spread_metric = r_slope + r_wind;
+    if (spread<0.f || spread>=1.f)
+        return false;
 
-    double spread_pixels = spread_metric / pixel_size;
-    if (spread_pixels<=0.)
-        return;
+    double spread_metric = r_slope + fire.wind_factors[direction-1]; // distance that fire supposedly spreads (slope + wind)
+    if (spread_metric<=0.)
+        return false;
 
     // calculate the probability: this is the chance
-    double p_spread = pow(mSpreadToDistProb, 1. / spread_pixels);
-    // apply the r_land factor that accounts for different land types
-    //p_spread *= fire_data.mRefLand;
-    // add probabilites
-    //*pixel_to = static_cast<float>(1. - (1. - *pixel_to)*(1. - p_spread));
-    fire_cell.spread = static_cast<float>(1. - (1. - fire_cell.spread)*(1. - p_spread));
+    // p = mSpreadToDistProb ^ (1/spread_pixels), with spread_pixels = spread_metric / pixel_size
+    double p_spread = exp(mLogSpreadToDistProb[direction-1] / spread_metric);
+    bool new_candidate = spread == 0.f;
+    spread = static_cast<float>(1. - (1. - spread)*(1. - p_spread));
+    return new_candidate && spread > 0.f;
 
 }
-
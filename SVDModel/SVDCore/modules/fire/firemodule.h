@@ -20,12 +20,20 @@
 #define FIREMODULE_H
 
 #include <map>
+#include <unordered_map>
+#include <exception>
+#include <memory>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
 
 #include "modules/module.h"
 
 #include "transitionmatrix.h"
 #include "states.h"
 #include "grid.h"
+#include "randomgen.h"
 #include "spdlog/spdlog.h"
 #include "expression.h"
 
@@ -33,12 +41,23 @@ class FireOut; // forward
 
 struct SFireCell {
     SFireCell() : spread(0.f), n_fire(0), n_high_severity(0), last_burn(0) {}
-    float spread; ///< spread flag during current fire event
+    float spread; ///< spread flag of the fires of the current year
     short int n_fire; ///< counter how often cell burned
     short int n_high_severity; ///< high severity counter
     short int last_burn; ///< year when the cell burned the last time
 };
 
+/// precalculated effect of the slope on fire spread from a cell to its 8 neighbors.
+/// The factors are stored as fixed point numbers (steps of 0.05m, range +-1638m) to keep the grid small.
+struct SFireSlopeFactors {
+    int16_t factor[8]; ///< slope factor (metric spread distance) for the directions 1..8 (N, E, S, W, NE, SE, SW, NW); cInvalid if the neighbor is not valid
+    static const int16_t cInvalid = std::numeric_limits<int16_t>::min();
+    /// the slope factor (m) for the direction 'd' (0..7), NaN if not valid
+    double value(int d) const { return factor[d] == cInvalid ? std::numeric_limits<double>::quiet_NaN() : factor[d] * 0.05; }
+    /// set the slope factor (m) for the direction 'd' (0..7); values beyond the range are clamped
+    void setValue(int d, double value) { factor[d] = static_cast<int16_t>(std::round(std::max(std::min(value / 0.05, 32767.), -32767.))); }
+};
+
 struct SFireStat {
     int year; ///< year of the fire
     int Id; ///< unique identifier
@@ -59,6 +78,10 @@ public:
 
     void run();
 
+    void saveCheckpoint(CheckpointWriter &writer) const;
+    void restoreCheckpoint(CheckpointReader &reader);
+    void updateParameters();
+
     // getters
     const Grid<SFireCell> &fireGrid() { return mGrid; }
 
@@ -81,13 +104,36 @@ private:
     std::multimap< int, SIgnition > mIgnitions;
 
     Grid<SFireCell> mGrid;
+    /// slope factors per cell and direction (calculated during setup; read-only, and shared with replicates)
+    std::shared_ptr< const Grid<SFireSlopeFactors> > mSlopeFactors;
+    double mLogSpreadToDistProb[8]; ///< log(mSpreadToDistProb) * distance (m) for the 8 directions
+
+    /// state of a single fire event. Fire events with non-overlapping footprints
+    /// are processed in parallel; the spread state is therefore stored per event (index of cells on the grid).
+    struct SFireEvent {
+        const SIgnition *ignition;
+        Point index; ///< ignition cell
+        int max_ha; ///< maximum fire size (ha), including the fireSizeMultiplier
+        int xmin, ymin, xmax, ymax; ///< potential footprint (cells) of the fire
+        double wind_factors[8]; ///< wind factors for the 8 directions
+        std::unordered_map<int, float> spread; ///< spread flag of the cells reached by the fire
+        std::vector<int> frontier; ///< cells that burned in the last round and are spreading (spread = 1)
+        std::vector<int> next_frontier; ///< cells that burn in the current round
+        std::vector<int> candidates; ///< cells that may burn in the current round (0 < spread < 1)
+        SFireStat stat; ///< statistics of the fire
+        RandomGenerator random; ///< random numbers of the fire (seeded in the order of ignition)
+        std::exception_ptr error; ///< exception thrown during the fire spread
+        bool overlaps(const SFireEvent &other) const { return xmin<=other.xmax && other.xmin<=xmax && ymin<=other.ymax && other.ymin<=ymax; }
+    };
+    std::vector<int> mTouched; ///< cells with a non-zero spread flag (cleared before the fires of the next year)
 
-    void fireSpread(const SIgnition &ign);
-    bool burnCell(int ix, int iy, int &rHighSeverity, int round);
+    void fireSpread(SFireEvent &fire);
+    bool burnCell(int ix, int iy, int &rHighSeverity, int round, float &rSpread);
 
     double calcSlopeFactor(const double slope) const;
     double calcWindFactor(const SIgnition &fire_event, const double direction) const;
-    void calculateSpreadProbability(const SIgnition &fire_event, const Point &point, const float origin_elevation,  const int direction);
+    void setupSlopeFactors();
+    bool calculateSpreadProbability(SFireEvent &fire, const SFireSlopeFactors &origin, const Point &point, const int direction);
 
 
     // store for transition probabilites for burned cells
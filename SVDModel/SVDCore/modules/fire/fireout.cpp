@@ -26,7 +26,7 @@ FireOut::FireOut()
 {
     setName("Fire");
     setDescription("Output on fire events (one event per line) and grids for the year of the last burn.\n\n" \
-                   "Grids are saved as ASCII grids to the location specified by the" \
+                   "Grids are saved as ASCII grids (or as compressed GeoTIFF if the path ends with `.tif`) to the location specified by the " \
                    "`lastFireGrid.path` property (`$year$` is replaced with the actual year). " \
                    "The value of the grid cells is the year of the last burn in a cell or 0 for unburned cells.\n\n" \
                    "### Parameters\n" \
@@ -57,28 +57,43 @@ void FireOut::execute()
     if (!fire)
         return;
 
-    // write output table
-    for (auto &s : fire->mStats) {
-        if (s.year == Model::instance()->year()) {
-            out() << s.year << s.Id << s.x << s.y << s.max_size << s.ha_burned << (s.ha_burned>0? s.ha_high_severity/static_cast<double>(s.ha_burned) : 0. );
-            out().write();
-        }
-    }
+    int year = Model::instance()->year();
+    // copy the fire events of the current year
+    std::vector<SFireStat> stats;
+    for (auto &s : fire->mStats)
+        if (s.year == year)
+            stats.push_back(s);
 
-    // write output grids
-    if (mLastFire.calculateBool( Model::instance()->year() )) {
-        std::string file_name = mLastFirePath;
-        find_and_replace(file_name, "$year$", to_string(Model::instance()->year()));
+    // snapshot of the grid (number of fires per cell), if a grid should be written
+    std::shared_ptr< Grid<short> > snapshot;
+    std::string file_name;
+    if (mLastFire.calculateBool( year )) {
+        file_name = mLastFirePath;
+        find_and_replace(file_name, "$year$", to_string(year));
         auto &grid = fire->mGrid;
+        snapshot = std::make_shared< Grid<short> >(grid.metricRect(), grid.cellsize());
+        short *p = snapshot->begin();
+        for (SFireCell *c = grid.begin(); c!=grid.end(); ++c, ++p)
+            *p = c->n_fire; // last burn: c->last_burn
+    }
 
-        // last burn:
-        //std::string result = gridToESRIRaster<SFireCell>(grid, [](const SFireCell &c) { return std::to_string(c.last_burn); });
-
-        // number of fires per cell:
-        std::string result = gridToESRIRaster<SFireCell>(grid, [](const SFireCell &c) { return std::to_string(c.n_fire); });
-        if (!writeFile(file_name, result))
-            throw std::logic_error("FireOut: couldn't write output grid file: " + file_name);
-
+    size_t bytes = stats.size() * sizeof(SFireStat) + (snapshot ? static_cast<size_t>(snapshot->count()) * sizeof(short) : 0);
+    writeAsync([this, stats, snapshot, file_name]() {
+        // write output table
+        for (auto &s : stats) {
+            out() << s.year << s.Id << s.x << s.y << s.max_size << s.ha_burned << (s.ha_burned>0? s.ha_high_severity/static_cast<double>(s.ha_burned) : 0. );
+            out().write();
+        }
 
-    }
+        // write output grids
+        if (snapshot) {
+            bool success;
+            if (has_ending(file_name, ".tif") || has_ending(file_name, ".TIF"))
+                success = gridToGeoTIFFInt16(*snapshot, file_name); // compressed 16 bit tif
+            else
+                success = gridToESRIRasterFile(*snapshot, file_name, [](const short &n) { return static_cast<int>(n); });
+            if (!success)
+                throw std::logic_error("FireOut: couldn't write output file: " + file_name);
+        }
+    }, bytes);
 }
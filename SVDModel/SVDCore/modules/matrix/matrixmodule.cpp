@@ -49,18 +49,23 @@ void MatrixModule::setup()
     mMatrix.load(Tools::path(filename));
 
     // set up key formula
-    std::string expr = settings.valueString("modules." + name() + ".keyFormula");
+    updateParameters();
+
+    lg->info("Setup of module '{}' complete.", name());
+    lg = spdlog::get("main");
+
+
+}
+
+void MatrixModule::updateParameters()
+{
+    std::string expr = Model::instance()->settings().valueString("modules." + name() + ".keyFormula");
     mHasKeyFormula = false;
     if (!expr.empty()) {
         mKeyFormula.setExpression(expr);
         mHasKeyFormula = true;
         lg->debug("Module has a keyFormula: '{}'", expr);
     }
-
-    lg->info("Setup of module '{}' complete.", name());
-    lg = spdlog::get("main");
-
-
 }
 
 void MatrixModule::prepareCell(Cell *cell)
@@ -75,11 +80,17 @@ void MatrixModule::processBatch(Batch *batch)
     CellWrapper cw(nullptr);
     int key=0;
     state_t new_state;
+    // evaluate the key formula for all cells of the batch
+    std::vector<double> keys;
+    if (mHasKeyFormula) {
+        keys.resize(batch->usedSlots());
+        mKeyFormula.calculateBatch(cw, keys.size(), [&cw, batch](size_t i) { cw.setData(batch->cells()[i]); }, keys.data());
+    }
     for (size_t i=0;i<batch->usedSlots();++i) {
         Cell *cell = batch->cells()[i];
+        cw.setData(cell);
         if (mHasKeyFormula) {
-            cw.setData(cell);
-            key = static_cast<int>(mKeyFormula.calculate(cw));
+            key = static_cast<int>(keys[i]);
             if (mMatrix.isValid(cell->stateId(), key))
                 new_state = mMatrix.transition(cell->stateId(), key, &cw); // we have a specific transition for the given key
             else
@@ -32,6 +32,7 @@ public:
     ~MatrixModule();
 
     void setup();
+    void updateParameters();
 
     void prepareCell(Cell *cell);
     void processBatch(Batch *batch);
@@ -37,7 +37,7 @@ Module::~Module()
 
 }
 
-std::shared_ptr<Module> Module::moduleFactory(std::string module_name, std::string module_type)
+std::shared_ptr<Module> Module::moduleFactory(std::string module_name, std::string module_type, bool register_name)
 {
 
     int idx = indexOf(allModuleTypes(), module_type);
@@ -45,7 +45,7 @@ std::shared_ptr<Module> Module::moduleFactory(std::string module_name, std::stri
     if (idx==-1)
         throw std::logic_error(fmt::format("The module with name '{}' and type '{}' cannot be created. Specify the type (modules.xxx.type) as one of: {}", module_name, module_type, join(allModuleTypes(), ",")));
 
-    if (indexOf(moduleNames(), module_name) != -1)
+    if (register_name && indexOf(moduleNames(), module_name) != -1)
         throw std::logic_error(fmt::format("The module with name '{}' cannot be created because the name is already used.", module_name));
     Module *m = nullptr;
     switch (idx) {
@@ -54,7 +54,8 @@ std::shared_ptr<Module> Module::moduleFactory(std::string module_name, std::stri
     case 2: m = new SimpleManagementModule(module_name); break;
     default: throw std::logic_error("Error: " + module_type + " is not a valid module type (Module::moduleFactory)!");
     }
-    mModuleNames.push_back(module_name);
+    if (register_name)
+        mModuleNames.push_back(module_name);
 
     return std::shared_ptr<Module>(m);
 }
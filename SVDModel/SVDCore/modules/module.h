@@ -26,6 +26,8 @@
 
 class Cell; // forward
 class Batch; // forward
+class CheckpointWriter; // forward
+class CheckpointReader; // forward
 
 class Module
 {
@@ -36,7 +38,9 @@ public:
     static std::vector<std::string> &allModuleTypes() {return mModuleTypes; }
     static std::vector<std::string> &moduleNames() {return mModuleNames; }
     static void clearModuleNames() { mModuleNames.clear(); }
-    static std::shared_ptr<Module> moduleFactory(std::string module_name, std::string module_type);
+    /// create a module of type 'module_type'. If 'register_name' is false, the name is not added
+    /// to the list of module names (modules of replicate models).
+    static std::shared_ptr<Module> moduleFactory(std::string module_name, std::string module_type, bool register_name=true);
 
     // properties
     const std::string &name() const { return mName; }
@@ -54,6 +58,14 @@ public:
     virtual void setup() {}
     virtual void run() {}
 
+    // checkpoints
+    /// write the (dynamic) state of the module to a checkpoint (see Model::saveCheckpoint())
+    virtual void saveCheckpoint(CheckpointWriter &) const {}
+    /// restore the state of the module from a checkpoint (the module is already set up)
+    virtual void restoreCheckpoint(CheckpointReader &) {}
+    /// read the parameters of the module again from the settings (called when the settings change, see Model::reset())
+    virtual void updateParameters() {}
+
     // variables
     virtual std::vector<std::pair<std::string, std::string> > moduleVariableNames() const;
     virtual double moduleVariable(const Cell *cell, size_t variableIndex) const;
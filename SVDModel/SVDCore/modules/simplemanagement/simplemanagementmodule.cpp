@@ -4,6 +4,7 @@
 #include "environmentcell.h"
 #include "tools.h"
 #include "filereader.h"
+#include "checkpoint.h"
 
 SimpleManagementModule::SimpleManagementModule(std::string module_name): Module(module_name, State::None)
 {
@@ -24,16 +25,16 @@ void SimpleManagementModule::setup()
 
     lg->debug("Created mgmt grid {} x {} cells.", mGrid.sizeX(), mGrid.sizeY());
 
-    int iRegime = EnvironmentCell::indexOf("regime");
-    int iInitAge = EnvironmentCell::indexOf("initialStandAge");
-    if (iRegime<0 || iInitAge<0)
+    EnvironmentColumn col_regime = EnvironmentCell::column("regime");
+    EnvironmentColumn col_init_age = EnvironmentCell::column("initialStandAge");
+    if (!col_regime.isValid() || !col_init_age.isValid())
         throw std::logic_error("SimpleManagementModule: values 'regime' and 'initialStandAge' are required environment variables");
 
     auto env_grid = Model::instance()->landscape()->environment().begin();
     for (auto *p = mGrid.begin(); p!=mGrid.end(); ++p, ++env_grid) {
         if (*env_grid) {
-            p->age = static_cast<short int>((*env_grid)->value(static_cast<size_t>(iInitAge)));
-            p->regime = static_cast<short int>((*env_grid)->value(static_cast<size_t>(iRegime)));
+            p->age = static_cast<short int>(col_init_age(*env_grid));
+            p->regime = static_cast<short int>(col_regime(*env_grid));
         }
     }
 
@@ -137,6 +138,22 @@ void SimpleManagementModule::run()
     }
 }
 
+void SimpleManagementModule::saveCheckpoint(CheckpointWriter &writer) const
+{
+    writer.write(mGrid.sizeX());
+    writer.write(mGrid.sizeY());
+    writer.writeArray(mGrid.begin(), static_cast<size_t>(mGrid.count()));
+}
+
+void SimpleManagementModule::restoreCheckpoint(CheckpointReader &reader)
+{
+    int size_x = reader.read<int>();
+    int size_y = reader.read<int>();
+    if (size_x != mGrid.sizeX() || size_y != mGrid.sizeY())
+        throw logic_error_fmt("SimpleManagementModule: the grid in the checkpoint ({} x {}) does not match the landscape ({} x {}).", size_x, size_y, mGrid.sizeX(), mGrid.sizeY());
+    reader.readArray(mGrid.begin(), static_cast<size_t>(mGrid.count()));
+}
+
 void SimpleManagementModule::managementActivity(const Cell *cell, float &rActivity, float &rTime) const
 {
     const auto &mgmt = mGrid[cell->cellIndex()];
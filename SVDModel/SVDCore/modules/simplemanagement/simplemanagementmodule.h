@@ -32,6 +32,9 @@ public:
 
     void run();
 
+    void saveCheckpoint(CheckpointWriter &writer) const;
+    void restoreCheckpoint(CheckpointReader &reader);
+
     // access
     void managementActivity(const Cell *cell, float &rActivity, float &rTime) const;
 private:
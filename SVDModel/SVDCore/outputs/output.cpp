@@ -20,11 +20,14 @@
 #include "model.h"
 #include "tools.h"
 #include "settings.h"
+#include "outputmanager.h"
+#include "outputwriter.h"
 #include "spdlog/spdlog.h"
 
 Output::Output()
 {
     mEnabled=false;
+    mAsync=false;
     mSeparator = ',';
 }
 
@@ -55,6 +58,18 @@ void Output::flush()
         mFile.flush();
 }
 
+void Output::writeAsync(std::function<void ()> job, size_t bytes)
+{
+    OutputWriter *writer = Model::instance()->outputManager()->writer();
+    if (!writer) {
+        job();
+        return;
+    }
+    // from now on, all writes to the output file happen on the writer thread
+    mAsync = true;
+    writer->queue(job, bytes);
+}
+
 std::string Output::createDocumentation()
 {
     std::string result;
@@ -87,6 +102,8 @@ void Output::openOutputFile(std::string default_key, bool write_header)
 {
     mOutputFileName = Tools::path(Model::instance()->settings().valueString(key(default_key)));
     auto lg = spdlog::get("setup");
+    if (file().is_open())
+        file().close(); // the output is set up again (e.g. Model::reset())
     file().open(mOutputFileName, std::fstream::out);
     if (file().fail()) {
       lg->error("Cannot create output file: '{}' (output: {}): {}", mOutputFileName, name(), strerror(errno));
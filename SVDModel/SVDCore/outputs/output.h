@@ -21,6 +21,7 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <functional>
 struct OutputColumn; // forward
 
 struct outstream
@@ -60,7 +61,9 @@ public:
     const std::string &fileName() const { return mOutputFileName; }
     bool enabled() const { return mEnabled; }
     void setEnabled(bool enable) { mEnabled = enable; }
-    void flush();
+    virtual void flush();
+    /// true if the output writes its data on the background writer thread (see OutputWriter)
+    bool isAsync() const { return mAsync; }
     /// builds a markdown compatible documentation from the output description
     std::string createDocumentation();
 
@@ -81,6 +84,9 @@ protected:
     /// get the internal filestream object
     std::fstream &file() { return mFile; }
     outstream &out() { return mOutStream; }
+    /// execute 'job' on the background writer thread (or immediately if asynchronous output is disabled).
+    /// The job must only use data that is captured by value (a snapshot), 'bytes' is the memory of this data.
+    void writeAsync(std::function<void()> job, size_t bytes);
 private:
     outstream mOutStream;
     std::fstream mFile;
@@ -88,6 +94,7 @@ private:
     std::string mName;
     std::string mDescription;
     bool mEnabled;
+    bool mAsync;
     std::vector< OutputColumn > mColumns;
     char mSeparator;
 };
@@ -22,11 +22,13 @@
 #include "tools.h"
 #include "strtools.h"
 #include "filereader.h"
+#include "modelrunstate.h"
 
 // the individual outputs
 #include "stategridout.h"
 #include "restimegridout.h"
 #include "statechangeout.h"
+#include "statechangelogout.h"
 #include "statehistout.h"
 #include "modules/fire/fireout.h"
 
@@ -36,12 +38,15 @@ OutputManager::OutputManager()
     mOutputs.push_back(new StateGridOut());
     mOutputs.push_back(new ResTimeGridOut());
     mOutputs.push_back(new StateChangeOut());
+    mOutputs.push_back(new StateChangeLogOut());
     mOutputs.push_back(new StateHistOut());
     mOutputs.push_back(new FireOut());
 }
 
 OutputManager::~OutputManager()
 {
+    // the writer finishes all pending jobs before the outputs are deleted
+    mWriter.reset();
     delete_and_clear(mOutputs);
 }
 
@@ -49,6 +54,15 @@ void OutputManager::setup()
 {
     auto lg = spdlog::get("setup");
     lg->info("Setup of outputs");
+    const Settings &settings = Model::instance()->settings();
+    bool async = settings.hasKey("model.asyncOutput") ? settings.valueBool("model.asyncOutput") : true;
+    if (async) {
+        size_t max_mb = settings.hasKey("model.asyncOutputMemory") ? settings.valueUInt("model.asyncOutputMemory") : 512;
+        mWriter.reset(new OutputWriter(max_mb * 1024 * 1024));
+        lg->debug("Asynchronous output writer enabled (max. memory: {} MB).", max_mb);
+    } else {
+        mWriter.reset();
+    }
     auto keys = Model::instance()->settings().findKeys("output.");
     std::sort(keys.begin(), keys.end());
     for (auto s : keys) {
@@ -81,6 +95,12 @@ void OutputManager::setup()
 
 }
 
+void OutputManager::reset()
+{
+    flush();
+    setup();
+}
+
 bool OutputManager::run(const std::string &output_name)
 {
     Output *o = find(output_name);
@@ -93,8 +113,31 @@ bool OutputManager::run(const std::string &output_name)
 
 void OutputManager::yearEnd()
 {
-    for (auto o : mOutputs)
-        o->flush();
+    try {
+        for (auto o : mOutputs) {
+            if (o->isAsync() && mWriter) {
+                // flush on the writer thread after the pending jobs of the output
+                mWriter->queue([o]() { o->flush(); }, 0);
+            } else {
+                o->flush();
+            }
+        }
+    } catch (const std::exception &e) {
+        spdlog::get("main")->error("Output Manager: {}", e.what());
+        RunState::instance()->setError(e.what(), RunState::instance()->modelState());
+    }
+}
+
+void OutputManager::flush()
+{
+    for (auto o : mOutputs) {
+        if (o->isAsync() && mWriter)
+            mWriter->queue([o]() { o->flush(); }, 0);
+        else
+            o->flush();
+    }
+    if (mWriter)
+        mWriter->flush();
 }
 
 std::string OutputManager::createDocumentation()
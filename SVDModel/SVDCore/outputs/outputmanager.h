@@ -20,7 +20,9 @@
 #define OUTPUTMANAGER_H
 #include <string>
 #include <vector>
+#include <memory>
 #include "output.h"
+#include "outputwriter.h"
 
 class OutputManager
 {
@@ -29,14 +31,21 @@ public:
     ~OutputManager();
     /// set up the outputs
     void setup();
+    /// write all pending data and set up the outputs again (the output files are re-created), see Model::reset()
+    void reset();
     bool isSetup() const { return mIsSetup; }
 
     /// executes the output 'output_name'.
     /// returns true if the output was actually executed.
     bool run(const std::string &output_name);
 
+    /// called at the end of a year: flushes the output files
     void yearEnd();
 
+    /// wait until all pending output data is written to disk (and flush files).
+    /// Throws an exception if writing failed.
+    void flush();
+
     /// builds a markdown documentation from all outputs
     std::string createDocumentation();
 
@@ -44,8 +53,11 @@ public:
 
     /// return the output or nullptr if 'output_name' is not a valid output.
     Output *find(std::string output_name);
+    /// the background writer (or nullptr if asynchronous output is disabled)
+    OutputWriter *writer() const { return mWriter.get(); }
 private:
     std::vector<Output*> mOutputs;
+    std::unique_ptr<OutputWriter> mWriter;
     bool mIsSetup;
 };
 
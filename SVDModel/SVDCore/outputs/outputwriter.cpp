@@ -0,0 +1,112 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "outputwriter.h"
+
+#include <stdexcept>
+#include "spdlog/spdlog.h"
+
+OutputWriter::OutputWriter(size_t max_bytes)
+{
+    mMaxBytes = max_bytes;
+    mPendingBytes = 0;
+    mBusy = false;
+    mStop = false;
+    mThread = std::thread(&OutputWriter::workerLoop, this);
+}
+
+OutputWriter::~OutputWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mJobQueued.notify_all();
+    // the worker writes all pending jobs before it quits
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void OutputWriter::queue(std::function<void ()> job, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    checkError();
+    // bounded memory: wait for the writer if the limit would be exceeded.
+    // A single job larger than the limit is accepted when the queue is empty.
+    mJobDone.wait(lock, [this, bytes]() { return mPendingBytes==0 || mPendingBytes + bytes <= mMaxBytes || !mError.empty(); });
+    checkError();
+    mJobs.push_back(std::make_pair(job, bytes));
+    mPendingBytes += bytes;
+    lock.unlock();
+    mJobQueued.notify_one();
+}
+
+void OutputWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mJobDone.wait(lock, [this]() { return mJobs.empty() && !mBusy; });
+    checkError();
+}
+
+size_t OutputWriter::pendingBytes()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPendingBytes;
+}
+
+void OutputWriter::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mJobQueued.wait(lock, [this]() { return mStop || !mJobs.empty(); });
+        if (mJobs.empty())
+            return; // mStop and nothing left to write
+
+        auto job = mJobs.front();
+        mJobs.pop_front();
+        mBusy = true;
+        lock.unlock();
+
+        std::string error;
+        try {
+            job.first();
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+
+        lock.lock();
+        if (!error.empty()) {
+            if (auto lg = spdlog::get("main"))
+                lg->error("Error in output writer: {}", error);
+            if (mError.empty())
+                mError = error;
+        }
+        mPendingBytes -= job.second;
+        mBusy = false;
+        mJobDone.notify_all();
+    }
+}
+
+void OutputWriter::checkError()
+{
+    if (!mError.empty()) {
+        std::string msg = mError;
+        mError.clear();
+        throw std::logic_error("Error in writing outputs: " + msg);
+    }
+}
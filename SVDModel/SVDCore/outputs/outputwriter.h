@@ -0,0 +1,66 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+
+/// The OutputWriter executes output jobs (formatting and writing of data to disk)
+/// on a background thread. Outputs take a snapshot of the relevant model data and queue a job
+/// that writes the snapshot, while the simulation of the next year continues.
+/// The memory of queued snapshots is limited: queue() blocks until enough jobs are written.
+/// Jobs are executed in the order they are queued.
+class OutputWriter
+{
+public:
+    /// create the writer; 'max_bytes' is the maximum memory of pending jobs
+    OutputWriter(size_t max_bytes);
+    /// waits until all pending jobs are written
+    ~OutputWriter();
+
+    /// add a job to the queue. 'bytes' is the (approximate) memory used by the job's data.
+    /// Throws an exception if a previous job failed.
+    void queue(std::function<void()> job, size_t bytes);
+
+    /// wait until all pending jobs are finished. Throws an exception if a job failed.
+    void flush();
+
+    size_t pendingBytes();
+private:
+    void workerLoop();
+    void checkError(); ///< throw an error of a job (called with locked mutex)
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mJobQueued;
+    std::condition_variable mJobDone;
+    std::deque< std::pair< std::function<void()>, size_t > > mJobs;
+    size_t mMaxBytes;
+    size_t mPendingBytes;
+    bool mBusy;
+    bool mStop;
+    std::string mError;
+};
+
+#endif // OUTPUTWRITER_H
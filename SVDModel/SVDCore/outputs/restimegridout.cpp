@@ -23,9 +23,10 @@
 ResTimeGridOut::ResTimeGridOut()
 {
     setName("ResTimeGrid");
-    setDescription("output of ASCII grids with the residence time (years) for each cell.\n" \
+    setDescription("output of grids with the residence time (years) for each cell.\n" \
                    "Grids are save to the location specified with the `path`property "
-                   "(`$year$` is replaced with the actual year).\n" \
+                   "(`$year$` is replaced with the actual year). Grids are written as ESRI ASCII grids, or as compressed 16 bit GeoTIFF "
+                   "if the path ends with `.tif`.\n" \
                    "### Parameters\n" \
                    "* `interval`: output is written only every `interval` years (or every year if `interval=0`). For example, a value of 10 limits output to the simulation years 1, 11, 21, ...\n");
     mInterval=0;
@@ -47,12 +48,24 @@ void ResTimeGridOut::execute()
     if (mInterval>0)
         if (year % mInterval != 1)
             return;
-    // write grids...
     std::string file_name = mPath;
     find_and_replace(file_name, "$year$", to_string(year));
+
+    // take a snapshot of the residence times; the grid file is written by the output writer
     auto &grid = Model::instance()->landscape()->grid();
-    std::string result = gridToESRIRaster<Cell>(grid, [](const Cell &c) { if (c.isNull()) return std::string("-9999"); else return std::to_string(c.residenceTime()); });
-    if (!writeFile(file_name, result))
-        throw std::logic_error("ResTimeGridOut: couldn't write output file: " + file_name);
+    auto snapshot = std::make_shared< Grid<restime_t> >(grid.metricRect(), grid.cellsize());
+    restime_t *p = snapshot->begin();
+    for (Cell *c = grid.begin(); c!=grid.end(); ++c, ++p)
+        *p = c->isNull() ? Grid<restime_t>::nullValue() : c->residenceTime();
+
+    writeAsync([snapshot, file_name]() {
+        bool success;
+        if (has_ending(file_name, ".tif") || has_ending(file_name, ".TIF"))
+            success = gridToGeoTIFFInt16(*snapshot, file_name); // compressed 16 bit tif
+        else
+            success = gridToESRIRasterFile(*snapshot, file_name, [](const restime_t &r) { return r==Grid<restime_t>::nullValue() ? -9999 : static_cast<int>(r); });
+        if (!success)
+            throw std::logic_error("ResTimeGridOut: couldn't write output file: " + file_name);
+    }, static_cast<size_t>(snapshot->count()) * sizeof(restime_t));
 
 }
@@ -0,0 +1,160 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "statechangelogout.h"
+#include "model.h"
+#include "tools.h"
+#include "third_party/FreeImage/FreeImage.h"
+
+#include <cstring>
+
+StateChangeLogOut::StateChangeLogOut()
+{
+    setName("StateChangeLog");
+    setDescription("Compact binary log of all state changes on the landscape.\n\n" \
+                   "For each year, the log contains only the cells that change their state (cell index, old state, new state, " \
+                   "and the residence time in the old state). In addition, the full landscape (state and residence time) " \
+                   "is stored every `keyframeInterval` years. Data is stored in compressed blocks. " \
+                   "The state of the landscape at the end of any year (after the first keyframe) can be reconstructed with the " \
+                   "`StateChangeLogReader` class.\n\n" \
+                   "### Parameters\n" \
+                   "* `file`: the binary output file\n" \
+                   "* `keyframeInterval`: a full grid is written every `keyframeInterval` years (simulation years 1, 1+`keyframeInterval`, ...). Default: 10.\n");
+    mKeyframeInterval = 10;
+    mHeaderWritten = false;
+}
+
+void StateChangeLogOut::setup()
+{
+    auto lg = spdlog::get("setup");
+    const Settings &settings = Model::instance()->settings();
+    mKeyframeInterval = settings.hasKey(key("keyframeInterval")) ? settings.valueInt(key("keyframeInterval")) : 10;
+    if (mKeyframeInterval < 1)
+        throw std::logic_error("StateChangeLog: 'keyframeInterval' must be >= 1.");
+    std::string file_name = Tools::path(settings.valueString(key("file")));
+    // a new setup (Model::reset()) starts a new file, i.e. the first year writes the header and a keyframe
+    if (mBinaryFile.is_open())
+        mBinaryFile.close();
+    mBinaryFile.open(file_name, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (mBinaryFile.fail()) {
+        lg->error("Cannot create output file: '{}' (output: {}): {}", file_name, name(), strerror(errno));
+        throw std::logic_error("Error in setup of output '" + name() + "'.");
+    }
+    mHeaderWritten = false;
+    mChanges.clear();
+    lg->debug("Setup of StateChangeLog output, keyframe interval: {}, file: {}.", mKeyframeInterval, file_name);
+}
+
+void StateChangeLogOut::execute()
+{
+    int year = Model::instance()->year();
+    auto &grid = Model::instance()->landscape()->grid();
+
+    // delta block: cell index gaps (varint), old states, new states, residence times
+    auto changes = std::make_shared< std::vector<SStateChangeRecord> >();
+    changes->swap(mChanges);
+
+    // keyframe: the full state and residence time of the landscape after the update
+    std::shared_ptr< std::vector<short> > keyframe;
+    if ((year - 1) % mKeyframeInterval == 0) {
+        keyframe = std::make_shared< std::vector<short> >(static_cast<size_t>(grid.count()) * 2);
+        short *s = keyframe->data();
+        short *r = s + grid.count();
+        for (Cell *c = grid.begin(); c!=grid.end(); ++c) {
+            *s++ = c->stateId();
+            *r++ = c->residenceTime();
+        }
+    }
+
+    bool write_header = !mHeaderWritten;
+    mHeaderWritten = true;
+    int size_x = grid.sizeX(), size_y = grid.sizeY();
+    double cellsize = grid.cellsize(), left = grid.metricRect().left(), top = grid.metricRect().top();
+
+    size_t bytes = changes->size() * sizeof(SStateChangeRecord) + (keyframe ? keyframe->size() * sizeof(short) : 0);
+    writeAsync([=]() {
+        if (write_header)
+            writeHeader(size_x, size_y, cellsize, left, top);
+
+        std::vector<char> raw;
+        raw.reserve(changes->size() * 8);
+        int last_index = 0;
+        for (const auto &c : *changes) {
+            // cells are visited in order, the gaps are small non-negative numbers
+            unsigned int gap = static_cast<unsigned int>(c.cellIndex - last_index);
+            last_index = c.cellIndex;
+            while (gap >= 0x80) {
+                raw.push_back(static_cast<char>((gap & 0x7f) | 0x80));
+                gap >>= 7;
+            }
+            raw.push_back(static_cast<char>(gap));
+        }
+        size_t offset = raw.size();
+        raw.resize(offset + changes->size() * 3 * sizeof(short));
+        short *p = reinterpret_cast<short*>(&raw[offset]);
+        for (const auto &c : *changes) *p++ = c.oldState;
+        for (const auto &c : *changes) *p++ = c.newState;
+        for (const auto &c : *changes) *p++ = c.residenceTime;
+        writeBlock(SCLDelta, year, changes->size(), raw);
+
+        if (keyframe) {
+            const char *k = reinterpret_cast<const char*>(keyframe->data());
+            writeBlock(SCLKeyframe, year, keyframe->size() / 2, std::vector<char>(k, k + keyframe->size() * sizeof(short)));
+        }
+    }, bytes);
+}
+
+void StateChangeLogOut::flush()
+{
+    if (mBinaryFile.is_open())
+        mBinaryFile.flush();
+}
+
+void StateChangeLogOut::writeHeader(int size_x, int size_y, double cellsize, double left, double top)
+{
+    mBinaryFile.write(StateChangeLogMagic, 8);
+    int32_t sx = size_x, sy = size_y, ki = mKeyframeInterval;
+    mBinaryFile.write(reinterpret_cast<const char*>(&sx), sizeof(sx));
+    mBinaryFile.write(reinterpret_cast<const char*>(&sy), sizeof(sy));
+    mBinaryFile.write(reinterpret_cast<const char*>(&cellsize), sizeof(cellsize));
+    mBinaryFile.write(reinterpret_cast<const char*>(&left), sizeof(left));
+    mBinaryFile.write(reinterpret_cast<const char*>(&top), sizeof(top));
+    mBinaryFile.write(reinterpret_cast<const char*>(&ki), sizeof(ki));
+}
+
+void StateChangeLogOut::writeBlock(char block_type, int year, size_t n, const std::vector<char> &raw)
+{
+    std::vector<BYTE> compressed(raw.size() + raw.size() / 1000 + 64);
+    uint32_t compressed_size = 0;
+    if (!raw.empty()) {
+        compressed_size = FreeImage_ZLibCompress(compressed.data(), static_cast<DWORD>(compressed.size()),
+                                                 reinterpret_cast<BYTE*>(const_cast<char*>(raw.data())), static_cast<DWORD>(raw.size()));
+        if (compressed_size == 0)
+            throw std::logic_error("StateChangeLog: compression of data block failed.");
+    }
+    int32_t y = year;
+    uint32_t count = static_cast<uint32_t>(n), raw_size = static_cast<uint32_t>(raw.size());
+    mBinaryFile.put(block_type);
+    mBinaryFile.write(reinterpret_cast<const char*>(&y), sizeof(y));
+    mBinaryFile.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    mBinaryFile.write(reinterpret_cast<const char*>(&raw_size), sizeof(raw_size));
+    mBinaryFile.write(reinterpret_cast<const char*>(&compressed_size), sizeof(compressed_size));
+    mBinaryFile.write(reinterpret_cast<const char*>(compressed.data()), compressed_size);
+    if (!mBinaryFile.good())
+        throw std::logic_error("StateChangeLog: error writing to the output file.");
+}
@@ -0,0 +1,50 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef STATECHANGELOGOUT_H
+#define STATECHANGELOGOUT_H
+
+#include <memory>
+#include <fstream>
+#include "output.h"
+#include "statechangelogreader.h"
+
+/// StateChangeLogOut writes only the cells that change their state (events), and full keyframes
+/// of the landscape in regular intervals to a compressed binary file.
+/// The file can be read with StateChangeLogReader.
+class StateChangeLogOut : public Output
+{
+public:
+    StateChangeLogOut();
+    void setup();
+    void execute();
+    void flush();
+
+    /// record a state change (called during Model::finalizeYear())
+    void addChange(int cell_index, state_t old_state, state_t new_state, restime_t residence_time) {
+        mChanges.push_back({cell_index, old_state, new_state, residence_time}); }
+private:
+    void writeHeader(int size_x, int size_y, double cellsize, double left, double top);
+    void writeBlock(char block_type, int year, size_t n, const std::vector<char> &raw);
+    int mKeyframeInterval;
+    bool mHeaderWritten;
+    std::vector<SStateChangeRecord> mChanges;
+    std::ofstream mBinaryFile;
+};
+
+#endif // STATECHANGELOGOUT_H
@@ -0,0 +1,186 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "statechangelogreader.h"
+#include "strtools.h"
+#include "third_party/FreeImage/FreeImage.h"
+
+#include <cstring>
+
+StateChangeLogReader::StateChangeLogReader()
+{
+    mSizeX = mSizeY = 0;
+    mCellsize = mLeft = mTop = 0.;
+    mKeyframeInterval = 0;
+}
+
+template <typename T>
+static void readValue(std::ifstream &in, T &value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+void StateChangeLogReader::open(const std::string &fileName)
+{
+    mFileName = fileName;
+    mBlocks.clear();
+    if (mFile.is_open())
+        mFile.close();
+    mFile.open(fileName, std::ios::binary | std::ios::in);
+    if (!mFile.is_open())
+        throw logic_error_fmt("StateChangeLogReader: cannot open file '{}'.", fileName);
+
+    char magic[8];
+    mFile.read(magic, 8);
+    if (!mFile.good() || memcmp(magic, StateChangeLogMagic, 8) != 0)
+        throw logic_error_fmt("StateChangeLogReader: '{}' is not a valid state change log file.", fileName);
+    int32_t sx, sy, ki;
+    readValue(mFile, sx);
+    readValue(mFile, sy);
+    readValue(mFile, mCellsize);
+    readValue(mFile, mLeft);
+    readValue(mFile, mTop);
+    readValue(mFile, ki);
+    mSizeX = sx; mSizeY = sy; mKeyframeInterval = ki;
+
+    // build the index of blocks (only the block headers are read)
+    while (true) {
+        SBlock block;
+        int32_t year;
+        block.type = static_cast<char>(mFile.get());
+        if (mFile.eof())
+            break;
+        readValue(mFile, year);
+        readValue(mFile, block.n);
+        readValue(mFile, block.rawSize);
+        readValue(mFile, block.compressedSize);
+        if (!mFile.good())
+            throw logic_error_fmt("StateChangeLogReader: '{}': truncated block header.", fileName);
+        block.year = year;
+        block.offset = mFile.tellg();
+        mFile.seekg(block.compressedSize, std::ios::cur);
+        mBlocks.push_back(block);
+    }
+    mFile.clear();
+}
+
+int StateChangeLogReader::firstYear() const
+{
+    for (const auto &b : mBlocks)
+        if (b.type == SCLKeyframe)
+            return b.year;
+    return -1;
+}
+
+int StateChangeLogReader::lastYear() const
+{
+    return mBlocks.empty() ? -1 : mBlocks.back().year;
+}
+
+void StateChangeLogReader::gridForYear(int year, Grid<state_t> &states, Grid<restime_t> *residence_times)
+{
+    // find the last keyframe before (or at) 'year'
+    const SBlock *keyframe = nullptr;
+    for (const auto &b : mBlocks)
+        if (b.type == SCLKeyframe && b.year <= year)
+            keyframe = &b;
+    if (!keyframe)
+        throw logic_error_fmt("StateChangeLogReader: no keyframe available for year {} in '{}'.", year, mFileName);
+    if (year > lastYear())
+        throw logic_error_fmt("StateChangeLogReader: year {} is not available in '{}' (last year: {}).", year, mFileName, lastYear());
+
+    states.setup(metricRect(), mCellsize);
+    Grid<restime_t> local_restime;
+    Grid<restime_t> &restime = residence_times ? *residence_times : local_restime;
+    restime.setup(metricRect(), mCellsize);
+
+    std::vector<char> data = readBlock(*keyframe);
+    if (keyframe->n != static_cast<uint32_t>(states.count()) || data.size() != keyframe->n * 2 * sizeof(short))
+        throw logic_error_fmt("StateChangeLogReader: invalid keyframe for year {} in '{}'.", keyframe->year, mFileName);
+    memcpy(states.begin(), data.data(), keyframe->n * sizeof(short));
+    memcpy(restime.begin(), data.data() + keyframe->n * sizeof(short), keyframe->n * sizeof(short));
+
+    // apply the changes of the following years
+    for (const auto &b : mBlocks) {
+        if (b.type != SCLDelta || b.year <= keyframe->year || b.year > year)
+            continue;
+        // the residence time increases for all cells, and is reset for cells that change
+        restime_t *r = restime.begin();
+        for (state_t *s = states.begin(); s!=states.end(); ++s, ++r)
+            if (*s != -1)
+                ++(*r);
+        for (const auto &c : decodeDelta(b)) {
+            states[c.cellIndex] = c.newState;
+            restime[c.cellIndex] = 0;
+        }
+    }
+}
+
+std::vector<SStateChangeRecord> StateChangeLogReader::changes(int year)
+{
+    for (const auto &b : mBlocks)
+        if (b.type == SCLDelta && b.year == year)
+            return decodeDelta(b);
+    return std::vector<SStateChangeRecord>();
+}
+
+std::vector<char> StateChangeLogReader::readBlock(const StateChangeLogReader::SBlock &block)
+{
+    std::vector<char> raw(block.rawSize);
+    if (block.rawSize == 0)
+        return raw;
+    std::vector<char> compressed(block.compressedSize);
+    mFile.seekg(block.offset);
+    mFile.read(compressed.data(), block.compressedSize);
+    if (!mFile.good())
+        throw logic_error_fmt("StateChangeLogReader: error reading '{}' (year {}).", mFileName, block.year);
+    DWORD n = FreeImage_ZLibUncompress(reinterpret_cast<BYTE*>(raw.data()), block.rawSize,
+                                       reinterpret_cast<BYTE*>(compressed.data()), block.compressedSize);
+    if (n != block.rawSize)
+        throw logic_error_fmt("StateChangeLogReader: invalid data block in '{}' (year {}).", mFileName, block.year);
+    return raw;
+}
+
+std::vector<SStateChangeRecord> StateChangeLogReader::decodeDelta(const StateChangeLogReader::SBlock &block)
+{
+    std::vector<char> data = readBlock(block);
+    std::vector<SStateChangeRecord> result(block.n);
+    size_t pos = 0;
+    int index = 0;
+    for (auto &c : result) {
+        unsigned int gap = 0;
+        int shift = 0;
+        unsigned char byte;
+        do {
+            if (pos >= data.size())
+                throw logic_error_fmt("StateChangeLogReader: invalid delta block in '{}' (year {}).", mFileName, block.year);
+            byte = static_cast<unsigned char>(data[pos++]);
+            gap |= static_cast<unsigned int>(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        index += static_cast<int>(gap);
+        c.cellIndex = index;
+    }
+    if (data.size() - pos != block.n * 3 * sizeof(short))
+        throw logic_error_fmt("StateChangeLogReader: invalid delta block in '{}' (year {}).", mFileName, block.year);
+    const short *p = reinterpret_cast<const short*>(data.data() + pos);
+    for (auto &c : result) c.oldState = *p++;
+    for (auto &c : result) c.newState = *p++;
+    for (auto &c : result) c.residenceTime = *p++;
+    return result;
+}
@@ -0,0 +1,90 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef STATECHANGELOGREADER_H
+#define STATECHANGELOGREADER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "grid.h"
+#include "states.h"
+
+/** Binary format of the StateChangeLog output (little endian):
+ *  Header: magic "SVDSCL01" (8 bytes), sizeX, sizeY (int32), cellsize, left, top (double, metric extent),
+ *  keyframe interval (int32).
+ *  Followed by blocks: type (1 byte), year (int32), number of records (uint32), uncompressed size (uint32),
+ *  compressed size (uint32), zlib compressed data.
+ *  - delta block: n cell index gaps (varint), n old states, n new states, n residence times (int16)
+ *  - keyframe block: n states, n residence times (int16), with n the number of cells of the grid
+ */
+static const char StateChangeLogMagic[] = "SVDSCL01";
+enum StateChangeLogBlockType { SCLKeyframe=1, SCLDelta=2 };
+
+/// a single state change of a cell (see StateChangeLogOut)
+struct SStateChangeRecord {
+    int cellIndex; ///< index of the cell in the landscape grid
+    state_t oldState; ///< state before the change
+    state_t newState; ///< state after the change
+    restime_t residenceTime; ///< residence time (years) in the old state
+};
+
+/// StateChangeLogReader reads files of the StateChangeLog output and reconstructs the
+/// state of the landscape for any year.
+class StateChangeLogReader
+{
+public:
+    StateChangeLogReader();
+    /// open the file and build an index of all blocks. Throws an exception on error.
+    void open(const std::string &fileName);
+
+    int sizeX() const { return mSizeX; }
+    int sizeY() const { return mSizeY; }
+    double cellsize() const { return mCellsize; }
+    RectF metricRect() const { return RectF(mLeft, mTop, mLeft + mSizeX*mCellsize, mTop + mSizeY*mCellsize); }
+    int keyframeInterval() const { return mKeyframeInterval; }
+    /// the first and last year that can be reconstructed
+    int firstYear() const;
+    int lastYear() const;
+
+    /// reconstruct the state (and the residence time) of all cells at the end of 'year'
+    /// (i.e. after all changes of the year). Cells outside of the landscape have a state of -1.
+    void gridForYear(int year, Grid<state_t> &states, Grid<restime_t> *residence_times=nullptr);
+
+    /// get all state changes that happened at the end of 'year'
+    std::vector<SStateChangeRecord> changes(int year);
+private:
+    struct SBlock {
+        char type;
+        int year;
+        uint32_t n;
+        uint32_t rawSize;
+        uint32_t compressedSize;
+        std::streamoff offset; ///< position of the compressed data
+    };
+    std::vector<char> readBlock(const SBlock &block);
+    std::vector<SStateChangeRecord> decodeDelta(const SBlock &block);
+    std::string mFileName;
+    std::ifstream mFile;
+    std::vector<SBlock> mBlocks;
+    int mSizeX, mSizeY;
+    double mCellsize, mLeft, mTop;
+    int mKeyframeInterval;
+};
+
+#endif // STATECHANGELOGREADER_H
@@ -74,7 +74,6 @@ void StateChangeOut::execute()
 
 }
 
-static std::mutex filter_mtx;
 bool StateChangeOut::shouldWriteOutput(const InferenceData &id)
 {
     int year =  Model::instance()->year();
@@ -85,7 +84,6 @@ bool StateChangeOut::shouldWriteOutput(const InferenceData &id)
     if (mFilter.isEmpty())
         return true;
 
-    std::lock_guard<std::mutex> guard(filter_mtx);
     InferenceDataWrapper wrap(&id);
     if (mFilter.calculateBool(wrap))
         return true;
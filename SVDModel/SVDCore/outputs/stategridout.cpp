@@ -23,9 +23,10 @@
 StateGridOut::StateGridOut()
 {
     setName("StateGrid");
-    setDescription("writes ASCII grids with the stateId for each cell.\n\n" \
+    setDescription("writes grids with the stateId for each cell.\n\n" \
                    "Grids are save to the location specified with the `path`property "
-                   "(`$year$` is replaced with the actual year).\n" \
+                   "(`$year$` is replaced with the actual year). Grids are written as ESRI ASCII grids, or as compressed 16 bit GeoTIFF "
+                   "if the path ends with `.tif`.\n" \
                    "### Parameters\n" \
                    "* `interval`: output is written only every `interval` years (or every year if `interval=0`). For example, a value of 10 limits output to the simulation years 1, 11, 21, ...\n\n");
     mInterval=0;
@@ -46,24 +47,27 @@ void StateGridOut::execute()
     if (mInterval>0)
         if (year % mInterval != 1)
             return;
-    // write grids...
     std::string file_name = mPath;
     find_and_replace(file_name, "$year$", to_string(year));
+
+    // take a snapshot of the stateIds; the grid file is written by the output writer
     auto &grid = Model::instance()->landscape()->grid();
-    if (has_ending(file_name, ".tif") || has_ending(file_name, ".TIF")) {
-        // save as tif
-        if (!gridToGeoTIFF<Cell>( grid, file_name,
-                                  [](const Cell &c) -> double {if(c.isNull())
-                                  return std::numeric_limits<double>::lowest();
-                                  else
-                                  return static_cast<double>(c.state()->id()); }) )
-            throw std::logic_error("StateGridOut: couldn't write output file: " + file_name);
+    auto snapshot = std::make_shared< Grid<state_t> >(grid.metricRect(), grid.cellsize());
+    state_t *p = snapshot->begin();
+    for (Cell *c = grid.begin(); c!=grid.end(); ++c, ++p)
+        *p = c->isNull() ? Grid<state_t>::nullValue() : c->stateId();
+
+    writeAsync([snapshot, file_name]() {
+        if (has_ending(file_name, ".tif") || has_ending(file_name, ".TIF")) {
+            // save as tiled and compressed (16 bit) tif
+            if (!gridToGeoTIFFInt16(*snapshot, file_name))
+                throw std::logic_error("StateGridOut: couldn't write output file: " + file_name);
 
-    } else {
-        // save as esri ascii raster
-        std::string result = gridToESRIRaster<Cell>(grid, [](const Cell &c) { if (c.isNull()) return std::string("-9999"); else return std::to_string(c.stateId()); });
-        if (!writeFile(file_name, result))
-            throw std::logic_error("StateGridOut: couldn't write output file: " + file_name);
-    }
+        } else {
+            // save as esri ascii raster
+            if (!gridToESRIRasterFile(*snapshot, file_name, [](const state_t &s) { return s==Grid<state_t>::nullValue() ? -9999 : static_cast<int>(s); }))
+                throw std::logic_error("StateGridOut: couldn't write output file: " + file_name);
+        }
+    }, static_cast<size_t>(snapshot->count()) * sizeof(state_t));
 
 }
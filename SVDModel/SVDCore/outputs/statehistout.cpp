@@ -40,13 +40,16 @@ void StateHistOut::execute()
 //        if (!c->isNull())
 //            state_count[static_cast<size_t>(c->stateId())]++;
 
+    // copy of the histogram; the table is written by the output writer
     auto state_count = Model::instance()->states()->stateHistogram();
     int year = Model::instance()->year();
-    // write output table
-    for (size_t i=0;i<state_count.size();++i) {
-        if (state_count[i]>0) {
-            out() << year << i << state_count[i];
-            out().write();
+    writeAsync([this, state_count, year]() {
+        // write output table
+        for (size_t i=0;i<state_count.size();++i) {
+            if (state_count[i]>0) {
+                out() << year << i << state_count[i];
+                out().write();
+            }
         }
-    }
+    }, state_count.size() * sizeof(int));
 }
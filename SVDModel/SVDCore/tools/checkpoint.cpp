@@ -0,0 +1,212 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "strtools.h"
+
+CheckpointWriter::CheckpointWriter()
+{
+    mSectionStart = -1;
+    mCommitted = false;
+    mOut.reset(new std::ostringstream(std::ios::binary));
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &file_name)
+{
+    mFileName = file_name;
+    mTempFileName = file_name + ".tmp";
+    mSectionStart = -1;
+    mCommitted = false;
+    mOut.reset(new std::ofstream(mTempFileName, std::ios::binary | std::ios::trunc));
+    if (!static_cast<std::ofstream*>(mOut.get())->is_open())
+        throw logic_error_fmt("Checkpoint: cannot create the file '{}'.", mTempFileName);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    // not committed (e.g. an exception occurred): remove the incomplete file
+    if (!mTempFileName.empty() && !mCommitted) {
+        mOut.reset();
+        std::remove(mTempFileName.c_str());
+    }
+}
+
+void CheckpointWriter::beginSection(const std::string &name)
+{
+    if (mSectionStart >= 0)
+        throw logic_error_fmt("Checkpoint: cannot start section '{}': sections can not be nested.", name);
+    writeString(name);
+    mSectionStart = static_cast<std::streamoff>(mOut->tellp());
+    write(static_cast<uint64_t>(0)); // placeholder for the size of the section
+}
+
+void CheckpointWriter::endSection()
+{
+    if (mSectionStart < 0)
+        throw std::logic_error("Checkpoint: endSection() without beginSection().");
+    std::streamoff end = static_cast<std::streamoff>(mOut->tellp());
+    uint64_t size = static_cast<uint64_t>(end - mSectionStart) - sizeof(uint64_t);
+    mOut->seekp(mSectionStart);
+    write(size);
+    mOut->seekp(end);
+    mSectionStart = -1;
+}
+
+void CheckpointWriter::commit()
+{
+    if (mSectionStart >= 0)
+        throw std::logic_error("Checkpoint: commit() with an open section.");
+    if (mTempFileName.empty())
+        throw std::logic_error("Checkpoint: commit() is not available for in-memory checkpoints.");
+    std::ofstream *out = static_cast<std::ofstream*>(mOut.get());
+    out->close();
+    if (out->fail())
+        throw logic_error_fmt("Checkpoint: error while writing the file '{}'.", mTempFileName);
+    mCommitted = true;
+    // replace an existing checkpoint in a single step: the old file stays valid until the new one is in place
+#ifdef _WIN32
+    // std::rename() fails on Windows if the target exists
+    auto widen = [](const std::string &s) {
+        int n = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, nullptr, 0);
+        std::wstring w(static_cast<size_t>(n > 0 ? n : 1), L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, &w[0], n);
+        return w;
+    };
+    if (!MoveFileExW(widen(mTempFileName).c_str(), widen(mFileName).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        throw logic_error_fmt("Checkpoint: cannot rename '{}' to '{}' (error {}).", mTempFileName, mFileName, GetLastError());
+#else
+    if (std::rename(mTempFileName.c_str(), mFileName.c_str()) != 0)
+        throw logic_error_fmt("Checkpoint: cannot rename '{}' to '{}'.", mTempFileName, mFileName);
+#endif
+}
+
+std::string CheckpointWriter::data() const
+{
+    if (!mTempFileName.empty())
+        throw std::logic_error("Checkpoint: data() is only available for in-memory checkpoints.");
+    return static_cast<std::ostringstream*>(mOut.get())->str();
+}
+
+void CheckpointWriter::writeBytes(const char *data, size_t n)
+{
+    mOut->write(data, static_cast<std::streamsize>(n));
+    if (!*mOut)
+        throw logic_error_fmt("Checkpoint: error while writing the file '{}'.", mTempFileName);
+}
+
+
+namespace {
+// read-only stream buffer on a memory block (without copying the data)
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+    MemoryStreamBuffer(const char *data, size_t size) { char *p = const_cast<char*>(data); setg(p, p, p + size); }
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+        char *target = (dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr()) + off;
+        if (target < eback() || target > egptr())
+            return pos_type(off_type(-1));
+        setg(eback(), target, egptr());
+        return pos_type(target - eback());
+    }
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override { return seekoff(off_type(pos), std::ios_base::beg, which); }
+};
+} // namespace
+
+CheckpointReader::CheckpointReader(const std::string &file_name)
+{
+    mFileName = file_name;
+    std::ifstream *in = new std::ifstream(file_name, std::ios::binary);
+    mIn.reset(in);
+    if (!in->is_open())
+        throw logic_error_fmt("Checkpoint: cannot open the file '{}'.", file_name);
+    init();
+}
+
+CheckpointReader::CheckpointReader(const std::string &data, const std::string &name)
+{
+    mFileName = name;
+    mBuffer.reset(new MemoryStreamBuffer(data.data(), data.size()));
+    mIn.reset(new std::istream(mBuffer.get()));
+    init();
+}
+
+CheckpointReader::~CheckpointReader()
+{
+    // the stream uses the buffer
+    mIn.reset();
+}
+
+void CheckpointReader::init()
+{
+    mSectionEnd = -1;
+    mIn->seekg(0, std::ios::end);
+    mFileSize = static_cast<std::streamoff>(mIn->tellg());
+    mIn->seekg(0, std::ios::beg);
+}
+
+bool CheckpointReader::atEnd()
+{
+    return static_cast<std::streamoff>(mIn->tellg()) >= mFileSize;
+}
+
+std::string CheckpointReader::beginSection()
+{
+    if (mSectionEnd >= 0)
+        throw logic_error_fmt("Checkpoint '{}': the section '{}' is not finished.", mFileName, mSection);
+    mSection = readString();
+    uint64_t size = checkedSize(read<uint64_t>(), 1);
+    mSectionEnd = static_cast<std::streamoff>(mIn->tellg()) + static_cast<std::streamoff>(size);
+    return mSection;
+}
+
+void CheckpointReader::endSection()
+{
+    if (static_cast<std::streamoff>(mIn->tellg()) != mSectionEnd)
+        throw logic_error_fmt("Checkpoint '{}': the size of section '{}' does not match the content (the checkpoint was probably written with a different configuration).", mFileName, mSection);
+    mSectionEnd = -1;
+}
+
+void CheckpointReader::skipSection()
+{
+    mIn->seekg(mSectionEnd);
+    mSectionEnd = -1;
+}
+
+void CheckpointReader::readBytes(char *data, size_t n)
+{
+    mIn->read(data, static_cast<std::streamsize>(n));
+    if (!*mIn || (mSectionEnd >= 0 && static_cast<std::streamoff>(mIn->tellg()) > mSectionEnd))
+        throw logic_error_fmt("Checkpoint '{}': unexpected end of data (section: '{}').", mFileName, mSection);
+}
+
+uint64_t CheckpointReader::checkedSize(uint64_t n, size_t element_size)
+{
+    std::streamoff remaining = mFileSize - static_cast<std::streamoff>(mIn->tellg());
+    if (element_size > 0 && n > static_cast<uint64_t>(remaining) / element_size)
+        throw logic_error_fmt("Checkpoint '{}': invalid size ({} elements) in section '{}'.", mFileName, n, mSection);
+    return n;
+}
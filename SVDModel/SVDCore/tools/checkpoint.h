@@ -0,0 +1,113 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief The CheckpointWriter class writes binary checkpoint files (snapshots of the model state).
+ * The data is written to a temporary file, which replaces the target file on commit(). An existing checkpoint
+ * therefore stays intact if the writing is interrupted.
+ * A checkpoint consists of named sections (beginSection() / endSection()); a section stores its size, and sections that are
+ * unknown to the reader can be skipped.
+ * The default constructor creates a writer that keeps the data in memory (see data()).
+ */
+class CheckpointWriter
+{
+public:
+    CheckpointWriter();
+    CheckpointWriter(const std::string &file_name);
+    ~CheckpointWriter();
+    /// write a plain value (e.g. int, double, or a struct without pointers)
+    template<typename T> void write(const T &value) { writeArray(&value, 1); }
+    /// write 'n' elements starting at 'data'
+    template<typename T> void writeArray(const T *data, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "CheckpointWriter: only trivially copyable types can be written.");
+        writeBytes(reinterpret_cast<const char*>(data), n * sizeof(T));
+    }
+    /// write the vector 'values' (size and elements)
+    template<typename T> void writeVector(const std::vector<T> &values) { write(static_cast<uint64_t>(values.size())); writeArray(values.data(), values.size()); }
+    void writeString(const std::string &s) { write(static_cast<uint64_t>(s.size())); writeBytes(s.data(), s.size()); }
+
+    /// start the section 'name' (sections can not be nested)
+    void beginSection(const std::string &name);
+    void endSection();
+
+    /// finish writing and replace the target file
+    void commit();
+    /// the written data (in-memory writers only)
+    std::string data() const;
+private:
+    void writeBytes(const char *data, size_t n);
+    std::string mFileName;
+    std::string mTempFileName; ///< empty for in-memory writers
+    bool mCommitted;
+    std::unique_ptr<std::ostream> mOut;
+    std::streamoff mSectionStart; ///< position of the size field of the current section (-1: no open section)
+};
+
+/**
+ * @brief The CheckpointReader class reads checkpoint files written by CheckpointWriter.
+ * Read errors (e.g. a truncated file) throw a std::logic_error.
+ */
+class CheckpointReader
+{
+public:
+    CheckpointReader(const std::string &file_name);
+    /// read from the memory block 'data' (e.g. CheckpointWriter::data()); the data is not copied and must stay valid.
+    /// 'name' is used in error messages.
+    CheckpointReader(const std::string &data, const std::string &name);
+    ~CheckpointReader();
+    const std::string &fileName() const { return mFileName; }
+    template<typename T> T read() { T value; readArray(&value, 1); return value; }
+    template<typename T> void readArray(T *data, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "CheckpointReader: only trivially copyable types can be read.");
+        readBytes(reinterpret_cast<char*>(data), n * sizeof(T));
+    }
+    template<typename T> std::vector<T> readVector() { std::vector<T> values(static_cast<size_t>(checkedSize(read<uint64_t>(), sizeof(T)))); readArray(values.data(), values.size()); return values; }
+    std::string readString() { std::string s(static_cast<size_t>(checkedSize(read<uint64_t>(), 1)), '\0'); readBytes(&s[0], s.size()); return s; }
+
+    /// true if there are no more sections to read
+    bool atEnd();
+    /// start reading the next section and return its name
+    std::string beginSection();
+    /// finish the current section. Throws an error if the section was not read completely.
+    void endSection();
+    /// skip the (remaining) content of the current section
+    void skipSection();
+private:
+    void readBytes(char *data, size_t n);
+    /// check that 'n' elements of 'element_size' bytes are available in the file
+    uint64_t checkedSize(uint64_t n, size_t element_size);
+    void init();
+    std::string mFileName;
+    std::unique_ptr<std::streambuf> mBuffer; ///< stream buffer for in-memory data
+    std::unique_ptr<std::istream> mIn;
+    std::streamoff mFileSize;
+    std::string mSection; ///< name of the current section
+    std::streamoff mSectionEnd; ///< end of the current section (-1: no open section)
+};
+
+#endif // CHECKPOINT_H
@@ -25,6 +25,7 @@
 #include <algorithm>
 #include <cassert>
 #include <mutex>
+#include <typeinfo>
 #include "randomgen.h"
 #include "strtools.h"
 
@@ -64,9 +65,19 @@
   }
   @endcode
 
-  Be careful with multithreading:
-  Now the calculate(double v1, double v2) as well as the calculate(wrapper, v1,v2) are thread safe. execute() accesses the internal variable list and is therefore not thredsafe.
-  A threadsafe version exists (executeLocked()). Special attention is needed when using setVar() or addVar().
+  Multithreading:
+  An expression is compiled once (parse(), on first use) into an execution list that is not changed afterwards.
+  All state that changes during an evaluation (local variables, incsum) is kept on the stack or in a ExpressionContext.
+  Therefore calculate(double v1, double v2), calculate(wrapper, v1,v2), calculateBatch() and evaluate() (with one context per thread)
+  can be used concurrently without locking. execute() accesses the internal variable list and is therefore not thread safe.
+  The same is true for calculate() after enableIncSum(): incsum() then accumulates over calls in the expression itself.
+  Special attention is needed when using setVar() or addVar().
+
+  Optimization:
+  After parsing, the execution list is optimized (see optimize()): constant parts are evaluated once (e.g. "x*(2+3)" -> "x*5"),
+  and sub-expressions that occur multiple times are evaluated only once (the value is kept in a temporary variable).
+  Variables of the model object are bound to direct accessors if the wrapper supports it (ExpressionWrapper::bindVariable()),
+  e.g. the CellWrapper provides direct access to state, environment and climate variables.
 
 */
 
@@ -92,9 +103,7 @@ static std::string AggFuncList[AGGFUNCCOUNT]={"sum", "avg", "max", "min", "stdde
 bool Expression::mLinearizationAllowed = false;
 Expression::Expression()
 {
-    mModelObject = nullptr;
-    m_externVarSpace=nullptr;
-    m_execList=nullptr;
+    setExpression("");
 }
 
 
@@ -176,8 +185,6 @@ Expression::ETokType  Expression::next_token()
 
 Expression::~Expression()
 {
-    if (m_execList)
-        delete[] m_execList;
 }
 
 
@@ -203,7 +210,7 @@ void Expression::setExpression(const std::string& aExpression)
 
     for (int i=0; i<MAXLOCALVAR; i++)
         m_varSpace[i]=0.;
-    m_parsed=false;
+    m_parsed.store(false);
     m_catchExceptions = false;
     m_errorMsg = "";
 
@@ -214,8 +221,10 @@ void Expression::setExpression(const std::string& aExpression)
     m_incSumEnabled=false;
     m_empty= (m_expression=="") ;
     // Buffer:
-    m_execListSize = 5; // inital value...
-    m_execList = new ExtExecListItem[m_execListSize]; // init
+    m_execList.assign(5, ExtExecListItem()); // inital size...
+    m_incSumVar = 0.;
+    m_nTemps = 0;
+    m_bindingType = nullptr;
 
     mLinearizeMode = 0; // linearization is switched off
     mScriptIndexFunc=nullptr;
@@ -223,12 +232,30 @@ void Expression::setExpression(const std::string& aExpression)
 }
 
 
-static std::mutex parse_mutex;
 void  Expression::parse(ExpressionWrapper *wrapper)
 {
-    std::lock_guard<std::mutex> guard(parse_mutex);
-    if (m_parsed)
+    std::lock_guard<std::mutex> guard(m_parseMutex);
+    if (m_parsed.load(std::memory_order_relaxed))
+        return;
+    parseInternal(wrapper);
+}
+
+inline void Expression::ensureParsed(ExpressionWrapper *wrapper, bool lax) const
+{
+    if (m_parsed.load(std::memory_order_acquire))
         return;
+    // first use: parse (only one thread); the compiled program is published by setting m_parsed
+    Expression *self = const_cast<Expression*>(this);
+    std::lock_guard<std::mutex> guard(self->m_parseMutex);
+    if (m_parsed.load(std::memory_order_relaxed))
+        return;
+    if (lax)
+        self->m_strict = false;
+    self->parseInternal(wrapper);
+}
+
+void Expression::parseInternal(ExpressionWrapper *wrapper)
+{
     try {
         ExpressionWrapper *old_wrap=mModelObject;
         if (wrapper) {
@@ -267,7 +294,9 @@ void  Expression::parse(ExpressionWrapper *wrapper)
         m_execList[m_execIndex].Value=0;
         m_execList[m_execIndex++].Index=0;
         checkBuffer(m_execIndex);
-        m_parsed=true;
+        optimize();
+        bindVariables(mModelObject);
+        m_parsed.store(true, std::memory_order_release);
 
         mModelObject = old_wrap;
 
@@ -452,7 +481,7 @@ void  Expression::parse_level4()
 
 void Expression::setVar(const std::string& Var, double Value)
 {
-    if (!m_parsed)
+    if (!m_parsed.load())
         parse();
     int idx=getVarIndex(Var);
     if (idx>=0 && idx<MAXLOCALVAR)
@@ -468,20 +497,20 @@ double Expression::calculate(const double Val1, const double Val2, const bool fo
             return linearizedValue(Val1);
         return linearizedValue2d(Val1, Val2); // matrix case
     }
-    double var_space[MAXLOCALVAR];
-    var_space[0]=Val1;
-    var_space[1]=Val2;
-    m_strict=false;
-    return execute(var_space); // execute with local variables on stack
+    ensureParsed(nullptr, true); // variables are added when encountered first
+    double var_space[MAXLOCALVAR] = {Val1, Val2};
+    double inc_sum = 0.;
+    // with enableIncSum() the sum continues over calls (as for execute()); otherwise each call starts from 0
+    return run(m_execList.data(), var_space, nullptr, nullptr, m_incSumEnabled ? &m_incSumVar : &inc_sum); // execute with local variables on stack
 }
 
 double Expression::calculate(ExpressionWrapper &object, const double variable_value1, const double variable_value2) const
 {
-    double var_space[MAXLOCALVAR];
-    var_space[0] = variable_value1;
-    var_space[1]=variable_value2;
-    // m_strict=false;
-    return execute(var_space,&object); // execute with local variables on stack
+    ensureParsed(&object, false);
+    double var_space[MAXLOCALVAR] = {variable_value1, variable_value2};
+    double inc_sum = 0.;
+    // with enableIncSum() the sum continues over calls (as for execute()); otherwise each call starts from 0
+    return run(m_execList.data(), var_space, &object, nullptr, m_incSumEnabled ? &m_incSumVar : &inc_sum); // execute with local variables on stack
 }
 
 
@@ -495,13 +524,26 @@ int Expression::getFuncIndex(const std::string& functionName)
 
 double Expression::execute(double *varlist, ExpressionWrapper *object, bool *rLogicResult) const
 {
-    if (!m_parsed)
-        const_cast<Expression*>(this)->parse(object);
-    const double *varSpace = varlist?varlist:m_varSpace;
-    ExtExecListItem *exec=m_execList;
+    ensureParsed(object, false);
+    return run(m_execList.data(), varlist?varlist:m_varSpace, object, rLogicResult, &m_incSumVar);
+}
+
+double Expression::evaluate(ExpressionContext &context, ExpressionWrapper *object, bool *rLogicResult) const
+{
+    ensureParsed(object, false);
+    return run(m_execList.data(), context.varSpace, object, rLogicResult, &context.incSum);
+}
+
+double Expression::run(const ExtExecListItem *program, const double *varSpace, ExpressionWrapper *object, bool *rLogicResult, double *incSum) const
+{
+    const ExtExecListItem *exec=program;
     int i;
     double result;
     double Stack[20];
+    double Temp[MAXTEMPVAR];
+    // use the direct accessors if the model object is of the type used for binding
+    ExpressionWrapper *model_object = object ? object : mModelObject;
+    const bool bound = m_bindingType && model_object && typeid(*model_object)==*m_bindingType;
     bool   LogicStack[20];
     bool   *lp=LogicStack;
     double *p=Stack;  // p=head pointer
@@ -526,13 +568,19 @@ double Expression::execute(double *varlist, ExpressionWrapper *object, bool *rLo
             if (exec->Index<100)
                 *p++=varSpace[exec->Index];
             else if (exec->Index<1000)
-                *p++=getModelVar(exec->Index,object);
+                *p++= bound ? exec->Access(model_object, exec->Param) : getModelVar(exec->Index,object);
             else
                 *p++=getExternVar(exec->Index);
             break;
         case etNumber:
             *p++=exec->Value;
             break;
+        case etStore:
+            Temp[exec->Index]=*(p-1);
+            break;
+        case etLoad:
+            *p++=Temp[exec->Index];
+            break;
         case etFunction:
             p--;
             switch (exec->Index) {
@@ -559,8 +607,8 @@ double Expression::execute(double *varlist, ExpressionWrapper *object, bool *rLo
                 p-= 2; // drop both arguments
                 break;
             case 9: // incremental sum
-                m_incSumVar+=*p;
-                *p=m_incSumVar;
+                *incSum+=*p;
+                *p=*incSum;
                 break;
             case 10: // polygon-function
                 *(p-(int)(exec->Value-1))=udfPolygon(*(p-(int)(exec->Value-1)), p, (int)exec->Value);
@@ -650,6 +698,229 @@ double Expression::execute(double *varlist, ExpressionWrapper *object, bool *rLo
     return result;
 }
 
+// number of objects that are processed together in batch mode
+static const size_t BatchBlockSize = 256;
+
+void Expression::calculateBatch(ExpressionWrapper &object, size_t n, const std::function<void (size_t)> &select, double *results) const
+{
+    ensureParsed(&object, false);
+    if (isEmpty()) {
+        std::fill(results, results+n, 0.);
+        return;
+    }
+    // find the variables of the model object used by the expression, and check if
+    // batch mode is possible (incsum and the neighborhood functions need the individual object)
+    std::vector<int> model_vars;
+    std::vector<const ExtExecListItem*> model_var_items;
+    bool batch_mode = true;
+    for (const ExtExecListItem *exec=m_execList.data(); exec->Type!=etStop; ++exec) {
+        if (exec->Type==etVariable && exec->Index>=100 && exec->Index<1000)
+            if (std::find(model_vars.begin(), model_vars.end(), exec->Index) == model_vars.end()) {
+                model_vars.push_back(exec->Index);
+                model_var_items.push_back(exec);
+            }
+        if (exec->Type==etFunction && (exec->Index==9 || exec->Index>=18))
+            batch_mode = false;
+    }
+    if (!batch_mode) {
+        for (size_t i=0;i<n;++i) {
+            select(i);
+            results[i] = calculate(object);
+        }
+        return;
+    }
+
+    const size_t stride = std::min(n, BatchBlockSize);
+    std::vector<double> columns(model_vars.size() * stride);
+    std::vector<double> stack((20 + static_cast<size_t>(m_nTemps)) * stride);
+    std::vector<char> logic(21 * stride);
+    const bool bound = m_bindingType && typeid(object)==*m_bindingType;
+    for (size_t start=0; start<n; start+=stride) {
+        size_t m = std::min(stride, n - start);
+        // fetch the variables column-wise
+        for (size_t i=0;i<m;++i) {
+            select(start + i);
+            if (bound) {
+                for (size_t v=0; v<model_vars.size(); ++v)
+                    columns[v*stride + i] = model_var_items[v]->Access(&object, model_var_items[v]->Param);
+            } else {
+                for (size_t v=0; v<model_vars.size(); ++v)
+                    columns[v*stride + i] = object.value(static_cast<size_t>(model_vars[v] - 100));
+            }
+        }
+        executeBatch(m, stride, model_vars, columns.data(), stack.data(), logic.data(), results + start);
+    }
+}
+
+void Expression::executeBatch(size_t n, size_t stride, const std::vector<int> &model_vars, const double *columns, double *stack, char *logic, double *results) const
+{
+    double *p = stack; // p: next free entry of the stack (each entry has 'stride' values)
+    double *stack_end = stack + 20*stride;
+    double *temps = stack_end; // temporary values are stored after the stack
+    char *lp = logic;
+    std::fill(lp, lp+n, 1);
+    lp += stride;
+    size_t i;
+    for (const ExtExecListItem *exec=m_execList.data(); exec->Type!=etStop; ++exec) {
+        switch (exec->Type) {
+        case etOperator: {
+            if (exec->Index == '_') { // unary operator -
+                double *a = p - stride;
+                for (i=0;i<n;++i) a[i] = -a[i];
+                break;
+            }
+            p -= stride;
+            double *a = p - stride;
+            const double *b = p;
+            switch (exec->Index) {
+            case '+': for (i=0;i<n;++i) a[i] = a[i] + b[i]; break;
+            case '-': for (i=0;i<n;++i) a[i] = a[i] - b[i]; break;
+            case '*': for (i=0;i<n;++i) a[i] = a[i] * b[i]; break;
+            case '/': for (i=0;i<n;++i) a[i] = a[i] / b[i]; break;
+            case '^': for (i=0;i<n;++i) a[i] = pow(a[i], b[i]); break;
+            }
+            break;
+        }
+        case etVariable:
+            if (p >= stack_end)
+                throw std::logic_error("Expression::executeBatch: stack overflow in: " + m_expression);
+            if (exec->Index<100) {
+                std::fill(p, p+n, 0.); // local variables are 0 (see calculate())
+            } else if (exec->Index<1000) {
+                size_t v = static_cast<size_t>(std::find(model_vars.begin(), model_vars.end(), exec->Index) - model_vars.begin());
+                std::copy(columns + v*stride, columns + v*stride + n, p);
+            } else {
+                std::fill(p, p+n, getExternVar(exec->Index));
+            }
+            p += stride;
+            break;
+        case etNumber:
+            if (p >= stack_end)
+                throw std::logic_error("Expression::executeBatch: stack overflow in: " + m_expression);
+            std::fill(p, p+n, exec->Value);
+            p += stride;
+            break;
+        case etStore:
+            std::copy(p - stride, p - stride + n, temps + exec->Index*stride);
+            break;
+        case etLoad:
+            if (p >= stack_end)
+                throw std::logic_error("Expression::executeBatch: stack overflow in: " + m_expression);
+            std::copy(temps + exec->Index*stride, temps + exec->Index*stride + n, p);
+            p += stride;
+            break;
+        case etFunction: {
+            int n_args = static_cast<int>(exec->Value);
+            double *top = p - stride; // last argument
+            switch (exec->Index) {
+            case 0: for (i=0;i<n;++i) top[i] = sin(top[i]); break;
+            case 1: for (i=0;i<n;++i) top[i] = cos(top[i]); break;
+            case 2: for (i=0;i<n;++i) top[i] = tan(top[i]); break;
+            case 3: for (i=0;i<n;++i) top[i] = exp(top[i]); break;
+            case 4: for (i=0;i<n;++i) top[i] = log(top[i]); break;
+            case 5: for (i=0;i<n;++i) top[i] = sqrt(top[i]); break;
+            case 6: // min
+                for (int k=0;k<n_args-1;++k, top-=stride) {
+                    double *a = top - stride;
+                    for (i=0;i<n;++i) a[i] = top[i]<a[i] ? top[i] : a[i];
+                }
+                break;
+            case 7: // max
+                for (int k=0;k<n_args-1;++k, top-=stride) {
+                    double *a = top - stride;
+                    for (i=0;i<n;++i) a[i] = top[i]>a[i] ? top[i] : a[i];
+                }
+                break;
+            case 8: { // if
+                double *c = top - 2*stride, *t = top - stride;
+                for (i=0;i<n;++i) c[i] = c[i]==1 ? t[i] : top[i];
+                top = c;
+                break;
+            }
+            case 10: case 17: { // polygon, in: the arguments of each object are copied to a buffer
+                double *first = top - (n_args-1)*stride;
+                std::vector<double> args(static_cast<size_t>(n_args));
+                for (i=0;i<n;++i) {
+                    for (int k=0;k<n_args;++k)
+                        args[static_cast<size_t>(k)] = first[k*stride + i];
+                    if (exec->Index==10)
+                        first[i] = udfPolygon(args[0], &args.back(), n_args);
+                    else
+                        first[i] = udfIn(args[0], &args.back(), n_args);
+                }
+                top = first;
+                break;
+            }
+            case 11: { // modulo
+                double *a = top - stride;
+                for (i=0;i<n;++i) a[i] = fmod(a[i], top[i]);
+                top = a;
+                break;
+            }
+            case 12: { // sigmoid
+                double *a = top - 3*stride;
+                for (i=0;i<n;++i) a[i] = udfSigmoid(a[i], a[stride+i], a[2*stride+i], top[i]);
+                top = a;
+                break;
+            }
+            case 13: case 14: { // rnd, rndg
+                double *a = top - stride;
+                for (i=0;i<n;++i) a[i] = udfRandom(exec->Index-13, a[i], top[i]);
+                top = a;
+                break;
+            }
+            case 15: { // limit(value, lower_bound, upper_bound)
+                double *a = top - 2*stride, *l = top - stride;
+                for (i=0;i<n;++i) {
+                    double m = a[i]<l[i] ? l[i] : a[i];
+                    a[i] = m>top[i] ? top[i] : m;
+                }
+                top = a;
+                break;
+            }
+            case 16: for (i=0;i<n;++i) top[i] = floor(top[i] + 0.5); break;
+            default: throw std::logic_error("Expression::executeBatch: function not supported in batch mode: " + m_expression);
+            }
+            p = top + stride;
+            break;
+        }
+        case etLogical: {
+            p -= stride;
+            lp -= stride;
+            char *la = lp - stride;
+            const char *lb = lp;
+            if (exec->Index==opAnd)
+                for (i=0;i<n;++i) la[i] = la[i] && lb[i];
+            else
+                for (i=0;i<n;++i) la[i] = la[i] || lb[i];
+            double *a = p - stride;
+            for (i=0;i<n;++i) a[i] = la[i] ? 1. : 0.;
+            break;
+        }
+        case etCompare: {
+            p -= stride;
+            double *a = p - stride;
+            const double *b = p;
+            switch (exec->Index) {
+            case opEqual: for (i=0;i<n;++i) a[i] = a[i]==b[i]; break;
+            case opNotEqual: for (i=0;i<n;++i) a[i] = a[i]!=b[i]; break;
+            case opLowerThen: for (i=0;i<n;++i) a[i] = a[i]<b[i]; break;
+            case opGreaterThen: for (i=0;i<n;++i) a[i] = a[i]>b[i]; break;
+            case opGreaterOrEqual: for (i=0;i<n;++i) a[i] = a[i]>=b[i]; break;
+            case opLowerOrEqual: for (i=0;i<n;++i) a[i] = a[i]<=b[i]; break;
+            }
+            for (i=0;i<n;++i) lp[i] = a[i]!=0.;
+            lp += stride;
+            break;
+        }
+        case etStop: case etUnknown: case etDelimeter: throw std::logic_error("invalid token during execution.");
+        }
+    }
+    if (p - stack != static_cast<std::ptrdiff_t>(stride))
+        throw std::logic_error("Expression::executeBatch: stack unbalanced: in: " + m_expression);
+    std::copy(stack, stack + n, results);
+}
+
 double * Expression::addVar(const std::string& VarName)
 {
     // add var
@@ -662,7 +933,7 @@ double * Expression::addVar(const std::string& VarName)
 
 double *  Expression::getVarAdress(const std::string& VarName)
 {
-    if (!m_parsed)
+    if (!m_parsed.load())
         parse();
     int idx=getVarIndex(VarName);
     if (idx>=0 && idx<MAXLOCALVAR)
@@ -812,20 +1083,13 @@ double Expression::udfIn(double Value, double *Stack, int ArgCount) const
 // SVD specific neighborhood functions
 double Expression::udfNeighborhood(ExpressionWrapper *object, int neighbor_class, double *Stack, int ArgCount) const
 {
-    // signature: f(
+    // signature: f(stateId, stateId, ...): sum of the frequencies of the states
     if (!object) return 0.;
-    CellWrapper *wrap = dynamic_cast<CellWrapper*>(object);
-    if (!wrap) return 0.;
     double *p = Stack - (ArgCount-1);
     double result = 0.;
     while (p <= Stack) {
         size_t stateId = static_cast<size_t>( *p );
-        switch (neighbor_class) {
-        case 1: result += wrap->localStateAverage(stateId); break;
-        case 2: result += wrap->intermediateStateAverage(stateId); break;
-        case 3: result +=  wrap->globalStateAverage(stateId); break;
-        default: break;
-        }
+        result += object->stateFrequency(neighbor_class, stateId);
         ++p;
     }
     return result;
@@ -835,18 +1099,151 @@ double Expression::udfNeighborhood(ExpressionWrapper *object, int neighbor_class
 void Expression::checkBuffer(int Index)
 {
     // manage the buffer: increase size if necessary
-    if (Index<m_execListSize)
+    if (Index<static_cast<int>(m_execList.size()))
+        return;
+    m_execList.resize(m_execList.size() * 2); // double size every time: 5->10->20->40->80->160
+}
+
+void Expression::optimize()
+{
+    if (m_empty)
         return;
-    int NewSize=m_execListSize * 2; // double size every time: 5->10->20->40->80->160
-    // (1) create new buffer
-    ExtExecListItem *NewBuf=new ExtExecListItem[NewSize];
-    // (2) copy values
-    for (int i=0;i<m_execListSize;i++)
-        NewBuf[i]=m_execList[i];
-    // (3) use new buffer
-    delete[] m_execList;
-    m_execList = NewBuf;
-    m_execListSize=NewSize;
+    const ExtExecListItem stop = m_execList[static_cast<size_t>(m_execIndex-1)];
+    std::vector<ExtExecListItem> code(m_execList.begin(), m_execList.begin() + (m_execIndex-1));
+
+    auto make_item = [](ETokType type, double value, int index) {
+        ExtExecListItem item = ExtExecListItem();
+        item.Type = type; item.Value = value; item.Index = index;
+        return item;
+    };
+    // number of values an item takes from the stack
+    auto n_args = [](const ExtExecListItem &item) {
+        switch (item.Type) {
+        case etOperator: return item.Index=='_' ? 1 : 2;
+        case etFunction: return static_cast<int>(item.Value);
+        case etLogical: case etCompare: return 2;
+        default: return 0;
+        }
+    };
+
+    // (1) constant folding: operators and functions with only constant arguments are evaluated once.
+    // not folded: incsum(), rnd(), rndg(), the neighborhood functions, and comparisons/logical operations (logic stack)
+    std::vector<ExtExecListItem> folded;
+    for (const auto &item : code) {
+        folded.push_back(item);
+        bool foldable = item.Type==etOperator ||
+                (item.Type==etFunction && item.Index!=9 && item.Index!=13 && item.Index!=14 && item.Index<18);
+        size_t k = static_cast<size_t>(n_args(item));
+        if (!foldable || folded.size() <= k)
+            continue;
+        bool constant = true;
+        for (size_t j=folded.size()-1-k; j<folded.size()-1; ++j)
+            if (folded[j].Type!=etNumber)
+                constant = false;
+        if (!constant)
+            continue;
+        std::vector<ExtExecListItem> program(folded.end()-static_cast<std::ptrdiff_t>(k)-1, folded.end());
+        program.push_back(stop);
+        double inc_sum = 0.;
+        double value = run(program.data(), m_varSpace, nullptr, nullptr, &inc_sum);
+        folded.resize(folded.size()-k-1);
+        folded.push_back(make_item(etNumber, value, -1));
+    }
+
+    // (2) common subexpressions: sub-expressions that occur multiple times are calculated
+    // once and stored in a temporary variable (etStore); other occurrences are replaced by etLoad.
+    const size_t n = folded.size();
+    std::vector<size_t> first(n); // index of the first item of the sub-expression that ends at item i
+    std::vector<size_t> n_bad(n+1, 0); // number of items that can not be shared (side effects, logic stack) before item i
+    std::vector<size_t> stack;
+    bool valid = true;
+    for (size_t i=0;i<n && valid;++i) {
+        const ExtExecListItem &item = folded[i];
+        size_t k = static_cast<size_t>(n_args(item));
+        if (stack.size() < k) {
+            valid = false;
+            break;
+        }
+        first[i] = k>0 ? stack[stack.size()-k] : i;
+        stack.resize(stack.size()-k);
+        stack.push_back(first[i]);
+        bool bad = item.Type==etLogical || item.Type==etCompare ||
+                (item.Type==etFunction && (item.Index==9 || item.Index==13 || item.Index==14));
+        n_bad[i+1] = n_bad[i] + (bad ? 1 : 0);
+    }
+    std::vector<size_t> candidates;
+    if (valid)
+        for (size_t i=0;i<n;++i) {
+            size_t len = i - first[i] + 1;
+            if (n_bad[i+1]==n_bad[first[i]] && (len>=3 || (len==2 && folded[i].Type==etFunction)))
+                candidates.push_back(i);
+        }
+    // larger sub-expressions first
+    std::stable_sort(candidates.begin(), candidates.end(), [&first](size_t a, size_t b) { return a-first[a] > b-first[b]; });
+    auto same = [&](size_t a, size_t b) {
+        if (a-first[a] != b-first[b])
+            return false;
+        for (size_t j=first[a], l=first[b]; j<=a; ++j, ++l)
+            if (folded[j].Type!=folded[l].Type || folded[j].Index!=folded[l].Index || !(folded[j].Value==folded[l].Value))
+                return false;
+        return true;
+    };
+    std::vector<char> handled(n, 0), deleted(n, 0);
+    std::vector<int> store_at(n, -1), load_at(n, -1);
+    for (size_t c : candidates) {
+        if (handled[c] || deleted[c])
+            continue;
+        std::vector<size_t> occurrences;
+        for (size_t o : candidates)
+            if (!handled[o] && !deleted[o] && same(c, o)) {
+                occurrences.push_back(o);
+                handled[o] = 1;
+            }
+        if (occurrences.size() < 2)
+            continue;
+        if (m_nTemps >= MAXTEMPVAR)
+            break;
+        std::sort(occurrences.begin(), occurrences.end());
+        int temp = m_nTemps++;
+        store_at[occurrences.front()] = temp;
+        for (size_t k=1;k<occurrences.size();++k) {
+            size_t o = occurrences[k];
+            std::fill(deleted.begin() + static_cast<std::ptrdiff_t>(first[o]), deleted.begin() + static_cast<std::ptrdiff_t>(o) + 1, 1);
+            load_at[o] = temp;
+        }
+    }
+
+    // (3) the new execution list
+    m_execList.clear();
+    for (size_t i=0;i<n;++i) {
+        if (load_at[i]>=0)
+            m_execList.push_back(make_item(etLoad, 0., load_at[i]));
+        else if (!deleted[i])
+            m_execList.push_back(folded[i]);
+        if (store_at[i]>=0)
+            m_execList.push_back(make_item(etStore, 0., store_at[i]));
+    }
+    m_execList.push_back(stop);
+    m_execIndex = static_cast<int>(m_execList.size());
+}
+
+void Expression::bindVariables(ExpressionWrapper *wrapper)
+{
+    m_bindingType = nullptr;
+    if (!wrapper)
+        return;
+    bool has_model_vars = false;
+    for (ExtExecListItem &item : m_execList) {
+        if (item.Type==etStop)
+            break;
+        if (item.Type==etVariable && item.Index>=100 && item.Index<1000) {
+            if (!wrapper->bindVariable(static_cast<size_t>(item.Index-100), item.Access, item.Param))
+                return; // no binding: value() is used for all variables
+            has_model_vars = true;
+        }
+    }
+    if (has_model_vars)
+        m_bindingType = &typeid(*wrapper);
 }
 
 
@@ -22,14 +22,32 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+#include "expressionwrapper.h"
 
 #define MAXLOCALVAR 15
-class ExpressionWrapper;
+#define MAXTEMPVAR 8
+
+/// ExpressionContext holds the state that changes during the evaluation of an Expression
+/// (values of local variables, the incremental sum). Each thread uses its own context (see Expression::evaluate()).
+class ExpressionContext
+{
+public:
+    ExpressionContext() : incSum(0.) { for (int i=0;i<MAXLOCALVAR;++i) varSpace[i]=0.; }
+    double varSpace[MAXLOCALVAR]; ///< values of the local variables
+    double incSum; ///< current value of incsum()
+};
+
 class Expression
 {
 public:
         ~Expression();
         Expression();
+        Expression(const Expression &) = delete;
+        Expression &operator=(const Expression &) = delete;
         enum BoolValue { False=0, True=1 };
         Expression(const std::string &aExpression) { setExpression(aExpression); }
         Expression(const std::string &expression, ExpressionWrapper *wrapper) { setExpression(expression); mModelObject = wrapper;  }
@@ -47,7 +65,9 @@ public:
         /// @param get_value a function with the signature double func(int var_index) --> to retrieve the current value of the associated function
         void setScriptingFunctions( int (*get_index)(const std::string &), double (*get_value)(int)) { mScriptIndexFunc=get_index; mScriptValueFunc = get_value; }
         // calculations
-        double execute(double *varlist=0, ExpressionWrapper *object=0, bool *rLogicResult=0) const; ///< calculate formula and return result. variable values need to be set using "setVar()"
+        double execute(double *varlist=0, ExpressionWrapper *object=0, bool *rLogicResult=0) const; ///< calculate formula and return result. variable values need to be set using "setVar()" (not thread safe)
+        /// calculate the formula using the local variables and state of 'context'. Thread safe (with one context per thread).
+        double evaluate(ExpressionContext &context, ExpressionWrapper *object=nullptr, bool *rLogicResult=nullptr) const;
         /** calculate formula. the first two variables are assigned the values Val1 and Val2. This function is for convenience.
            the return is the result of the calculation.
            e.g.: x+3*y --> Val1->x, Val2->y
@@ -64,6 +84,10 @@ public:
             double res = calculate(object, variable_value1, variable_value2);
             return !(res==0.);
         }
+        /// calculate the formula for 'n' objects at once (batch mode). 'select(i)' is called to set 'object' to the i-th object
+        /// (e.g. CellWrapper::setData()); the results are written to 'results' (n values).
+        /// The variables are fetched column-wise and each operation is executed for a block of objects.
+        void calculateBatch(ExpressionWrapper &object, size_t n, const std::function<void(size_t)> &select, double *results) const;
         //variables
         /// set the value of the variable named "Var". Note: using addVar to obtain a pointer may be more efficient for multiple executions.
         void  setVar(const std::string& Var, double Value);
@@ -84,28 +108,44 @@ public:
         void setStrict(bool str) { m_strict=str; }
         void setCatchExceptions(bool docatch=true) { m_catchExceptions = docatch; }
         void   setExternalVarSpace(const std::vector<std::string>& ExternSpaceNames, double* ExternSpace);
+        /// incsum() accumulates over subsequent calls of execute() and calculate() (resets the sum; calculate() is then not thread safe)
         void enableIncSum();
         double udfRandom(int type, double p1, double p2) const; ///< user defined function rnd() (normal distribution does not work now!)
 private:
-        enum ETokType {etNumber, etOperator, etVariable, etFunction, etLogical, etCompare, etStop, etUnknown, etDelimeter};
+        enum ETokType {etNumber, etOperator, etVariable, etFunction, etLogical, etCompare, etStop, etUnknown, etDelimeter,
+                       etStore, etLoad}; // etStore/etLoad: temporary values (common subexpressions)
         enum EValueClasses {evcBHD, evcHoehe, evcAlter};
         struct ExtExecListItem {
             ETokType Type;
             double  Value;
             int     Index;
+            ExpressionVariableAccessor Access; ///< direct access to a model variable (see bindVariables())
+            size_t Param; ///< parameter for 'Access'
         };
         enum EDatatype {edtInfo, edtNumber, edtString, edtObject, edtVoid, edtObjVar, edtReference, edtObjectReference};
         bool m_catchExceptions;
         std::string m_errorMsg;
 
-        bool m_parsed;
-        mutable bool m_strict;
+        // the compiled program (m_execList) is immutable after parse(); m_parsed is set when the program is complete
+        std::atomic<bool> m_parsed;
+        std::mutex m_parseMutex;
+        /// parse the expression if this has not happened yet (thread safe). if 'lax' is true, unknown variables are local variables
+        inline void ensureParsed(ExpressionWrapper *wrapper, bool lax) const;
+        void parseInternal(ExpressionWrapper *wrapper);
+        /// run the compiled program 'program' with the local variables 'varSpace'
+        double run(const ExtExecListItem *program, const double *varSpace, ExpressionWrapper *object, bool *rLogicResult, double *incSum) const;
+        /// optimization of the compiled program: constant folding and common subexpressions
+        void optimize();
+        /// bind model variables to the direct accessors of the 'wrapper' (see ExpressionWrapper::bindVariable())
+        void bindVariables(ExpressionWrapper *wrapper);
+        int m_nTemps; ///< number of temporary values (common subexpressions)
+        const std::type_info *m_bindingType; ///< type of the wrapper used for binding variables (or nullptr)
+        bool m_strict;
         bool m_empty; // empty expression
         bool m_constExpression;
         std::string m_tokString;
         std::string m_expression;
-        Expression::ExtExecListItem *m_execList;
-        int m_execListSize; // size of buffer
+        std::vector<ExtExecListItem> m_execList;
         int m_execIndex;
         double m_varSpace[MAXLOCALVAR];
         std::vector<std::string> m_varList;
@@ -130,13 +170,16 @@ private:
         int  getFuncIndex(const std::string& functionName);
         int  getVarIndex(const std::string& variableName);
         inline double getModelVar(const int varIdx, ExpressionWrapper *object=0) const ;
+        /// execute the expression for 'n' values (see calculateBatch()). Each stack entry has 'stride' values,
+        /// temporary values (see optimize()) are stored after the 20 entries of the stack.
+        void executeBatch(size_t n, size_t stride, const std::vector<int> &model_vars, const double *columns, double *stack, char *logic, double *results) const;
 
         // link to external model variable
         ExpressionWrapper *mModelObject;
 
         double getExternVar(const int Index) const;
         // inc-sum
-        mutable double m_incSumVar;
+        mutable double m_incSumVar; ///< incsum() state for execute(), and for calculate() if enableIncSum() was called
         bool   m_incSumEnabled;
         double  udfPolygon(double Value, double* Stack, int ArgCount) const; ///< special function polygon()
         double udfSigmoid(double Value, double sType, double p1, double p2) const; ///< special function sigmoid()
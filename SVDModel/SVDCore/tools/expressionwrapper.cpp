@@ -33,6 +33,8 @@
 #include "model.h"
 #include "modules/module.h"
 
+#include <algorithm>
+
 #define VARCOUNT 52
 static const char *VarList[VARCOUNT]={"bhd", "alter", "hoehe", "art", "id", "vorrat",
                                "npp", "gpp", "leafarea", "leafweight", "mstem",
@@ -109,6 +111,19 @@ double ExpressionWrapper::valueByName(const std::string &variableName)
     return value(idx);
 }
 
+bool ExpressionWrapper::bindVariable(const size_t variableIndex, ExpressionVariableAccessor &rAccessor, size_t &rParam)
+{
+    // no direct access by default
+    (void)variableIndex; (void)rAccessor; (void)rParam;
+    return false;
+}
+
+double ExpressionWrapper::stateFrequency(const int neighborClass, const size_t stateId)
+{
+    (void)neighborClass; (void)stateId;
+    return 0.;
+}
+
 /***********************
 *** Tree Wrapper     ***
 ***********************/
@@ -177,7 +192,7 @@ std::vector<std::pair<std::string, std::string> > CellWrapper::mVariablesMetaDat
 size_t CellWrapper::mMaxStateVar = 0;
 size_t CellWrapper::mMaxEnvVar = 0;
 size_t CellWrapper::mMaxClimVar = 0;
-std::vector<std::pair<const Module*, size_t> > CellWrapper::mModules;
+std::vector<std::pair<size_t, size_t> > CellWrapper::mModules;
 
 void CellWrapper::setupVariables(EnvironmentCell *ecell, const State *astate)
 {
@@ -235,9 +250,15 @@ void CellWrapper::setupVariables(const Module *module)
     auto vars = module->moduleVariableNames();
     if (vars.size()==0)
         return;
+    // modules are stored by index, i.e. the variables are valid for all models with the same modules (replicates)
+    const auto &modules = Model::instance()->modules();
+    size_t module_index = static_cast<size_t>(std::find_if(modules.begin(), modules.end(),
+                                                           [module](const std::shared_ptr<Module> &m) { return m.get() == module; }) - modules.begin());
+    if (module_index >= modules.size())
+        throw logic_error_fmt("CellWrapper: the module '{}' is not active.", module->name());
     for (size_t i=0;i<vars.size();++i) {
         mVariableList.push_back(vars[i].first);
-        mModules.push_back(std::pair<const Module*, size_t>(module, i));
+        mModules.push_back(std::pair<size_t, size_t>(module_index, i));
         mVariablesMetaData.push_back({module->name(), vars[i].second});
     }
 }
@@ -279,26 +300,81 @@ double CellWrapper::value(const size_t variableIndex)
         // module variable
         size_t mod_idx = variableIndex - mMaxClimVar;
         if (mod_idx < mModules.size()) {
-            return mModules[mod_idx].first->moduleVariable( mData, mModules[mod_idx].second );
+            return Model::instance()->modules()[mModules[mod_idx].first]->moduleVariable( mData, mModules[mod_idx].second );
         }
 
     }
     return 0.;
 }
 
+bool CellWrapper::bindVariable(const size_t variableIndex, ExpressionVariableAccessor &rAccessor, size_t &rParam)
+{
+    // the same layout of variables as in value(), but resolved only once (when the expression is parsed)
+    const size_t NFixedVariables = 8;
+    rParam = 0;
+    if (variableIndex < NFixedVariables) {
+        switch (variableIndex) {
+        case 0: rAccessor = [](ExpressionWrapper *w, size_t) { return static_cast<double>(static_cast<CellWrapper*>(w)->mData->cellIndex()); }; break;
+        case 1: rAccessor = [](ExpressionWrapper *w, size_t) { return static_cast<double>(static_cast<CellWrapper*>(w)->mData->environment()->id()); }; break;
+        case 2: rAccessor = [](ExpressionWrapper *w, size_t) { return static_cast<double>(static_cast<CellWrapper*>(w)->mData->environment()->climateId()); }; break;
+        case 3: rAccessor = [](ExpressionWrapper *w, size_t) { return static_cast<double>(static_cast<CellWrapper*>(w)->mData->elevation()); }; break;
+        case 4: rAccessor = [](ExpressionWrapper *w, size_t) { return static_cast<double>(static_cast<CellWrapper*>(w)->mData->stateId()); }; break;
+        case 5: rAccessor = [](ExpressionWrapper *w, size_t) { return static_cast<double>(static_cast<CellWrapper*>(w)->mData->residenceTime()); }; break;
+        case 6: rAccessor = [](ExpressionWrapper *w, size_t) { const State *s = static_cast<CellWrapper*>(w)->mData->state();
+                                                               return static_cast<double>(s ? s->function() : 0); }; break;
+        case 7: rAccessor = [](ExpressionWrapper *w, size_t) { const State *s = static_cast<CellWrapper*>(w)->mData->state();
+                                                               return static_cast<double>(s ? s->structure() : 0); }; break;
+        }
+        return true;
+    }
+    if (variableIndex < mMaxStateVar) {
+        // state variable: offset in the values of the state
+        rParam = variableIndex - NFixedVariables;
+        rAccessor = [](ExpressionWrapper *w, size_t i) { return static_cast<CellWrapper*>(w)->mData->state()->value(i); };
+        return true;
+    }
+    if (variableIndex < mMaxEnvVar) {
+        // environment variable: offset in the values of the environment cell
+        rParam = variableIndex - mMaxStateVar;
+        rAccessor = [](ExpressionWrapper *w, size_t i) { return static_cast<CellWrapper*>(w)->mData->environment()->value(i); };
+        return true;
+    }
+    if (variableIndex < mMaxClimVar) {
+        // climate variable: column in the climate table
+        rParam = variableIndex - mMaxEnvVar;
+        rAccessor = [](ExpressionWrapper *w, size_t i) { return Model::instance()->climate()->value(i, static_cast<CellWrapper*>(w)->mData->environment()->climateId()); };
+        return true;
+    }
+    // module variable
+    size_t mod_idx = variableIndex - mMaxClimVar;
+    if (mod_idx >= mModules.size())
+        return false;
+    rParam = mod_idx;
+    rAccessor = [](ExpressionWrapper *w, size_t i) { return Model::instance()->modules()[mModules[i].first]->moduleVariable( static_cast<CellWrapper*>(w)->mData, mModules[i].second ); };
+    return true;
+}
+
+double CellWrapper::stateFrequency(const int neighborClass, const size_t stateId)
+{
+    switch (neighborClass) {
+    case 1: return localStateAverage(stateId);
+    case 2: return intermediateStateAverage(stateId);
+    case 3: return globalStateAverage(stateId);
+    default: return 0.;
+    }
+}
+
 double CellWrapper::localStateAverage(size_t stateId)
 {
-    return mData->stateFrequencyLocal(static_cast<state_t>(stateId));
+    return Model::instance()->neighborhood()->localFrequency(mData->cellIndex(), static_cast<state_t>(stateId));
 }
 
 double CellWrapper::intermediateStateAverage(size_t stateId)
 {
-    return mData->stateFrequencyIntermediate(static_cast<state_t>(stateId));
+    return Model::instance()->neighborhood()->intermediateFrequency(mData->cellIndex(), static_cast<state_t>(stateId));
 }
 
 double CellWrapper::globalStateAverage(size_t stateId)
 {
-    auto shist = Model::instance()->states()->stateHistogram();
-
-    return shist[stateId] / static_cast<double>( Model::instance()->landscape()->NCells() );
+    return Model::instance()->neighborhood()->globalFrequency(static_cast<state_t>(stateId));
 }
@@ -22,6 +22,10 @@
 #include <vector>
 #include <string>
 
+class ExpressionWrapper; // forward
+/// function for the direct access to a variable of a wrapper (see ExpressionWrapper::bindVariable())
+typedef double (*ExpressionVariableAccessor)(ExpressionWrapper *wrapper, size_t param);
+
 class ExpressionWrapper
 {
 public:
@@ -31,6 +35,12 @@ public:
     virtual double value(const size_t variableIndex);
     virtual double valueByName(const std::string &variableName);
     virtual int variableIndex(const std::string &variableName);
+    /// bind the variable 'variableIndex' to a direct accessor: the value is 'rAccessor(wrapper, rParam)' (with 'wrapper' an object
+    /// of the same type). Returns false if the variable can not be bound (value() is used in this case).
+    virtual bool bindVariable(const size_t variableIndex, ExpressionVariableAccessor &rAccessor, size_t &rParam);
+    /// frequency of the state 'stateId' in the neighborhood of the object (neighborClass: 1: local, 2: intermediate, 3: global).
+    /// Used by the functions localNB(), intermediateNB(), globalNB(); the default is 0.
+    virtual double stateFrequency(const int neighborClass, const size_t stateId);
 };
 
 class InferenceData; // forward
@@ -69,6 +79,8 @@ public:
     virtual const std::vector<std::string> &getVariablesList() { return mVariableList; }
     virtual const std::vector<std::pair<std::string, std::string> > &getVariablesMetaData() { return mVariablesMetaData; }
     virtual double value(const size_t variableIndex);
+    virtual bool bindVariable(const size_t variableIndex, ExpressionVariableAccessor &rAccessor, size_t &rParam);
+    virtual double stateFrequency(const int neighborClass, const size_t stateId);
 
     double localStateAverage(size_t stateId);
     double intermediateStateAverage(size_t stateId);
@@ -77,7 +89,7 @@ public:
 private:
     static std::vector<std::string> mVariableList;
     static std::vector<std::pair<std::string, std::string> > mVariablesMetaData;
-    static std::vector<std::pair<const Module*, size_t> > mModules;
+    static std::vector<std::pair<size_t, size_t> > mModules; ///< index of the module (Model::modules()) and of the variable
     static size_t mMaxStateVar;
     static size_t mMaxEnvVar;
     static size_t mMaxClimVar;
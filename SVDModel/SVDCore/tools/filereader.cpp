@@ -87,8 +87,8 @@ void FileReader::loadFile(const std::string &fileName)
         throw std::logic_error("FileReader:: cannot open file: " + fileName);
     // read first line...
     while (!mInStream.eof()) {
-       mInStream.getline(mBuffer, FRBUFSIZE);
-       if (mBuffer[0]!='#' && *mBuffer!='\0')    // skip comment lines
+       std::getline(mInStream, mBuffer);
+       if (!mBuffer.empty() && mBuffer[0]!='#')    // skip comment lines
            break;
     }
     if (mInStream.eof())
@@ -104,12 +104,12 @@ void FileReader::loadFile(const std::string &fileName)
 
 bool FileReader::scanSection()
 {
-    if (mHasSections && mBuffer[0]=='[') {
+    if (mHasSections && !mBuffer.empty() && mBuffer[0]=='[') {
         // section found...
-        mCurrentSection = trimmed( std::string(mBuffer) );
+        mCurrentSection = trimmed( mBuffer );
         mCurrentSection = mCurrentSection.substr(1, mCurrentSection.size()-2); // remove brackets
         // read next line of data
-        mInStream.getline(mBuffer, FRBUFSIZE);
+        std::getline(mInStream, mBuffer);
         return true;
     }
     return false;
@@ -121,8 +121,8 @@ bool FileReader::nextSection()
         return false;
     // skip empty and comment lines
     while (!mInStream.eof()) {
-       mInStream.getline(mBuffer, FRBUFSIZE);
-       if (mBuffer[0]!='#' && mBuffer[0]!='\0')    // skip comment and empty lines lines
+       std::getline(mInStream, mBuffer);
+       if (!mBuffer.empty() && mBuffer[0]!='#')    // skip comment and empty lines lines
            break;
     }
     mCurrentSection = "";
@@ -138,10 +138,10 @@ bool FileReader::nextSection()
 void FileReader::readHeader()
 {
     // determine the used delimiter
-    size_t ctab = count_occ(mBuffer,'\t');
-    size_t csemi = count_occ(mBuffer,';');
-    size_t ccol = count_occ(mBuffer,',');
-    size_t cspc = count_occ(mBuffer,' ');
+    size_t ctab = count_occ(mBuffer.c_str(),'\t');
+    size_t csemi = count_occ(mBuffer.c_str(),';');
+    size_t ccol = count_occ(mBuffer.c_str(),',');
+    size_t cspc = count_occ(mBuffer.c_str(),' ');
     size_t maxc = std::max( std::max(ctab, csemi), std::max(ccol, cspc) );
     if (maxc==0)
         throw std::logic_error("FileReader:: cannot determine delimiter in " + mFileName);
@@ -152,7 +152,7 @@ void FileReader::readHeader()
 
     // read headers
     mFields.clear();
-    tokenize(std::string(mBuffer), mFields, mDelimiter );
+    tokenize(mBuffer, mFields, mDelimiter );
 
     mColCount = mFields.size();
     for (size_t i=0;i<mFields.size(); i++) {
@@ -231,9 +231,9 @@ bool FileReader::next()
 
     size_t line_len=0;
     while (!eof()) {
-        mInStream.getline(mBuffer, FRBUFSIZE);
+        std::getline(mInStream, mBuffer);
         // skip empty lines (unless we are in section mode - then a empty line signals end of section)
-        if (((line_len=strlen(mBuffer)) > 0) || mHasSections)   // skip empty lines
+        if (((line_len=mBuffer.size()) > 0) || mHasSections)   // skip empty lines
            break;
     }
     if (line_len==0)
@@ -243,7 +243,7 @@ bool FileReader::next()
     dsp[0]=mDelimiter;
 
     // parse....
-    char *p = mBuffer;
+    const char *p = mBuffer.c_str();
     while (*p && (*p==mDelimiter || *p==' ') ) p++; // skip delimeters
     for (size_t i=0;i<mColCount;i++) {
         if (*p==mDelimiter)
@@ -255,7 +255,7 @@ bool FileReader::next()
         //while (*p && (*p==mDelimiter || *p==' ')) p++;
         while (*p && *p==' ') p++; // skip also spaces
         if (!p) {
-            throw std::logic_error("FileReader:: not enough values.\nError at line:" + std::string(mBuffer) + "\nin:" + mFileName);
+            throw std::logic_error("FileReader:: not enough values.\nError at line:" + mBuffer + "\nin:" + mFileName);
         }
     }
     return true;
@@ -268,8 +268,8 @@ std::string FileReader::valueString(const size_t columnIndex)
     // we assume, the current line is in "mBuffer"
     // so seek for the n-th delimiter
     int dfound = 0;
-    char *p = mBuffer;
-    char *ps;
+    const char *p = mBuffer.c_str();
+    const char *ps;
     while(*p) {
         if (*p==mDelimiter) {
             dfound++;
@@ -283,7 +283,7 @@ std::string FileReader::valueString(const size_t columnIndex)
             if (!*p){
                 // reached the end of the string
                 if (columnIndex<mColCount-1)
-                    throw std::logic_error("FileReader::valueString not enough values.\nError at line:" + std::string(mBuffer) + "\nin:" + mFileName);
+                    throw std::logic_error("FileReader::valueString not enough values.\nError at line:" + mBuffer + "\nin:" + mFileName);
                 std::string s(ps);
                 if (s.size()>0 && s[s.size()-1] == '\r')
                     s = s.substr( 0, s.size() - 1 ); // drop last character if CR
@@ -294,7 +294,7 @@ std::string FileReader::valueString(const size_t columnIndex)
         }
         ++p;
     }
-    throw std::logic_error("FileReader::valueString not enough values.\nError at line:" + std::string(mBuffer) + "\nin:" + mFileName);
+    throw std::logic_error("FileReader::valueString not enough values.\nError at line:" + mBuffer + "\nin:" + mFileName);
 //    char dsp[2]="\0";
 //    dsp[0]=mDelimiter;
 //    while (dfound<=columnIndex) {
@@ -40,7 +40,6 @@ while (!reader.next()) {
 #include <cassert>
 
 
-#define FRBUFSIZE 10000
 class FileReader
 {
 public:
@@ -71,7 +70,7 @@ public:
    /// retrieve the index of a given column or std::string::npos if the column is not found.
    /// @sa indexOf
    size_t columnIndex(const char *columnName);
-   const char *currentLine() {return mBuffer; }
+   const char *currentLine() {return mBuffer.c_str(); }
    double value(const size_t columnIndex) { assert(columnIndex<mColCount); return mValues[columnIndex]; }
    double value(const std::string &columnName) { return value(indexOf(columnName)); }
    std::string valueString(const size_t columnIndex);
@@ -87,7 +86,7 @@ public:
 private:
    void readHeader(); ///< scan the headers
    bool scanSection();
-   char mBuffer[FRBUFSIZE];
+   std::string mBuffer; ///< the current line (no length limit)
    std::string mFileName;
    std::streampos mDataStart;
    void clear();
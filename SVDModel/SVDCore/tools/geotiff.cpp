@@ -2,6 +2,10 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <thread>
+#include <cstring>
+#include <mutex>
 
 #include "spdlog/spdlog.h"
 
@@ -11,6 +15,8 @@
 #include "third_party/FreeImage/FreeImage.h"
 
 FIBITMAP *GeoTIFF::mProjectionBitmap = nullptr;
+std::vector<GeoTIFF::SProjectionTag> GeoTIFF::mProjectionTags;
+static std::mutex projection_mutex;
 
 GeoTIFF::GeoTIFF()
 {
@@ -33,6 +39,15 @@ void GeoTIFF::clearProjection()
         FreeImage_Unload(mProjectionBitmap);
         mProjectionBitmap = nullptr;
     }
+    std::lock_guard<std::mutex> guard(projection_mutex);
+    mProjectionTags.clear();
+}
+
+void GeoTIFF::setProjectionTags(const std::vector<GeoTIFF::SProjectionTag> &tags)
+{
+    std::lock_guard<std::mutex> guard(projection_mutex);
+    if (mProjectionTags.empty())
+        mProjectionTags = tags;
 }
 
 int GeoTIFF::loadImage(const std::string &fileName)
@@ -215,3 +230,181 @@ void GeoTIFF::setValue(size_t ix, size_t iy, double value)
     float flt_value = static_cast<float>(value);
     ((float*)FreeImage_GetScanLine(dib, iy))[ix] = flt_value;
 }
+
+// TIFF field types
+enum TiffType { TiffASCII=2, TiffSHORT=3, TiffLONG=4, TiffDOUBLE=12 };
+struct TiffEntry {
+    TiffEntry(uint16_t atag, uint16_t atype, uint32_t acount, const void *adata, size_t nbytes):
+        tag(atag), type(atype), count(acount), data(static_cast<const char*>(adata), static_cast<const char*>(adata) + nbytes) {}
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    std::vector<char> data;
+};
+static TiffEntry tiffShort(uint16_t tag, uint16_t value) { return TiffEntry(tag, TiffSHORT, 1, &value, sizeof(value)); }
+static TiffEntry tiffLong(uint16_t tag, uint32_t value) { return TiffEntry(tag, TiffLONG, 1, &value, sizeof(value)); }
+
+static const size_t TiffTileSize = 256;
+
+// copy a single tile (padded with 'null_value' at the edges), and compress it (deflate with horizontal differencing)
+static void buildTiffTile(const short *data, size_t width, size_t height, size_t tx, size_t ty,
+                          short null_value, bool compress, std::vector<unsigned char> &result)
+{
+    std::vector<unsigned short> tile(TiffTileSize * TiffTileSize, static_cast<unsigned short>(null_value));
+    size_t n_cols = std::min(TiffTileSize, width - tx * TiffTileSize);
+    for (size_t r=0; r<TiffTileSize && ty*TiffTileSize + r < height; ++r)
+        memcpy(&tile[r*TiffTileSize], data + (ty*TiffTileSize + r)*width + tx*TiffTileSize, n_cols * sizeof(short));
+
+    const size_t src_bytes = tile.size() * sizeof(short);
+    if (!compress) {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(tile.data());
+        result.assign(p, p + src_bytes);
+        return;
+    }
+    // TIFF predictor 2: store the difference to the left neighbor
+    for (size_t r=0; r<TiffTileSize; ++r) {
+        unsigned short *row = &tile[r*TiffTileSize];
+        for (size_t x=TiffTileSize-1; x>0; --x)
+            row[x] = static_cast<unsigned short>(row[x] - row[x-1]);
+    }
+    result.resize(src_bytes + src_bytes / 1000 + 64);
+    DWORD n = FreeImage_ZLibCompress(result.data(), static_cast<DWORD>(result.size()),
+                                     reinterpret_cast<BYTE*>(tile.data()), static_cast<DWORD>(src_bytes));
+    if (n == 0)
+        throw std::logic_error("GeoTIFF: compression of a tile failed.");
+    result.resize(n);
+}
+
+bool GeoTIFF::saveTiledInt16(const std::string &fileName, const short *data, size_t width, size_t height,
+                             double x_left, double y_top, double cellsize, short null_value,
+                             bool compress, int n_threads)
+{
+    // the file is written as little endian ('II') TIFF; the data is written in the native byte order (x86/x64).
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out.is_open())
+        return false;
+    const char header[8] = { 'I', 'I', 42, 0, 0, 0, 0, 0 }; // the offset of the IFD is written at the end
+    out.write(header, 8);
+
+    const size_t tiles_x = (width + TiffTileSize - 1) / TiffTileSize;
+    const size_t tiles_y = (height + TiffTileSize - 1) / TiffTileSize;
+    const size_t n_tiles = tiles_x * tiles_y;
+    std::vector<uint32_t> tile_offsets(n_tiles);
+    std::vector<uint32_t> tile_sizes(n_tiles);
+
+    if (n_threads <= 0)
+        n_threads = static_cast<int>(std::thread::hardware_concurrency());
+    n_threads = std::max(n_threads, 1);
+
+    // tiles are processed in batches: compressed in parallel, and written in order
+    const size_t batch_size = static_cast<size_t>(n_threads) * 4;
+    std::vector< std::vector<unsigned char> > buffers(batch_size);
+    uint64_t pos = 8;
+    for (size_t batch_start=0; batch_start<n_tiles; batch_start+=batch_size) {
+        size_t n = std::min(batch_size, n_tiles - batch_start);
+        std::vector<std::thread> workers;
+        std::vector<std::string> errors(static_cast<size_t>(n_threads));
+        for (int t=0; t<n_threads; ++t) {
+            workers.emplace_back([&, t]() {
+                try {
+                    for (size_t i=static_cast<size_t>(t); i<n; i+=static_cast<size_t>(n_threads)) {
+                        size_t tile = batch_start + i;
+                        buildTiffTile(data, width, height, tile % tiles_x, tile / tiles_x, null_value, compress, buffers[i]);
+                    }
+                } catch (const std::exception &e) {
+                    errors[static_cast<size_t>(t)] = e.what();
+                }
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        for (auto &e : errors)
+            if (!e.empty())
+                throw std::logic_error(e);
+
+        for (size_t i=0; i<n; ++i) {
+            tile_offsets[batch_start + i] = static_cast<uint32_t>(pos);
+            tile_sizes[batch_start + i] = static_cast<uint32_t>(buffers[i].size());
+            out.write(reinterpret_cast<const char*>(buffers[i].data()), static_cast<std::streamsize>(buffers[i].size()));
+            pos += buffers[i].size();
+        }
+        if (pos > std::numeric_limits<uint32_t>::max())
+            throw logic_error_fmt("GeoTIFF: '{}' is too large for a TIFF file (>4GB).", fileName);
+    }
+
+    // the directory (IFD), tags in ascending order
+    std::vector<TiffEntry> entries;
+    entries.push_back(tiffLong(256, static_cast<uint32_t>(width))); // ImageWidth
+    entries.push_back(tiffLong(257, static_cast<uint32_t>(height))); // ImageLength
+    entries.push_back(tiffShort(258, 16)); // BitsPerSample
+    entries.push_back(tiffShort(259, compress ? 8 : 1)); // Compression: deflate or none
+    entries.push_back(tiffShort(262, 1)); // Photometric: BlackIsZero
+    entries.push_back(tiffShort(277, 1)); // SamplesPerPixel
+    entries.push_back(tiffShort(284, 1)); // PlanarConfiguration
+    if (compress)
+        entries.push_back(tiffShort(317, 2)); // Predictor: horizontal differencing
+    entries.push_back(tiffLong(322, static_cast<uint32_t>(TiffTileSize))); // TileWidth
+    entries.push_back(tiffLong(323, static_cast<uint32_t>(TiffTileSize))); // TileLength
+    entries.push_back(TiffEntry(324, TiffLONG, static_cast<uint32_t>(n_tiles), tile_offsets.data(), n_tiles*sizeof(uint32_t))); // TileOffsets
+    entries.push_back(TiffEntry(325, TiffLONG, static_cast<uint32_t>(n_tiles), tile_sizes.data(), n_tiles*sizeof(uint32_t))); // TileByteCounts
+    entries.push_back(tiffShort(339, 2)); // SampleFormat: signed integer
+    const double pixel_scale[3] = { cellsize, cellsize, 0. };
+    entries.push_back(TiffEntry(33550, TiffDOUBLE, 3, pixel_scale, sizeof(pixel_scale))); // ModelPixelScale
+    const double tie_point[6] = { 0., 0., 0., x_left, y_top, 0. };
+    entries.push_back(TiffEntry(33922, TiffDOUBLE, 6, tie_point, sizeof(tie_point))); // ModelTiepoint
+
+    // the projection (GeoKeyDirectory, GeoDoubleParams, GeoAsciiParams) from the first loaded TIF
+    std::unique_lock<std::mutex> projection_lock(projection_mutex);
+    if (!mProjectionTags.empty()) {
+        for (const auto &t : mProjectionTags)
+            entries.push_back(TiffEntry(t.tag, t.type, t.count, t.data.data(), t.data.size()));
+    } else if (mProjectionBitmap) {
+        FITAG *tag = nullptr;
+        FIMETADATA *md = FreeImage_FindFirstMetadata(FIMD_GEOTIFF, mProjectionBitmap, &tag);
+        if (md) {
+            do {
+                WORD id = FreeImage_GetTagID(tag);
+                if (id == 34735 || id == 34736 || id == 34737)
+                    entries.push_back(TiffEntry(id, static_cast<uint16_t>(FreeImage_GetTagType(tag)), FreeImage_GetTagCount(tag),
+                                                FreeImage_GetTagValue(tag), FreeImage_GetTagLength(tag)));
+            } while (FreeImage_FindNextMetadata(md, &tag));
+            FreeImage_FindCloseMetadata(md);
+        }
+    }
+    projection_lock.unlock();
+    std::string nodata = std::to_string(null_value);
+    entries.push_back(TiffEntry(42113, TiffASCII, static_cast<uint32_t>(nodata.size()+1), nodata.c_str(), nodata.size()+1)); // GDAL_NODATA
+    std::sort(entries.begin(), entries.end(), [](const TiffEntry &a, const TiffEntry &b) { return a.tag < b.tag; });
+
+    if (pos % 2) { out.put(0); ++pos; } // word alignment
+    uint32_t ifd_offset = static_cast<uint32_t>(pos);
+    uint32_t data_offset = ifd_offset + 2 + static_cast<uint32_t>(entries.size()) * 12 + 4;
+    uint16_t n_entries = static_cast<uint16_t>(entries.size());
+    out.write(reinterpret_cast<const char*>(&n_entries), 2);
+    for (auto &e : entries) {
+        out.write(reinterpret_cast<const char*>(&e.tag), 2);
+        out.write(reinterpret_cast<const char*>(&e.type), 2);
+        out.write(reinterpret_cast<const char*>(&e.count), 4);
+        if (e.data.size() <= 4) {
+            char value[4] = {0, 0, 0, 0};
+            std::copy(e.data.begin(), e.data.end(), value);
+            out.write(value, 4);
+        } else {
+            out.write(reinterpret_cast<const char*>(&data_offset), 4);
+            data_offset += static_cast<uint32_t>(e.data.size() + e.data.size() % 2);
+        }
+    }
+    const uint32_t next_ifd = 0;
+    out.write(reinterpret_cast<const char*>(&next_ifd), 4);
+    for (auto &e : entries) {
+        if (e.data.size() > 4) {
+            out.write(e.data.data(), static_cast<std::streamsize>(e.data.size()));
+            if (e.data.size() % 2)
+                out.put(0);
+        }
+    }
+    // now the offset of the IFD is known
+    out.seekp(4);
+    out.write(reinterpret_cast<const char*>(&ifd_offset), 4);
+    return out.good();
+}
@@ -2,6 +2,8 @@
 #define GEOTIFF_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
 
 //#include "grid.h"
 
@@ -16,6 +18,11 @@ public:
     ~GeoTIFF();
 
     static void clearProjection();
+    /// a GeoTIFF projection tag (GeoKeyDirectory, GeoDoubleParams, GeoAsciiParams); values in native byte order
+    struct SProjectionTag { uint16_t tag; uint16_t type; uint32_t count; std::vector<char> data; };
+    /// set the projection used for writing GeoTIFFs (see saveTiledInt16()). Only the first call has an
+    /// effect, i.e. the projection of the first loaded TIF is used.
+    static void setProjectionTags(const std::vector<SProjectionTag> &tags);
 
     int loadImage(const std::string &fileName);
 
@@ -29,6 +36,14 @@ public:
     void initialize(size_t width, size_t height);
     void setValue(size_t ix, size_t iy, double value);
 
+    /// write 16 bit integer data as a tiled (256x256) GeoTIFF, optionally deflate compressed.
+    /// 'data' holds 'width' x 'height' values row by row, starting with the northernmost row.
+    /// 'x_left', 'y_top' are the world coordinates of the upper left corner. The projection is taken
+    /// from the first loaded TIF (if available). Tiles are compressed in parallel by 'n_threads' threads (0: one per core).
+    static bool saveTiledInt16(const std::string &fileName, const short *data, size_t width, size_t height,
+                               double x_left, double y_top, double cellsize, short null_value,
+                               bool compress=true, int n_threads=0);
+
 
     // getters
     double ox() { return mOx; }
@@ -38,6 +53,7 @@ public:
     size_t nrow() { return mNrow; }
 private:
     static FIBITMAP *mProjectionBitmap;
+    static std::vector<SProjectionTag> mProjectionTags;
     FIBITMAP *dib;
 
     double mOx, mOy;
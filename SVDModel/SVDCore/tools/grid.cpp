@@ -20,7 +20,11 @@
 //#include "exception.h"
 //#include "global.h"
 #include <string>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "geotiff.h"
+#include "tablereader.h"
 
 struct SCoordTrans {
     SCoordTrans() { setupTransformation(0.,0.,0.,0.); }
@@ -85,6 +89,166 @@ PointF worldToModel(PointF world_coordinates)
 }
 
 
+static bool GridFileCacheEnabled = false;
+void setGridFileCache(bool enabled)
+{
+    GridFileCacheEnabled = enabled;
+}
+
+bool gridFileCache()
+{
+    return GridFileCacheEnabled;
+}
+
+bool gridFileStamp(const std::string &fileName, int64_t &size, int64_t &modified)
+{
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0)
+        return false;
+    size = static_cast<int64_t>(st.st_size);
+    modified = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+// AsciiGridReader
+// blocks of the data section are not smaller than this (bytes)
+static const size_t AsciiGridMinBlockSize = 1 << 20;
+
+static inline bool isGridSpace(char c) { return c==' ' || c=='\n' || c=='\r' || c=='\t'; }
+
+AsciiGridReader::AsciiGridReader(const std::string &fileName):
+    mDataStart(nullptr), mNCols(0), mNRows(0), mXll(0.), mYll(0.), mCellSize(0.), mNoData(0.)
+{
+    mFile.open(fileName);
+    const char *p = mFile.data();
+    const char *end = mFile.end();
+    // parse the header: lines that start with a key (e.g. 'ncols 100')
+    while (true) {
+        if (p >= end)
+            throw std::logic_error(std::string("Error in loading grid from file: unexpected end of file: ") + fileName);
+        if (!isalpha(static_cast<unsigned char>(*p)))
+            break; // we reached the data lines
+        const char *key_end = p;
+        while (key_end < end && !isGridSpace(*key_end)) ++key_end;
+        std::string key = lowercase(std::string(p, key_end));
+        const char *line_end = static_cast<const char*>(memchr(key_end, '\n', static_cast<size_t>(end - key_end)));
+        if (!line_end)
+            line_end = end;
+        double value = TableReader::parseNumber(key_end, line_end);
+        if (key=="ncols")
+            mNCols=int(value);
+        else if (key=="nrows")
+            mNRows=int(value);
+        else if (key=="xllcorner")
+            mXll = value;
+        else if (key=="yllcorner")
+            mYll = value;
+        else if (key=="cellsize")
+            mCellSize = value;
+        else if (key=="nodata_value")
+            mNoData = value;
+        else
+            throw std::logic_error(std::string("Grid: invalid key ") + key);
+        p = line_end < end ? line_end + 1 : end;
+    }
+    mDataStart = p;
+}
+
+void AsciiGridReader::readValues(const std::function<void (size_t, const double *, size_t)> &fn, int n_threads)
+{
+    if (n_threads <= 0)
+        n_threads = static_cast<int>(std::thread::hardware_concurrency());
+    n_threads = std::max(n_threads, 1);
+
+    // split the data section into blocks; blocks start at the beginning of a value
+    struct SBlock { const char *begin; const char *end; size_t n_values; size_t first_index; };
+    std::vector<SBlock> blocks;
+    const char *end = mFile.end();
+    size_t bytes = static_cast<size_t>(end - mDataStart);
+    size_t n_blocks = std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(n_threads) * 8, bytes / AsciiGridMinBlockSize));
+    const char *p = mDataStart;
+    for (size_t i=1; i<=n_blocks && p<end; ++i) {
+        const char *block_end = end;
+        if (i < n_blocks) {
+            block_end = std::max(p, mDataStart + bytes / n_blocks * i);
+            while (block_end < end && !isGridSpace(*block_end)) ++block_end;
+        }
+        blocks.push_back( SBlock { p, block_end, 0, 0 } );
+        p = block_end;
+    }
+
+    auto run_parallel = [&](const std::function<void(SBlock&)> &block_fn) {
+        size_t n_workers = std::min(static_cast<size_t>(n_threads), blocks.size());
+        std::atomic<size_t> next_block(0);
+        std::vector<std::thread> workers;
+        std::vector<std::string> errors(n_workers);
+        for (size_t t=0; t<n_workers; ++t) {
+            workers.emplace_back([&, t]() {
+                try {
+                    size_t i;
+                    while ((i = next_block++) < blocks.size())
+                        block_fn(blocks[i]);
+                } catch (const std::exception &e) {
+                    errors[t] = e.what();
+                    next_block = blocks.size();
+                }
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        for (auto &e : errors)
+            if (!e.empty())
+                throw std::logic_error(e);
+    };
+
+    // first pass: count the values of each block
+    run_parallel([](SBlock &b) {
+        size_t n = 0;
+        for (const char *c = b.begin; c < b.end; ) {
+            while (c < b.end && isGridSpace(*c)) ++c;
+            if (c == b.end)
+                break;
+            ++n;
+            while (c < b.end && !isGridSpace(*c)) ++c;
+        }
+        b.n_values = n;
+    });
+    size_t total = 0;
+    for (auto &b : blocks) {
+        b.first_index = total;
+        total += b.n_values;
+    }
+    size_t n_cells = static_cast<size_t>(mNCols) * static_cast<size_t>(mNRows);
+    if (total < n_cells)
+        throw std::logic_error("Grid: Unexpected End of File! In file: " + mFile.fileName() );
+
+    // second pass: parse the values
+    run_parallel([&](SBlock &b) {
+        if (b.first_index >= n_cells)
+            return; // additional values are ignored
+        size_t n = std::min(b.n_values, n_cells - b.first_index);
+        std::vector<double> values(n);
+        const char *c = b.begin;
+        char buf[64];
+        for (size_t i=0; i<n; ++i) {
+            while (isGridSpace(*c)) ++c;
+            const char *token = c;
+            while (c < b.end && !isGridSpace(*c)) ++c;
+            const char *comma = static_cast<const char*>(memchr(token, ',', static_cast<size_t>(c - token)));
+            if (comma && static_cast<size_t>(c - token) < sizeof(buf)) {
+                // use '.' as decimal separator
+                size_t len = static_cast<size_t>(c - token);
+                memcpy(buf, token, len);
+                std::replace(buf, buf + len, ',', '.');
+                values[i] = TableReader::parseNumber(buf, buf + len);
+            } else {
+                values[i] = TableReader::parseNumber(token, c);
+            }
+        }
+        fn(b.first_index, values.data(), n);
+    });
+}
+
 std::string gridToString(const DoubleGrid &grid, const char sep, const int newline_after)
 {
 
@@ -27,12 +27,21 @@
 #include <functional>
 
 #include <stdexcept>
+#include <cmath>
 #include <limits>
 #include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "strtools.h"
 #include "randomgen.h"
 #include "geotiff.h"
+#include "mappedfile.h"
+#include "tiffreader.h"
 
 class Point {
 public:
@@ -120,8 +129,14 @@ public:
     Grid(const RectF rect_metric, const double cellsize) { mData=nullptr; setup(rect_metric,cellsize); }
     /// load a grid from an ASCII grid file
     /// the coordinates and cell size remain as in the grid file.
+    /// if the binary cache is enabled (see setGridFileCache()), the grid is loaded from / saved to a
+    /// sidecar file ('<fileName>.<type>.svdcache', e.g. 'dem.asc.f4.svdcache') which is used as long as the source file is not modified.
     bool loadGridFromFile(const std::string &fileName);
+    /// load a grid from a GeoTIFF; the extent and cell size of the grid are taken from the file.
     bool loadGridFromGeoTIFF(const std::string &fileName);
+    /// fill the (already set up) grid with values of a GeoTIFF: each cell gets the value of the pixel at the
+    /// center point of the cell (or null if outside). Only the tiles within the extent of the grid are read.
+    bool loadWindowFromGeoTIFF(const std::string &fileName);
 
     // copy ctor
     Grid(const Grid<T>& toCopy);
@@ -255,6 +270,12 @@ public:
     int countNotNull();
 
 private:
+    /// load the grid from the binary cache 'cacheFile' (if valid for 'fileName')
+    bool loadGridFromCache(const std::string &cacheFile, const std::string &fileName);
+    /// save the grid content to the binary cache 'cacheFile'
+    bool saveGridToCache(const std::string &cacheFile, const std::string &fileName) const;
+    /// copy the values of 'tif' to the grid (see loadWindowFromGeoTIFF())
+    void readGeoTIFF(const TiffReader &tif);
 
     T* mData;
     T* mEnd; ///< pointer to 1 element behind the last
@@ -793,8 +814,9 @@ bool gridToGeoTIFF(const Grid<T> &grid, const std::string &fileName, std::functi
 
 void modelToWorld(const Vector3D &From, Vector3D &To);
 
+/// the header of an ESRI ASCII raster for 'grid'
 template <class T>
-std::string gridToESRIRaster(const Grid<T> &grid, std::function<std::string(const T&)>  valueFunction )
+std::string gridToESRIHeader(const Grid<T> &grid)
 {
     Vector3D model(grid.metricRect().left(), grid.metricRect().top(), 0.);
     Vector3D world;
@@ -806,6 +828,14 @@ std::string gridToESRIRaster(const Grid<T> &grid, std::function<std::string(cons
         << "yllcorner " << world.y() << std::endl
         << "cellsize " << grid.cellsize() << std::endl
         << "NODATA_value -9999" << std::endl;
+    return oss.str();
+}
+
+template <class T>
+std::string gridToESRIRaster(const Grid<T> &grid, std::function<std::string(const T&)>  valueFunction )
+{
+    std::ostringstream oss;
+    oss << gridToESRIHeader(grid);
     oss << gridToString(grid, valueFunction, ' ');
     return oss.str();
     /*
@@ -817,6 +847,142 @@ std::string gridToESRIRaster(const Grid<T> &grid, std::function<std::string(cons
         QString line =  gridToString(grid, valueFunction, QChar(' ')); // for special grids */
 }
 
+/// Save 16 bit integer 'data' (values of 'grid' row by row, starting with the northern row) as tiled
+/// and compressed GeoTIFF with the extent of 'grid' (see GeoTIFF::saveTiledInt16()).
+template <class T>
+bool saveGridDataToGeoTIFFInt16(const Grid<T> &grid, const std::string &fileName, const short *data, short null_value)
+{
+    Vector3D model(grid.metricRect().left(), grid.metricRect().top(), 0.);
+    Vector3D world;
+    modelToWorld(model, world);
+    return GeoTIFF::saveTiledInt16(fileName, data, static_cast<size_t>(grid.sizeX()), static_cast<size_t>(grid.sizeY()),
+                                   world.x(), world.y() + grid.metricSizeY(), grid.cellsize(), null_value);
+}
+
+/// Save a grid as tiled and compressed GeoTIFF with 16 bit integer pixels.
+/// @param valueFunction a function with the signature short func(const T&); return 'null_value' for NA values.
+template <class T, class F>
+bool gridToGeoTIFFInt16(const Grid<T> &grid, const std::string &fileName, F valueFunction, short null_value=std::numeric_limits<short>::min())
+{
+    std::vector<short> data(static_cast<size_t>(grid.count()));
+    for (int y=0; y<grid.sizeY(); ++y) {
+        const T *src = &grid.constValueAtIndex(0, y);
+        short *dst = &data[static_cast<size_t>(grid.sizeY()-1-y) * static_cast<size_t>(grid.sizeX())];
+        for (int x=0; x<grid.sizeX(); ++x)
+            dst[x] = static_cast<short>(valueFunction(src[x]));
+    }
+    return saveGridDataToGeoTIFFInt16(grid, fileName, data.data(), null_value);
+}
+
+/// Save a grid of 16 bit integers as tiled and compressed GeoTIFF (rows are copied in bulk).
+/// The null value of the grid is used as NA value.
+inline bool gridToGeoTIFFInt16(const Grid<short> &grid, const std::string &fileName)
+{
+    std::vector<short> data(static_cast<size_t>(grid.count()));
+    for (int y=0; y<grid.sizeY(); ++y)
+        memcpy(&data[static_cast<size_t>(grid.sizeY()-1-y) * static_cast<size_t>(grid.sizeX())],
+               &grid.constValueAtIndex(0, y), static_cast<size_t>(grid.sizeX()) * sizeof(short));
+    return saveGridDataToGeoTIFFInt16(grid, fileName, data.data(), Grid<short>::nullValue());
+}
+
+/// Write a grid with integer values as ESRI ASCII raster to the file 'fileName'.
+/// The grid is not converted to a string: blocks of rows are formatted in parallel by 'n_threads'
+/// threads (0: one per core) and written to the file in order, i.e. the memory used is only a few rows per thread.
+/// @param valueFunction a function with the signature int func(const T&); return -9999 for NA values.
+/// The function is called concurrently from multiple threads.
+/// @return false if the file could not be written
+template <class T, class F>
+bool gridToESRIRasterFile(const Grid<T> &grid, const std::string &fileName, F valueFunction, int n_threads=0)
+{
+    std::ofstream out(fileName);
+    if (!out.is_open())
+        return false;
+    out << gridToESRIHeader(grid);
+
+    const int nx = grid.sizeX();
+    const int ny = grid.sizeY();
+    if (nx==0 || ny==0)
+        return out.good();
+    // a block has roughly 64k values (but at least one row)
+    const int rows_per_block = std::max(1, 65536 / nx);
+    const int n_blocks = (ny + rows_per_block - 1) / rows_per_block;
+    if (n_threads <= 0)
+        n_threads = static_cast<int>(std::thread::hardware_concurrency());
+    n_threads = std::max(1, std::min(n_threads, n_blocks));
+
+    // format block 'b' into 'buf'; rows are written from north (y=ny-1) to south (y=0)
+    auto format_block = [&grid, &valueFunction, nx, ny, rows_per_block](int b, std::string &buf) {
+        int y_start = ny - 1 - b*rows_per_block;
+        int y_end = std::max(y_start - rows_per_block, -1);
+        buf.resize(static_cast<size_t>(y_start - y_end) * (static_cast<size_t>(nx) * 12 + 2)); // max. 11 chars + separator per value
+        char *p = &buf[0];
+        for (int y=y_start; y>y_end; --y) {
+            const T *v = &grid.constValueAtIndex(0, y);
+            for (int x=0; x<nx; ++x, ++v) {
+                p = int_to_chars(p, static_cast<int>(valueFunction(*v)));
+                *p++ = ' ';
+            }
+            *p++ = '\r'; *p++ = '\n';
+        }
+        buf.resize(static_cast<size_t>(p - &buf[0]));
+    };
+
+    if (n_threads == 1) {
+        std::string buf;
+        for (int b=0; b<n_blocks && out.good(); ++b) {
+            format_block(b, buf);
+            out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        }
+        return out.good();
+    }
+
+    // worker 't' formats the blocks t, t+n_threads, ... and stores them in a ring of slots;
+    // the calling thread writes the slots in order.
+    const int n_slots = 2 * n_threads;
+    std::vector<std::string> slots(static_cast<size_t>(n_slots));
+    std::vector<int> slot_block(static_cast<size_t>(n_slots), -1);
+    std::mutex mtx;
+    std::condition_variable cv;
+    int n_written = 0;
+    bool failed = false;
+
+    std::vector<std::thread> workers;
+    for (int t=0; t<n_threads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::string buf;
+            for (int b=t; b<n_blocks; b+=n_threads) {
+                format_block(b, buf);
+                size_t slot = static_cast<size_t>(b % n_slots);
+                std::unique_lock<std::mutex> lock(mtx);
+                // the slot is free after the block previously stored there is written
+                cv.wait(lock, [&]() { return failed || n_written > b - n_slots; });
+                if (failed)
+                    return;
+                slots[slot].swap(buf);
+                slot_block[slot] = b;
+                cv.notify_all();
+            }
+        });
+    }
+
+    for (int b=0; b<n_blocks; ++b) {
+        size_t slot = static_cast<size_t>(b % n_slots);
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&]() { return slot_block[slot] == b; });
+        lock.unlock();
+        out.write(slots[slot].data(), static_cast<std::streamsize>(slots[slot].size()));
+        lock.lock();
+        n_written = b + 1;
+        failed = !out.good();
+        cv.notify_all();
+        if (failed)
+            break;
+    }
+    for (auto &w : workers)
+        w.join();
+    return !failed && out.good();
+}
+
 template <class T>
 std::string gridToESRIRaster(const Grid<T> &grid )
 {
@@ -836,6 +1002,37 @@ std::string gridToESRIRaster(const Grid<T> &grid )
 }
 
 
+/// enable/disable the binary cache of ASCII grids (see Grid::loadGridFromFile())
+void setGridFileCache(bool enabled);
+bool gridFileCache();
+/// retrieve size and modification time of 'fileName' (returns false if the file is not accessible)
+bool gridFileStamp(const std::string &fileName, int64_t &size, int64_t &modified);
+
+/** AsciiGridReader parses ESRI ASCII grids.
+ *  The file is memory mapped, and the data section is split into blocks that are parsed in parallel
+ *  with a locale independent number parser (both '.' and ',' are accepted as decimal separator). */
+class AsciiGridReader
+{
+public:
+    /// open 'fileName' and parse the header
+    AsciiGridReader(const std::string &fileName);
+    int nCols() const { return mNCols; }
+    int nRows() const { return mNRows; }
+    double xllCorner() const { return mXll; }
+    double yllCorner() const { return mYll; }
+    double cellSize() const { return mCellSize; }
+    double noDataValue() const { return mNoData; }
+    /// parse the data section and call 'fn(first_index, values, n_values)' for each block of values;
+    /// 'first_index' is the position of the first value in the file (row by row, starting with the northern row).
+    /// 'fn' is called concurrently for different blocks. Throws an exception if the file has less than nCols*nRows values.
+    void readValues(const std::function<void(size_t first_index, const double *values, size_t n_values)> &fn, int n_threads=0);
+private:
+    MappedFile mFile;
+    const char *mDataStart;
+    int mNCols, mNRows;
+    double mXll, mYll, mCellSize, mNoData;
+};
+
 template <typename T>
 bool Grid<T>::loadGridFromFile(const std::string &fileName)
 {
@@ -843,140 +1040,205 @@ bool Grid<T>::loadGridFromFile(const std::string &fileName)
         return loadGridFromGeoTIFF(fileName);
     }
 
-    std::vector<std::string> lines = readFile(fileName);
-    std::vector<std::string>::iterator l = lines.begin();
-
-    bool in_header=true;
-    std::string key;
-    std::string strValue;
-    T value;
-    double cell_size=0.;
-    int n_rows=0, n_cols=0;
-    double ox=0., oy=0.;
-    double no_data_val=0.;
-
-    do {
-        if (l == lines.end())
-            throw std::logic_error(std::string("Error in loading grid from file: unexpected end of file: ") + fileName);
-
-        size_t str_pos = (*l).find(" ");
-        key = lowercase((*l).substr(0, str_pos));
-
-        if (!isalpha(key[0])) {
-            in_header=false; // we reachted datalines
-        } else {
-            strValue = (*l).substr(str_pos+1);
-            value = static_cast<T>(atof(strValue.c_str()));
-            if (key=="ncols")
-                n_cols=int(value);
-            else if (key=="nrows")
-                n_rows=int(value);
-            else if (key=="xllcorner")
-                ox = value;
-            else if (key=="yllcorner")
-                oy = value;
-            else if (key=="cellsize")
-                cell_size = value;
-            else if (key=="nodata_value")
-                no_data_val=value;
-            else
-                throw std::logic_error(std::string("Grid: invalid key ") + key);
-            ++l;
-        }
-    } while (in_header);
+    std::string cache_file = fileName + (std::numeric_limits<T>::is_integer ? ".i" : ".f") + std::to_string(sizeof(T)) + ".svdcache";
+    if (gridFileCache() && loadGridFromCache(cache_file, fileName))
+        return true;
 
-    // create the underlying grid
+    AsciiGridReader rdr(fileName);
+    // note: header values are converted to T (as values of the grid)
+    int n_cols = int( static_cast<T>(rdr.nCols()) );
+    int n_rows = int( static_cast<T>(rdr.nRows()) );
+    double ox = static_cast<T>(rdr.xllCorner());
+    double oy = static_cast<T>(rdr.yllCorner());
+    double cell_size = static_cast<T>(rdr.cellSize());
+    double no_data_val = static_cast<T>(rdr.noDataValue());
 
+    // create the underlying grid
     RectF rect(ox, oy, ox + n_cols*cell_size, oy + n_rows*cell_size );
     setup(rect, cell_size);
-    //setup(cell_size, n_cols, n_rows);
-
-
-    // loop thru datalines
-    int i,j;
-    const char *p=nullptr;
-    const char *p2;
-
-    --l;
-    for (i=1;i<=n_rows;++i)
-        for (j=0;j<n_cols;j++) {
-            // copy next value to buffer, change "," to "."
-            if (!p || *p==0) {
-                ++l;
-                if (l==lines.end())
-                    throw std::logic_error("Grid: Unexpected End of File! In file: " + fileName );
-                p=(*l).c_str();
-                // replace chars
-                p2=p;
-                while (*p2) {
-                    if (*p2==',')
-                        *const_cast<char*>(p2)='.';
-                    p2++;
-                }
-            }
-            // skip spaces
-            while (*p && strchr(" \r\n\t", *p))
-                p++;
-            if (*p) {
-                value = static_cast<T>(atof(p));
-                if (value==no_data_val) {
-                    value = nullValue();
-                }
-                valueAtIndex(j, n_rows - i) = value;
-                // skip text...
-                while (*p && !strchr(" \r\n\t", *p))
-                    p++;
-            } else
-                j--;
+
+    // values are written directly to the grid (the first value in the file is the north-western cell)
+    const T null_value = nullValue();
+    rdr.readValues([&](size_t first_index, const double *values, size_t n_values) {
+        for (size_t i=0; i<n_values; ++i) {
+            size_t idx = first_index + i;
+            int row = static_cast<int>(idx / static_cast<size_t>(n_cols));
+            int col = static_cast<int>(idx % static_cast<size_t>(n_cols));
+            T value = static_cast<T>(values[i]);
+            if (value==no_data_val)
+                value = null_value;
+            valueAtIndex(col, n_rows - 1 - row) = value;
         }
+    });
 
+    if (gridFileCache())
+        saveGridToCache(cache_file, fileName);
 
     return true;
 }
 
-//template<typename T>
-//bool Grid<T>::loadGridFromGeoTIFF(const std::string &fileName);
-//template<> bool Grid<double>::loadGridFromGeoTIFF(const std::string &fileName);
-//template<> bool Grid<int>::loadGridFromGeoTIFF(const std::string &fileName);
+/// layout of the binary grid cache
+struct SGridCacheHeader {
+    char magic[8];
+    uint32_t value_size; ///< sizeof(T)
+    uint32_t value_type; ///< 0: integer, 1: floating point
+    int64_t source_size; ///< size of the source file
+    int64_t source_modified; ///< modification time of the source file
+    int32_t size_x, size_y;
+    double left, top, right, bottom, cellsize;
+};
 
-template<typename T>
-bool Grid<T>::loadGridFromGeoTIFF(const std::string &fileName) {
-    return false; // not impl
+template <typename T>
+bool Grid<T>::loadGridFromCache(const std::string &cacheFile, const std::string &fileName)
+{
+    SGridCacheHeader header, expected;
+    if (!gridFileStamp(fileName, expected.source_size, expected.source_modified))
+        return false;
+    std::ifstream in(cacheFile, std::ios::binary);
+    if (!in.is_open())
+        return false;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in.good() || memcmp(header.magic, "SVDGRID1", 8)!=0 ||
+            header.value_size != sizeof(T) || header.value_type != (std::numeric_limits<T>::is_integer ? 0u : 1u) ||
+            header.source_size != expected.source_size || header.source_modified != expected.source_modified ||
+            header.size_x <= 0 || header.size_y <= 0)
+        return false; // cache is outdated or not valid
+
+    RectF rect(header.left, header.top, header.right, header.bottom);
+    setup(rect, header.cellsize);
+    if (sizeX()!=header.size_x || sizeY()!=header.size_y)
+        return false;
+    in.read(reinterpret_cast<char*>(mData), static_cast<std::streamsize>(sizeof(T)) * count());
+    return in.good();
 }
 
-template<> inline bool Grid<double>::loadGridFromGeoTIFF(const std::string &fileName)
+template <typename T>
+bool Grid<T>::saveGridToCache(const std::string &cacheFile, const std::string &fileName) const
 {
-    GeoTIFF tif;
-    tif.loadImage(fileName);
-    // fill grid with the contents of the file, but first set up the grid
-    RectF rect(tif.ox(), tif.oy(), tif.ox() + tif.ncol()*tif.cellsize(), tif.oy() + tif.nrow()*tif.cellsize());
-    setup(rect, tif.cellsize());
-    tif.copyToDoubleGrid(this);
-    return true;
-    //tif.saveToGrid(this)
+    SGridCacheHeader header;
+    memcpy(header.magic, "SVDGRID1", 8);
+    header.value_size = sizeof(T);
+    header.value_type = std::numeric_limits<T>::is_integer ? 0u : 1u;
+    if (!gridFileStamp(fileName, header.source_size, header.source_modified))
+        return false;
+    header.size_x = sizeX();
+    header.size_y = sizeY();
+    header.left = metricRect().left(); header.top = metricRect().top();
+    header.right = metricRect().right(); header.bottom = metricRect().bottom();
+    header.cellsize = cellsize();
+
+    std::ofstream out(cacheFile, std::ios::binary);
+    if (!out.is_open())
+        return false; // e.g. a read-only folder: the cache is not used
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(mData), static_cast<std::streamsize>(sizeof(T)) * count());
+    return out.good();
 }
-template<> inline bool Grid<float>::loadGridFromGeoTIFF(const std::string &fileName)
+
+template<typename T>
+bool Grid<T>::loadGridFromGeoTIFF(const std::string &fileName)
 {
-    GeoTIFF tif;
-    tif.loadImage(fileName);
+    TiffReader tif(fileName);
+    if (!tif.hasGeoReference())
+        throw logic_error_fmt("GeoTIF '{}' does not contain required tags (pixel scale, tie points).", fileName);
     // fill grid with the contents of the file, but first set up the grid
-    RectF rect(tif.ox(), tif.oy(), tif.ox() + tif.ncol()*tif.cellsize(), tif.oy() + tif.nrow()*tif.cellsize());
+    RectF rect(tif.xLeft(), tif.yTop() - tif.height()*tif.cellsize(), tif.xLeft() + tif.width()*tif.cellsize(), tif.yTop());
     setup(rect, tif.cellsize());
-    tif.copyToFloatGrid(this);
+    readGeoTIFF(tif);
     return true;
-    //tif.saveToGrid(this)
 }
 
-template<> inline bool Grid<int>::loadGridFromGeoTIFF(const std::string &fileName)
+template<typename T>
+bool Grid<T>::loadWindowFromGeoTIFF(const std::string &fileName)
 {
-    GeoTIFF tif;
-    tif.loadImage(fileName);
-    // fill grid with the contents of the file, but first set up the grid
-    RectF rect(tif.ox(), tif.oy(), tif.ox() + tif.ncol()*tif.cellsize(), tif.oy() + tif.nrow()*tif.cellsize());
-    setup(rect, tif.cellsize());
-    tif.copyToIntGrid(this);
+    if (isEmpty())
+        throw logic_error_fmt("Grid: loading a window from GeoTIF '{}' requires a grid that is already set up.", fileName);
+    TiffReader tif(fileName);
+    if (!tif.hasGeoReference())
+        throw logic_error_fmt("GeoTIF '{}' does not contain required tags (pixel scale, tie points).", fileName);
+    readGeoTIFF(tif);
     return true;
-    //tif.saveToGrid(this)
+}
+
+/// copy the values of a decoded TIFF block with samples of type S to 'grid';
+/// 'col_px' and 'row_py' are the pixel column/row for each column/row of the grid (-1 if outside).
+template<typename T, typename S>
+void copyTiffBlockToGrid(Grid<T> &grid, const TiffReader &tif, const TiffReader::SBlock &block,
+                         const std::vector<int> &col_px, const std::vector<int> &row_py, int col_first, int col_last)
+{
+    const S *data = reinterpret_cast<const S*>(block.data);
+    const T null_value = grid.nullValue();
+    // the no data value is only used if it can be represented by S (checked before the conversion,
+    // as casting an out-of-range value is undefined)
+    const double nodata_value = tif.noDataValue();
+    const bool has_nodata = tif.hasNoData() && std::isfinite(nodata_value)
+            && nodata_value >= static_cast<double>(std::numeric_limits<S>::lowest())
+            && nodata_value <= static_cast<double>(std::numeric_limits<S>::max())
+            && static_cast<double>(static_cast<S>(nodata_value)) == nodata_value;
+    const S nodata = has_nodata ? static_cast<S>(nodata_value) : S();
+    // the grid columns within the block (the pixel columns are ascending)
+    auto c_begin = std::lower_bound(col_px.begin() + col_first, col_px.begin() + col_last + 1, static_cast<int>(block.x));
+    auto c_end = std::lower_bound(c_begin, col_px.begin() + col_last + 1, static_cast<int>(block.x + block.width));
+    int x_begin = static_cast<int>(c_begin - col_px.begin());
+    int x_end = static_cast<int>(c_end - col_px.begin());
+    for (int y=0; y<grid.sizeY(); ++y) {
+        int py = row_py[static_cast<size_t>(y)];
+        if (py < static_cast<int>(block.y) || py >= static_cast<int>(block.y + block.height))
+            continue;
+        const S *row = data + static_cast<size_t>(py - static_cast<int>(block.y)) * block.width;
+        for (int x=x_begin; x<x_end; ++x) {
+            S value = row[static_cast<size_t>(col_px[static_cast<size_t>(x)]) - block.x];
+            if ((has_nodata && value == nodata) || value != value) // nodata or NaN
+                grid.valueAtIndex(x, y) = null_value;
+            else
+                grid.valueAtIndex(x, y) = static_cast<T>(value);
+        }
+    }
+}
+
+template<typename T>
+void Grid<T>::readGeoTIFF(const TiffReader &tif)
+{
+    // the pixel (column/row) of the TIF for each column/row of the grid (-1: outside of the TIF)
+    std::vector<int> col_px(static_cast<size_t>(sizeX())), row_py(static_cast<size_t>(sizeY()));
+    int col_first=-1, col_last=-1, row_min=-1, row_max=-1;
+    for (int x=0; x<sizeX(); ++x) {
+        double px = floor((metricRect().left() + (x + 0.5) * cellsize() - tif.xLeft()) / tif.cellsize());
+        col_px[static_cast<size_t>(x)] = px >= 0. && px < tif.width() ? static_cast<int>(px) : -1;
+        if (col_px[static_cast<size_t>(x)] >= 0) {
+            if (col_first < 0) col_first = x;
+            col_last = x;
+        }
+    }
+    for (int y=0; y<sizeY(); ++y) {
+        double py = floor((tif.yTop() - (metricRect().top() + (y + 0.5) * cellsize())) / tif.cellsize());
+        row_py[static_cast<size_t>(y)] = py >= 0. && py < tif.height() ? static_cast<int>(py) : -1;
+        if (row_py[static_cast<size_t>(y)] >= 0) {
+            row_min = row_min < 0 ? row_py[static_cast<size_t>(y)] : std::min(row_min, row_py[static_cast<size_t>(y)]);
+            row_max = std::max(row_max, row_py[static_cast<size_t>(y)]);
+        }
+    }
+
+    initialize(nullValue());
+    if (col_first < 0 || row_min < 0)
+        return; // no overlap
+    size_t x0 = static_cast<size_t>(col_px[static_cast<size_t>(col_first)]);
+    size_t x1 = static_cast<size_t>(col_px[static_cast<size_t>(col_last)]);
+    size_t y0 = static_cast<size_t>(row_min), y1 = static_cast<size_t>(row_max);
+
+    tif.readBlocks(x0, y0, x1 - x0 + 1, y1 - y0 + 1, [&](const TiffReader::SBlock &block) {
+        switch (tif.sampleType()) {
+        case TiffReader::UInt8: copyTiffBlockToGrid<T, uint8_t>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::Int8: copyTiffBlockToGrid<T, int8_t>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::UInt16: copyTiffBlockToGrid<T, uint16_t>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::Int16: copyTiffBlockToGrid<T, int16_t>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::UInt32: copyTiffBlockToGrid<T, uint32_t>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::Int32: copyTiffBlockToGrid<T, int32_t>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::Float32: copyTiffBlockToGrid<T, float>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        case TiffReader::Float64: copyTiffBlockToGrid<T, double>(*this, tif, block, col_px, row_py, col_first, col_last); break;
+        default: throw std::logic_error("Grid: invalid sample type of TIF.");
+        }
+    });
 }
 
 
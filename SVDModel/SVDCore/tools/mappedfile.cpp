@@ -0,0 +1,122 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "mappedfile.h"
+
+#include <stdexcept>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(): mData(nullptr), mSize(0), mMapped(false)
+{
+#ifdef _WIN32
+    mFileHandle = nullptr;
+    mMappingHandle = nullptr;
+#else
+    mFileDescriptor = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::open(const std::string &fileName)
+{
+    close();
+    mFileName = fileName;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::logic_error("MappedFile: cannot open file: " + fileName);
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    mFileHandle = file;
+    mSize = static_cast<size_t>(file_size.QuadPart);
+    if (mSize > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            mMappingHandle = mapping;
+            mData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            mMapped = mData != nullptr;
+        }
+    }
+#else
+    mFileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if (mFileDescriptor < 0)
+        throw std::logic_error("MappedFile: cannot open file: " + fileName);
+    struct stat st;
+    if (fstat(mFileDescriptor, &st) != 0)
+        throw std::logic_error("MappedFile: cannot access file: " + fileName);
+    mSize = static_cast<size_t>(st.st_size);
+    if (mSize > 0) {
+        void *p = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, mSize, MADV_SEQUENTIAL);
+            mData = static_cast<const char*>(p);
+            mMapped = true;
+        }
+    }
+#endif
+    if (!mMapped) {
+        // fallback: read the full file
+        std::ifstream in(fileName, std::ios::binary);
+        if (!in.is_open())
+            throw std::logic_error("MappedFile: cannot open file: " + fileName);
+        in.seekg(0, std::ios::end);
+        mSize = static_cast<size_t>(in.tellg());
+        in.seekg(0, std::ios::beg);
+        mBuffer.resize(mSize + 1);
+        in.read(mBuffer.data(), static_cast<std::streamsize>(mSize));
+        mBuffer[mSize] = '\0';
+        mData = mBuffer.data();
+    }
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (mMapped && mData)
+        UnmapViewOfFile(mData);
+    if (mMappingHandle)
+        CloseHandle(mMappingHandle);
+    if (mFileHandle)
+        CloseHandle(mFileHandle);
+    mMappingHandle = nullptr;
+    mFileHandle = nullptr;
+#else
+    if (mMapped && mData)
+        munmap(const_cast<char*>(mData), mSize);
+    if (mFileDescriptor >= 0)
+        ::close(mFileDescriptor);
+    mFileDescriptor = -1;
+#endif
+    mBuffer.clear();
+    mData = nullptr;
+    mSize = 0;
+    mMapped = false;
+}
@@ -0,0 +1,65 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief The MappedFile class provides read-only access to the content of a file.
+ * The file is mapped into memory (mmap() / MapViewOfFile()); if this is not possible, the content is read into a buffer.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    MappedFile(const std::string &fileName) : MappedFile() { open(fileName); }
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /// open (and map) the file 'fileName'. Throws an exception if the file cannot be read.
+    void open(const std::string &fileName);
+    void close();
+
+    const std::string &fileName() const { return mFileName; }
+    /// pointer to the first byte of the file content
+    const char *data() const { return mData; }
+    /// size of the file (bytes)
+    size_t size() const { return mSize; }
+    const char *end() const { return mData + mSize; }
+    bool isMapped() const { return mMapped; }
+
+private:
+    std::string mFileName;
+    const char *mData;
+    size_t mSize;
+    bool mMapped; ///< true if mapped, false if the content is in mBuffer
+    std::vector<char> mBuffer;
+#ifdef _WIN32
+    void *mFileHandle;
+    void *mMappingHandle;
+#else
+    int mFileDescriptor;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -17,15 +17,27 @@
 **    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ********************************************************************************************/
 #include "randomgen.h"
+#include "model.h"
 
 #include <random>
 #include <chrono>
+#include <sstream>
+#include <stdexcept>
 
-std::uniform_real_distribution<double> RandomGenerator::dbl_dist = std::uniform_real_distribution<double>(0., 1.);
-std::mt19937_64 RandomGenerator::generator;
+thread_local RandomGenerator *RandomGenerator::mBound = nullptr;
 
 // uniform_real_distribution: 1'000'000'000 random numbers: 27 secs (release mode)
 
+RandomGenerator &RandomGenerator::current()
+{
+    if (mBound)
+        return *mBound;
+    if (Model::hasInstance())
+        return Model::instance()->randomGenerator();
+    // random numbers outside of a model (e.g. tools)
+    static RandomGenerator global_generator;
+    return global_generator;
+}
 
 void RandomGenerator::setRandomSeed()
 {
@@ -33,3 +45,18 @@ void RandomGenerator::setRandomSeed()
     generator.seed(seed);
 
 }
+
+std::string RandomGenerator::state() const
+{
+    std::stringstream ss;
+    ss << generator;
+    return ss.str();
+}
+
+void RandomGenerator::setState(const std::string &state)
+{
+    std::stringstream ss(state);
+    ss >> generator;
+    if (ss.fail())
+        throw std::logic_error("RandomGenerator: invalid state of the random number generator.");
+}
@@ -20,22 +20,52 @@
 #define RANDOMGEN_H
 
 #include <random>
+#include <string>
+#include <cstdint>
 
-
+/** RandomGenerator is a Mersenne twister (64 bit) that provides uniform random numbers.
+ *  Each model has its own generator (Model::randomGenerator()), i.e. replicates in the same process do not
+ *  share the random number stream. The global functions nrandom(), drandom() and irandom() use the generator
+ *  of the current model (see current()). */
 class RandomGenerator {
   public:
-    RandomGenerator() { dbl_dist = std::uniform_real_distribution<double>(0., 1.);  setRandomSeed(); }
-    // this is the more "correct" way of doing it, but it is three times slower than the other way
-    //static double rand() { return dbl_dist(generator); }
-    // the faster way
-    static double rand() { return generator() / static_cast<double>(generator.max()); }
-    static double rand(double range) { return rand()*range; }
-    static int randInt(int range) { int r = static_cast<int>( generator() % static_cast<unsigned long long>(range) ); return r; }
+    RandomGenerator() {}
+    explicit RandomGenerator(uint64_t seed): generator(seed) {}
+    // a std::uniform_real_distribution is the more "correct" way of doing it, but it is three times slower
+    double rand() { return generator() / static_cast<double>(generator.max()); }
+    double rand(double range) { return rand()*range; }
+    int randInt(int range) { int r = static_cast<int>( generator() % static_cast<unsigned long long>(range) ); return r; }
+    /// a raw 64 bit random number (e.g. to seed other generators)
+    uint64_t randRaw() { return generator(); }
+    /// restart the generator with 'seed'
+    void setSeed(uint64_t seed) { generator.seed(seed); }
     // random seed....
-    static void setRandomSeed();
+    void setRandomSeed();
+    /// the internal state of the generator (e.g. to store it in a checkpoint)
+    std::string state() const;
+    /// restore the state of the generator (see state())
+    void setState(const std::string &state);
+
+    /// the generator that is used by nrandom(), drandom() and irandom(): the generator bound to the current
+    /// thread (see RandomScope), or the generator of Model::instance(), or a global generator if there is no model.
+    static RandomGenerator &current();
+private:
+    std::mt19937_64 generator;
+    static thread_local RandomGenerator *mBound; ///< the generator bound to the current thread
+    friend class RandomScope;
+};
+
+/// RandomScope binds a generator to the current thread: while the object lives, the global
+/// random functions (drandom(), ...) use 'generator' in this thread (e.g. for the fires of a wave that spread in parallel).
+class RandomScope
+{
+public:
+    explicit RandomScope(RandomGenerator *generator): mPrevious(RandomGenerator::mBound) { RandomGenerator::mBound = generator; }
+    ~RandomScope() { RandomGenerator::mBound = mPrevious; }
+    RandomScope(const RandomScope &) = delete;
+    RandomScope &operator=(const RandomScope &) = delete;
 private:
-    static std::uniform_real_distribution<double> dbl_dist;
-    static std::mt19937_64 generator;
+    RandomGenerator *mPrevious;
 };
 
 /// ******************************************
@@ -46,19 +76,19 @@ private:
 /// nrandom returns a random number from [p1, p2) -> p2 is not a possible result!
 inline double nrandom(const double& p1, const double& p2)
 {
-    return p1 + RandomGenerator::rand(p2-p1);
+    return p1 + RandomGenerator::current().rand(p2-p1);
     //return p1 + (p2-p1)*(rand()/double(RAND_MAX));
 }
 /// returns a random number in [0,1) (i.e.="1" is NOT a possible result!)
 inline double drandom()
 {
-    return RandomGenerator::rand();
+    return RandomGenerator::current().rand();
     //return rand()/double(RAND_MAX);
 }
 /// return a random number from "from" to "to" (excluding 'to'.), i.e. irandom(3,6) results in 3, 4 or 5.
 inline int irandom(int from, int to)
 {
-    return from + RandomGenerator::randInt(to-from);
+    return from + RandomGenerator::current().randInt(to-from);
     //return from +  rand()%(to-from);
 }
 
@@ -88,6 +88,26 @@ std::string join(Iter it, Iter end, const std::string &delim=", ", int print_max
 }
 
 
+// write the decimal representation of 'value' to 'buffer' (no terminating 0) and return
+// the position after the last character. 'buffer' must hold at least 11 characters.
+inline char *int_to_chars(char *buffer, int value)
+{
+    unsigned int v = static_cast<unsigned int>(value);
+    if (value < 0) {
+        *buffer++ = '-';
+        v = 0u - v;
+    }
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n)
+        *buffer++ = tmp[--n];
+    return buffer;
+}
+
 // return true if fullString ends with 'ending'
 bool has_ending(std::string const &fullString, std::string const &ending);
 
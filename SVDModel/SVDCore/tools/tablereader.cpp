@@ -0,0 +1,335 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "tablereader.h"
+#include "strtools.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+// chunks are not smaller than this (bytes)
+static const size_t MinChunkSize = 1 << 20;
+
+void TableReader::loadFile(const std::string &fileName, int n_threads)
+{
+    mFields.clear();
+    mChunks.clear();
+    mColumns.clear();
+    mRows = 0;
+    mFile.open(fileName);
+
+    if (n_threads <= 0)
+        n_threads = static_cast<int>(std::thread::hardware_concurrency());
+    mThreads = std::max(n_threads, 1);
+
+    readHeader();
+    buildChunks();
+}
+
+size_t TableReader::columnIndex(const std::string &columnName) const
+{
+    auto it = std::find(mFields.begin(), mFields.end(), columnName);
+    if (it==mFields.end())
+        return std::string::npos;
+    return static_cast<size_t>(it - mFields.begin());
+}
+
+size_t TableReader::indexOf(const std::string &columnName) const
+{
+    size_t idx = columnIndex(columnName);
+    if (idx == std::string::npos)
+        throw std::logic_error("TableReader:: invalid column:" + columnName + "\nin:" + fileName());
+    return idx;
+}
+
+bool TableReader::requiredColumns(const std::vector<std::string> &cols) const
+{
+    std::string msg;
+    for (const auto &s : cols)
+        if (!contains(mFields, s))
+            msg += s + ", ";
+    if (msg.size()==0)
+        return true;
+    throw std::logic_error("Required column(s) not in File '" + fileName() + "': " + msg + " (required are: " +  join(cols) + ")");
+}
+
+void TableReader::readColumns()
+{
+    // first pass: count the rows of each chunk
+    runParallel([this](size_t i) { mChunks[i].rows = countRows(mChunks[i]); });
+    mRows = 0;
+    for (auto &c : mChunks) {
+        c.offset = mRows;
+        mRows += c.rows;
+    }
+    mColumns.assign(columnCount(), std::vector<double>(mRows));
+
+    // second pass: parse the values directly into the columns
+    runParallel([this](size_t i) {
+        std::vector<double> values(columnCount());
+        const char *p = mChunks[i].begin;
+        const char *line_begin, *line_end;
+        size_t row = mChunks[i].offset;
+        while (nextLine(p, mChunks[i].end, line_begin, line_end)) {
+            parseLine(line_begin, line_end, values.data());
+            for (size_t c=0; c<values.size(); ++c)
+                mColumns[c][row] = values[c];
+            ++row;
+        }
+    });
+}
+
+void TableReader::forEachRow(const TableReader::RowVisitor &visitor)
+{
+    runParallel([this, &visitor](size_t i) {
+        std::vector<double> values(columnCount());
+        const char *p = mChunks[i].begin;
+        const char *line_begin, *line_end;
+        while (nextLine(p, mChunks[i].end, line_begin, line_end)) {
+            parseLine(line_begin, line_end, values.data());
+            visitor(i, values.data());
+        }
+    });
+}
+
+void TableReader::readHeader()
+{
+    const char *p = mFile.data();
+    const char *end = mFile.end();
+    const char *line_begin = nullptr, *line_end = nullptr;
+    // skip comment lines and empty lines
+    while (p < end) {
+        line_begin = p;
+        const char *q = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        line_end = q ? q : end;
+        p = q ? q + 1 : end;
+        if (line_end > line_begin && line_end[-1]=='\r')
+            --line_end;
+        if (line_end > line_begin && *line_begin != '#')
+            break;
+        line_begin = nullptr;
+    }
+    if (!line_begin)
+        throw std::logic_error("TableReader:: file contains no data: " + fileName());
+    mDataStart = static_cast<size_t>(p - mFile.data());
+
+    std::string header(line_begin, line_end);
+    // determine the used delimiter (same rules as FileReader)
+    size_t ctab = static_cast<size_t>(std::count(header.begin(), header.end(), '\t'));
+    size_t csemi = static_cast<size_t>(std::count(header.begin(), header.end(), ';'));
+    size_t ccol = static_cast<size_t>(std::count(header.begin(), header.end(), ','));
+    size_t cspc = static_cast<size_t>(std::count(header.begin(), header.end(), ' '));
+    size_t maxc = std::max( std::max(ctab, csemi), std::max(ccol, cspc) );
+    if (maxc==0)
+        throw std::logic_error("TableReader:: cannot determine delimiter in " + fileName());
+    if (ctab == maxc) mDelimiter = '\t';
+    if (csemi == maxc) mDelimiter = ';';
+    if (ccol == maxc) mDelimiter = ',';
+    if (cspc == maxc) mDelimiter = ' ';
+
+    // read headers (empty tokens are skipped)
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t next = header.find(mDelimiter, pos);
+        if (next == std::string::npos)
+            next = header.size();
+        if (next > pos) {
+            std::string field = header.substr(pos, next - pos);
+            replace_string(field, "\"", ""); // drop quotes
+            mFields.push_back(field);
+        }
+        pos = next + 1;
+    }
+}
+
+void TableReader::buildChunks()
+{
+    const char *begin = mFile.data() + mDataStart;
+    const char *end = mFile.end();
+    size_t bytes = static_cast<size_t>(end - begin);
+    size_t n_chunks = std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(mThreads) * 8, bytes / MinChunkSize));
+    const char *p = begin;
+    for (size_t i=1; i<=n_chunks && p<end; ++i) {
+        const char *chunk_end = end;
+        if (i < n_chunks) {
+            // align the end of the chunk to the end of a line
+            chunk_end = std::max(p, begin + bytes / n_chunks * i);
+            const char *q = static_cast<const char*>(memchr(chunk_end, '\n', static_cast<size_t>(end - chunk_end)));
+            chunk_end = q ? q + 1 : end;
+        }
+        mChunks.push_back( SChunk { p, chunk_end, 0, 0 } );
+        p = chunk_end;
+    }
+}
+
+void TableReader::runParallel(const std::function<void (size_t)> &fn)
+{
+    size_t n_threads = std::min(static_cast<size_t>(mThreads), mChunks.size());
+    if (n_threads <= 1) {
+        for (size_t i=0; i<mChunks.size(); ++i)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next_chunk(0);
+    std::vector<std::thread> workers;
+    std::vector<std::string> errors(n_threads);
+    for (size_t t=0; t<n_threads; ++t) {
+        workers.emplace_back([&, t]() {
+            try {
+                size_t i;
+                while ((i = next_chunk++) < mChunks.size())
+                    fn(i);
+            } catch (const std::exception &e) {
+                errors[t] = e.what();
+                next_chunk = mChunks.size(); // stop the other workers
+            }
+        });
+    }
+    for (auto &w : workers)
+        w.join();
+    for (auto &e : errors)
+        if (!e.empty())
+            throw std::logic_error(e);
+}
+
+size_t TableReader::countRows(const TableReader::SChunk &chunk) const
+{
+    size_t n = 0;
+    const char *p = chunk.begin;
+    const char *line_begin, *line_end;
+    while (nextLine(p, chunk.end, line_begin, line_end))
+        ++n;
+    return n;
+}
+
+bool TableReader::nextLine(const char *&p, const char *end, const char *&line_begin, const char *&line_end)
+{
+    while (p < end) {
+        line_begin = p;
+        const char *q = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        line_end = q ? q : end;
+        p = q ? q + 1 : end;
+        if (line_end > line_begin && line_end[-1]=='\r')
+            --line_end;
+        // skip empty lines and comments
+        const char *s = line_begin;
+        while (s < line_end && (*s==' ' || *s=='\t')) ++s;
+        if (s < line_end && *s != '#')
+            return true;
+    }
+    return false;
+}
+
+// parse a line; the semantics are the same as in FileReader::next(): empty fields and missing values are 0.
+void TableReader::parseLine(const char *p, const char *end, double *values) const
+{
+    while (p<end && (*p==mDelimiter || *p==' ')) ++p; // skip delimiters
+    for (size_t i=0; i<mFields.size(); ++i) {
+        if (p>=end || *p==mDelimiter)
+            values[i] = 0.;
+        else
+            values[i] = parseNumber(p, end);
+        while (p<end && *p!=mDelimiter) ++p; // skip data
+        if (p<end) ++p; // skip delimiter
+        while (p<end && *p==' ') ++p; // skip also spaces
+    }
+}
+
+// fallback for numbers that can not be parsed exactly by the fast path below
+static double parseNumberSlow(const char *p, const char *end)
+{
+    char buf[128];
+    size_t n = std::min(static_cast<size_t>(end - p), sizeof(buf) - 1);
+    memcpy(buf, p, n);
+    buf[n] = '\0';
+    return strtod(buf, nullptr);
+}
+
+double TableReader::parseNumber(const char *p, const char *end)
+{
+    // powers of 10 that are exactly representable as double
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char *start = p;
+    while (p<end && (*p==' ' || *p=='\t')) ++p;
+    bool negative = false;
+    if (p<end && (*p=='-' || *p=='+')) {
+        negative = *p=='-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int n_digits = 0; // significant digits in 'mantissa'
+    int exponent = 0;
+    bool any_digit = false, truncated = false;
+    for (; p<end && *p>='0' && *p<='9'; ++p) {
+        any_digit = true;
+        if (n_digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa) ++n_digits;
+        } else {
+            ++exponent;
+            truncated = true;
+        }
+    }
+    if (p<end && *p=='.') {
+        for (++p; p<end && *p>='0' && *p<='9'; ++p) {
+            any_digit = true;
+            if (n_digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa) ++n_digits;
+                --exponent;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+    if (!any_digit)
+        return parseNumberSlow(start, end); // e.g. 'nan', 'inf', or no number (=0)
+
+    if (p<end && (*p=='e' || *p=='E')) {
+        const char *e = p + 1;
+        bool exp_negative = false;
+        if (e<end && (*e=='-' || *e=='+')) {
+            exp_negative = *e=='-';
+            ++e;
+        }
+        if (e<end && *e>='0' && *e<='9') {
+            int exp_value = 0;
+            for (; e<end && *e>='0' && *e<='9'; ++e)
+                if (exp_value < 100000)
+                    exp_value = exp_value * 10 + (*e - '0');
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+    }
+
+    if (mantissa == 0)
+        return negative ? -0. : 0.;
+    // fast path: the mantissa and the power of 10 are exact doubles, i.e. the result is correctly rounded
+    if (!truncated && mantissa <= (static_cast<uint64_t>(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+        return negative ? -value : value;
+    }
+    return parseNumberSlow(start, end);
+}
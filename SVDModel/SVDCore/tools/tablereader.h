@@ -0,0 +1,108 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef TABLEREADER_H
+#define TABLEREADER_H
+/*  TableReader reads large numeric tables (e.g. climate or environment files) in parallel.
+    The file is memory mapped, split into line-aligned chunks, and the chunks are parsed by
+    multiple threads. The header and the delimiter are detected as in FileReader (tab, ';', ',' and (multiple) space).
+    There is no limit to the line length. Sections and string values are not supported (use FileReader).
+Usage example:
+...
+TableReader reader(file_name);
+reader.requiredColumns({"id", "year"});
+// (a) columnar access
+reader.readColumns();
+const std::vector<double> &years = reader.column(reader.indexOf("year"));
+// (b) row visitor: called in parallel for different chunks, rows within a chunk are visited in file order
+reader.forEachRow([&](size_t chunk, const double *values) { ... });
+
+*/
+#include <string>
+#include <vector>
+#include <functional>
+#include <cassert>
+
+#include "mappedfile.h"
+
+class TableReader
+{
+public:
+    TableReader() : mDelimiter(' '), mDataStart(0), mThreads(1), mRows(0) {}
+    /// create and open the file
+    TableReader(const std::string &fileName, int n_threads=0) : TableReader() { loadFile(fileName, n_threads); }
+    /// open (map) the file and parse the header. 'n_threads'=0: use all available cores.
+    void loadFile(const std::string &fileName, int n_threads=0);
+    const std::string &fileName() const { return mFile.fileName(); }
+
+    // header
+    /// number of columns
+    size_t columnCount() const { return mFields.size(); }
+    const std::string &columnName(const size_t columnIndex) const { assert(columnIndex<mFields.size()); return mFields[columnIndex]; }
+    const std::vector<std::string> &columnNames() const { return mFields; }
+    /// retrieve the index of a given column or std::string::npos if the column is not found.
+    size_t columnIndex(const std::string &columnName) const;
+    /// retrieve the index of a column name. Throws an error if the column is not present.
+    size_t indexOf(const std::string &columnName) const;
+    /// check if *all* columns provided in 'cols' are in the file. Throws an exception if not.
+    bool requiredColumns(const std::vector<std::string> &cols) const;
+
+    // columnar access
+    /// parse the full file and store the values column-wise
+    void readColumns();
+    /// number of data rows (available after readColumns())
+    size_t rowCount() const { return mRows; }
+    const std::vector<double> &column(const size_t columnIndex) const { assert(columnIndex<mColumns.size()); return mColumns[columnIndex]; }
+    /// move the values of the column 'columnIndex' out of the reader (the column is empty afterwards).
+    std::vector<double> takeColumn(const size_t columnIndex) { assert(columnIndex<mColumns.size()); return std::move(mColumns[columnIndex]); }
+    double value(const size_t row, const size_t columnIndex) const { assert(columnIndex<mColumns.size() && row<mRows); return mColumns[columnIndex][row]; }
+
+    // row visitor
+    /// number of chunks the file is split into
+    size_t chunkCount() const { return mChunks.size(); }
+    /// the visitor gets the index of the chunk and a pointer to the values (columnCount() values) of the row.
+    typedef std::function<void(size_t chunk, const double *values)> RowVisitor;
+    /// parse the file and call 'visitor' for every row. The visitor is called concurrently for different chunks
+    /// (so it needs to be thread safe), but rows of a chunk are visited in order.
+    void forEachRow(const RowVisitor &visitor);
+
+    /// locale-independent parsing of a number (same semantics as atof()), 'end' points to the end of the buffer.
+    static double parseNumber(const char *p, const char *end);
+private:
+    struct SChunk { const char *begin; const char *end; size_t rows; size_t offset; };
+    void readHeader();
+    void buildChunks();
+    /// run 'fn(chunk_index)' for all chunks in parallel
+    void runParallel(const std::function<void(size_t)> &fn);
+    size_t countRows(const SChunk &chunk) const;
+    /// parse a line of data and fill 'values'
+    void parseLine(const char *p, const char *end, double *values) const;
+    /// return the next data line in [p, end) (and advance 'p'); returns false if no more data lines
+    static bool nextLine(const char *&p, const char *end, const char *&line_begin, const char *&line_end);
+
+    MappedFile mFile;
+    std::vector<std::string> mFields;
+    char mDelimiter;
+    size_t mDataStart; ///< offset of the first data line
+    int mThreads;
+    std::vector<SChunk> mChunks;
+    std::vector< std::vector<double> > mColumns;
+    size_t mRows; ///< number of rows (after readColumns())
+};
+
+#endif // TABLEREADER_H
@@ -0,0 +1,109 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "taskgraph.h"
+
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <QtConcurrent>
+
+#include "strtools.h"
+#include "spdlog/spdlog.h"
+
+void TaskGraph::add(const std::string &name, std::function<void()> fn, const std::vector<std::string> &depends_on)
+{
+    for (const auto &t : mTasks)
+        if (t.name == name)
+            throw logic_error_fmt("TaskGraph: the task '{}' is already defined.", name);
+
+    STask task { name, fn, std::vector<size_t>(), depends_on.size() };
+    for (const auto &dep : depends_on) {
+        auto it = std::find_if(mTasks.begin(), mTasks.end(), [&dep](const STask &t) { return t.name == dep; });
+        if (it == mTasks.end())
+            throw logic_error_fmt("TaskGraph: the task '{}' depends on '{}', which is not defined (yet).", name, dep);
+        it->dependents.push_back(mTasks.size());
+    }
+    mTasks.push_back(task);
+}
+
+void TaskGraph::run(bool parallel)
+{
+    auto lg = spdlog::get("setup");
+    auto run_task = [&lg](const STask &task) {
+        auto start = std::chrono::steady_clock::now();
+        task.fn();
+        if (lg)
+            lg->debug("Task '{}' finished ({} ms).", task.name,
+                      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    if (!parallel) {
+        for (const auto &task : mTasks)
+            run_task(task);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<size_t> n_open(mTasks.size());
+    for (size_t i=0;i<mTasks.size();++i)
+        n_open[i] = mTasks[i].n_dependencies;
+    size_t n_running = 0;
+    std::string error;
+
+    // start a task on the thread pool; the caller holds the lock
+    std::function<void(size_t)> start_task = [&](size_t i) {
+        ++n_running;
+        QtConcurrent::run(QThreadPool::globalInstance(), [&, i]() {
+            bool failed = true;
+            std::string task_error;
+            try {
+                run_task(mTasks[i]);
+                failed = false;
+            } catch (const std::exception &e) {
+                task_error = e.what();
+            } catch (...) {
+                task_error = "unknown exception";
+            }
+            std::lock_guard<std::mutex> guard(mutex);
+            if (failed) {
+                if (error.empty())
+                    error = fmt::format("Error in '{}': {}", mTasks[i].name, task_error);
+            } else if (error.empty()) {
+                for (size_t d : mTasks[i].dependents)
+                    if (--n_open[d] == 0)
+                        start_task(d);
+            }
+            --n_running;
+            finished.notify_all();
+        });
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t i=0;i<mTasks.size();++i)
+            if (n_open[i] == 0)
+                start_task(i);
+        finished.wait(lock, [&n_running]() { return n_running == 0; });
+    }
+
+    if (!error.empty())
+        throw std::logic_error(error);
+}
@@ -0,0 +1,53 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * @brief The TaskGraph class runs a set of tasks with declared dependencies.
+ * A task is started (on the global thread pool) as soon as all tasks it depends on are finished,
+ * i.e., independent tasks run concurrently.
+ * Dependencies have to be added before the tasks that depend on them (the graph is therefore free of cycles).
+ */
+class TaskGraph
+{
+public:
+    TaskGraph() {}
+    /// add a task 'name' that executes 'fn' after all tasks in 'depends_on' are finished.
+    void add(const std::string &name, std::function<void()> fn, const std::vector<std::string> &depends_on = {});
+    /// run all tasks and wait until they are finished. If a task fails, tasks that depend on it are not started,
+    /// and a std::logic_error is thrown after all running tasks are finished.
+    /// If 'parallel' is false, the tasks are executed one after another in the order they were added.
+    void run(bool parallel=true);
+    size_t count() const { return mTasks.size(); }
+private:
+    struct STask {
+        std::string name;
+        std::function<void()> fn;
+        std::vector<size_t> dependents; ///< tasks that wait for this task
+        size_t n_dependencies; ///< number of tasks this task depends on
+    };
+    std::vector<STask> mTasks;
+};
+
+#endif // TASKGRAPH_H
@@ -0,0 +1,486 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "tiffreader.h"
+
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "strtools.h"
+#include "geotiff.h"
+#include "third_party/FreeImage/FreeImage.h"
+
+// size (bytes) of the TIFF field types (0: unknown)
+static size_t tiffTypeSize(uint16_t type)
+{
+    switch (type) {
+    case 1: case 2: case 6: case 7: return 1; // BYTE, ASCII, SBYTE, UNDEFINED
+    case 3: case 8: return 2; // SHORT, SSHORT
+    case 4: case 9: case 11: case 13: return 4; // LONG, SLONG, FLOAT, IFD
+    case 5: case 10: case 12: case 16: case 17: case 18: return 8; // RATIONAL, SRATIONAL, DOUBLE, LONG8, SLONG8, IFD8
+    default: return 0;
+    }
+}
+
+// decode a LZW compressed block (TIFF variant: MSB first, codes with 9-12 bits, 'early change')
+// returns the number of decoded bytes
+static size_t lzwDecode(const unsigned char *src, size_t src_size, unsigned char *dst, size_t dst_size)
+{
+    const int ClearCode = 256, EoiCode = 257;
+    // the string table: each entry is the prefix code plus the last byte
+    std::vector<uint16_t> prefix(4096), length(4096);
+    std::vector<unsigned char> suffix(4096), first(4096);
+    for (int i=0; i<256; ++i) {
+        prefix[i] = 0xFFFF; suffix[i] = first[i] = static_cast<unsigned char>(i); length[i] = 1;
+    }
+    size_t bit_pos = 0, out = 0;
+    const size_t n_bits = src_size * 8;
+    int width = 9, next = 258, old = -1;
+    while (out < dst_size) {
+        if (bit_pos + static_cast<size_t>(width) > n_bits)
+            break;
+        int code = 0;
+        for (int i=0; i<width; ++i, ++bit_pos)
+            code = (code << 1) | ((src[bit_pos >> 3] >> (7 - (bit_pos & 7))) & 1);
+
+        if (code == EoiCode)
+            break;
+        if (code == ClearCode) {
+            width = 9; next = 258; old = -1;
+            continue;
+        }
+        if (old < 0) {
+            if (code > 255)
+                break; // invalid data
+        } else {
+            if (code > next || (code == next && next >= 4096))
+                break; // invalid data
+            if (next < 4096) {
+                // add the new string (old string + first byte of the current string)
+                prefix[next] = static_cast<uint16_t>(old);
+                suffix[next] = code < next ? first[code] : first[old];
+                first[next] = first[old];
+                length[next] = static_cast<uint16_t>(length[old] + 1);
+                ++next;
+                if (next + 1 >= (1 << width) && width < 12)
+                    ++width;
+            }
+        }
+        // write the string (backwards)
+        size_t len = length[code];
+        size_t pos = out + len;
+        for (int c = code; c != 0xFFFF; c = prefix[c])
+            if (--pos < dst_size)
+                dst[pos] = suffix[c];
+        out = std::min(out + len, dst_size);
+        old = code;
+    }
+    return out;
+}
+
+// decode a PackBits compressed block, returns the number of decoded bytes
+static size_t packBitsDecode(const unsigned char *src, size_t src_size, unsigned char *dst, size_t dst_size)
+{
+    size_t i = 0, out = 0;
+    while (i < src_size && out < dst_size) {
+        int n = static_cast<signed char>(src[i++]);
+        if (n >= 0) {
+            size_t len = std::min(static_cast<size_t>(n + 1), std::min(src_size - i, dst_size - out));
+            memcpy(dst + out, src + i, len);
+            i += static_cast<size_t>(n + 1);
+            out += len;
+        } else if (n != -128) {
+            if (i >= src_size)
+                break;
+            size_t len = std::min(static_cast<size_t>(1 - n), dst_size - out);
+            memset(dst + out, src[i++], len);
+            out += len;
+        }
+    }
+    return out;
+}
+
+static bool nativeLittleEndian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+TiffReader::TiffReader(const std::string &fileName):
+    mSwap(false), mBigTiff(false), mWidth(0), mHeight(0), mBitsPerSample(0), mSampleType(Unknown),
+    mCompression(1), mPredictor(1), mTiled(false), mBlockWidth(0), mBlockHeight(0),
+    mXLeft(0.), mYTop(0.), mCellsize(0.), mHasNoData(false), mNoData(0.)
+{
+    mFile.open(fileName);
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(mFile.data());
+    if (mFile.size() < 16)
+        throw logic_error_fmt("TIFF '{}': invalid file (too small).", fileName);
+    bool little_endian;
+    if (p[0]=='I' && p[1]=='I')
+        little_endian = true;
+    else if (p[0]=='M' && p[1]=='M')
+        little_endian = false;
+    else
+        throw logic_error_fmt("TIFF '{}': not a TIFF file.", fileName);
+    mSwap = little_endian != nativeLittleEndian();
+
+    uint16_t version = read16(p + 2);
+    uint64_t ifd_offset;
+    if (version == 42) {
+        ifd_offset = read32(p + 4);
+    } else if (version == 43) {
+        if (read16(p + 4) != 8)
+            throw logic_error_fmt("TIFF '{}': invalid BigTIFF header.", fileName);
+        mBigTiff = true;
+        ifd_offset = read64(p + 8);
+    } else {
+        throw logic_error_fmt("TIFF '{}': not a TIFF file (version {}).", fileName, version);
+    }
+    parseDirectory(ifd_offset);
+}
+
+void TiffReader::readBlocks(size_t x0, size_t y0, size_t w, size_t h, const std::function<void (const TiffReader::SBlock &)> &fn, int n_threads) const
+{
+    size_t x1 = std::min(x0 + w, mWidth);
+    size_t y1 = std::min(y0 + h, mHeight);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    // the blocks that intersect with the window
+    std::vector<SBlock> blocks;
+    std::vector<size_t> indices;
+    size_t blocks_x = (mWidth + mBlockWidth - 1) / mBlockWidth;
+    for (size_t by = y0 / mBlockHeight; by <= (y1 - 1) / mBlockHeight; ++by)
+        for (size_t bx = x0 / mBlockWidth; bx <= (x1 - 1) / mBlockWidth; ++bx) {
+            // tiles have always the full size, the last strip may be shorter
+            size_t rows = mTiled ? mBlockHeight : std::min(mBlockHeight, mHeight - by * mBlockHeight);
+            blocks.push_back( SBlock { bx * mBlockWidth, by * mBlockHeight, mBlockWidth, rows, nullptr } );
+            indices.push_back(by * blocks_x + bx);
+        }
+
+    if (n_threads <= 0)
+        n_threads = static_cast<int>(std::thread::hardware_concurrency());
+    size_t n_workers = std::min(static_cast<size_t>(std::max(n_threads, 1)), blocks.size());
+    std::atomic<size_t> next_block(0);
+    std::vector<std::thread> workers;
+    std::vector<std::string> errors(n_workers);
+    for (size_t t=0; t<n_workers; ++t) {
+        workers.emplace_back([&, t]() {
+            try {
+                std::vector<unsigned char> buffer, temp;
+                size_t i;
+                while ((i = next_block++) < blocks.size()) {
+                    decodeBlock(indices[i], blocks[i].height, buffer, temp);
+                    SBlock block = blocks[i];
+                    block.data = buffer.data();
+                    fn(block);
+                }
+            } catch (const std::exception &e) {
+                errors[t] = e.what();
+                next_block = blocks.size(); // stop the other workers
+            }
+        });
+    }
+    for (auto &wrk : workers)
+        wrk.join();
+    for (auto &e : errors)
+        if (!e.empty())
+            throw std::logic_error(e);
+}
+
+uint16_t TiffReader::read16(const unsigned char *p) const
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return mSwap ? static_cast<uint16_t>((v >> 8) | (v << 8)) : v;
+}
+
+uint32_t TiffReader::read32(const unsigned char *p) const
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    if (mSwap)
+        v = ((v >> 24) & 0xFF) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+    return v;
+}
+
+uint64_t TiffReader::read64(const unsigned char *p) const
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    if (mSwap) {
+        uint64_t r = 0;
+        for (int i=0; i<8; ++i)
+            r = (r << 8) | ((v >> (8*i)) & 0xFF);
+        v = r;
+    }
+    return v;
+}
+
+std::vector<uint64_t> TiffReader::intValues(const TiffReader::SEntry &e) const
+{
+    std::vector<uint64_t> result(static_cast<size_t>(e.count));
+    for (size_t i=0; i<result.size(); ++i) {
+        switch (e.type) {
+        case 1: case 7: result[i] = e.value[i]; break;
+        case 6: result[i] = static_cast<uint64_t>(static_cast<signed char>(e.value[i])); break;
+        case 3: result[i] = read16(e.value + 2*i); break;
+        case 8: result[i] = static_cast<uint64_t>(static_cast<int16_t>(read16(e.value + 2*i))); break;
+        case 4: case 13: result[i] = read32(e.value + 4*i); break;
+        case 9: result[i] = static_cast<uint64_t>(static_cast<int32_t>(read32(e.value + 4*i))); break;
+        case 16: case 17: case 18: result[i] = read64(e.value + 8*i); break;
+        default: throw logic_error_fmt("TIFF '{}': invalid data type {} for tag {}.", fileName(), e.type, e.tag);
+        }
+    }
+    return result;
+}
+
+std::vector<double> TiffReader::doubleValues(const TiffReader::SEntry &e) const
+{
+    if (e.type != 11 && e.type != 12) {
+        std::vector<uint64_t> ints = intValues(e);
+        return std::vector<double>(ints.begin(), ints.end());
+    }
+    std::vector<double> result(static_cast<size_t>(e.count));
+    for (size_t i=0; i<result.size(); ++i) {
+        if (e.type == 11) {
+            uint32_t v = read32(e.value + 4*i);
+            float f;
+            memcpy(&f, &v, 4);
+            result[i] = static_cast<double>(f);
+        } else {
+            uint64_t v = read64(e.value + 8*i);
+            memcpy(&result[i], &v, 8);
+        }
+    }
+    return result;
+}
+
+std::vector<char> TiffReader::rawValues(const TiffReader::SEntry &e) const
+{
+    // values are converted to the native byte order
+    size_t size = tiffTypeSize(e.type);
+    std::vector<char> result(static_cast<size_t>(e.count) * size);
+    for (size_t i=0; i<static_cast<size_t>(e.count); ++i)
+        for (size_t b=0; b<size; ++b)
+            result[i*size + b] = static_cast<char>(e.value[i*size + (mSwap ? size - 1 - b : b)]);
+    return result;
+}
+
+void TiffReader::parseDirectory(uint64_t offset)
+{
+    const unsigned char *base = reinterpret_cast<const unsigned char*>(mFile.data());
+    const uint64_t file_size = mFile.size();
+    const size_t count_size = mBigTiff ? 8 : 2;
+    const size_t entry_size = mBigTiff ? 20 : 12;
+    const size_t inline_size = mBigTiff ? 8 : 4;
+    if (offset + count_size > file_size)
+        throw logic_error_fmt("TIFF '{}': invalid offset of the image directory.", fileName());
+    uint64_t n_entries = mBigTiff ? read64(base + offset) : read16(base + offset);
+    if (offset + count_size + n_entries * entry_size > file_size)
+        throw logic_error_fmt("TIFF '{}': invalid image directory.", fileName());
+
+    std::map<uint16_t, SEntry> entries;
+    for (uint64_t i=0; i<n_entries; ++i) {
+        const unsigned char *p = base + offset + count_size + i * entry_size;
+        SEntry e;
+        e.tag = read16(p);
+        e.type = read16(p + 2);
+        e.count = mBigTiff ? read64(p + 4) : read32(p + 4);
+        size_t type_size = tiffTypeSize(e.type);
+        if (type_size == 0)
+            continue; // unknown data type: skip the tag
+        const unsigned char *value_field = p + (mBigTiff ? 12 : 8);
+        if (e.count > file_size / type_size)
+            throw logic_error_fmt("TIFF '{}': invalid count for tag {}.", fileName(), e.tag);
+        uint64_t n_bytes = e.count * type_size;
+        if (n_bytes <= inline_size) {
+            e.value = value_field;
+        } else {
+            uint64_t value_offset = mBigTiff ? read64(value_field) : read32(value_field);
+            if (value_offset + n_bytes > file_size)
+                throw logic_error_fmt("TIFF '{}': invalid offset for tag {}.", fileName(), e.tag);
+            e.value = base + value_offset;
+        }
+        entries[e.tag] = e;
+    }
+
+    auto int_value = [&](uint16_t tag, uint64_t default_value) -> uint64_t {
+        auto it = entries.find(tag);
+        if (it == entries.end() || it->second.count == 0)
+            return default_value;
+        return intValues(it->second)[0];
+    };
+    auto required = [&](uint16_t tag) -> const SEntry& {
+        auto it = entries.find(tag);
+        if (it == entries.end())
+            throw logic_error_fmt("TIFF '{}': required tag {} is missing.", fileName(), tag);
+        return it->second;
+    };
+
+    mWidth = static_cast<size_t>(int_value(256, 0));
+    mHeight = static_cast<size_t>(int_value(257, 0));
+    if (mWidth == 0 || mHeight == 0)
+        throw logic_error_fmt("TIFF '{}': invalid image size.", fileName());
+    if (int_value(277, 1) != 1)
+        throw logic_error_fmt("TIFF '{}': only images with a single band are supported (samples per pixel: {}).", fileName(), int_value(277, 1));
+
+    mBitsPerSample = static_cast<size_t>(int_value(258, 1));
+    int sample_format = static_cast<int>(int_value(339, 1));
+    switch (sample_format * 100 + static_cast<int>(mBitsPerSample)) {
+    case 108: mSampleType = UInt8; break;
+    case 116: mSampleType = UInt16; break;
+    case 132: mSampleType = UInt32; break;
+    case 208: mSampleType = Int8; break;
+    case 216: mSampleType = Int16; break;
+    case 232: mSampleType = Int32; break;
+    case 332: mSampleType = Float32; break;
+    case 364: mSampleType = Float64; break;
+    default:
+        throw logic_error_fmt("TIFF '{}': sample type not supported (sample format: {}, bits per sample: {}).", fileName(), sample_format, mBitsPerSample);
+    }
+
+    mCompression = static_cast<int>(int_value(259, 1));
+    if (mCompression != 1 && mCompression != 5 && mCompression != 8 && mCompression != 32946 && mCompression != 32773)
+        throw logic_error_fmt("TIFF '{}': compression {} is not supported (supported are: none, LZW, deflate, PackBits).", fileName(), mCompression);
+    mPredictor = static_cast<int>(int_value(317, 1));
+    if (mPredictor < 1 || mPredictor > 3)
+        throw logic_error_fmt("TIFF '{}': predictor {} is not supported.", fileName(), mPredictor);
+
+    mTiled = entries.count(322) > 0;
+    if (mTiled) {
+        mBlockWidth = static_cast<size_t>(int_value(322, 0));
+        mBlockHeight = static_cast<size_t>(int_value(323, 0));
+        mOffsets = intValues(required(324));
+        mByteCounts = intValues(required(325));
+    } else {
+        mBlockWidth = mWidth;
+        mBlockHeight = std::min(static_cast<size_t>(int_value(278, mHeight)), mHeight);
+        mOffsets = intValues(required(273));
+        mByteCounts = intValues(required(279));
+    }
+    if (mBlockWidth == 0 || mBlockHeight == 0)
+        throw logic_error_fmt("TIFF '{}': invalid tile size.", fileName());
+    size_t n_blocks = ((mWidth + mBlockWidth - 1) / mBlockWidth) * ((mHeight + mBlockHeight - 1) / mBlockHeight);
+    if (mOffsets.size() < n_blocks || mByteCounts.size() < n_blocks)
+        throw logic_error_fmt("TIFF '{}': the number of tiles/strips ({}) does not match the image size.", fileName(), mOffsets.size());
+
+    // geo reference: pixel scale and tie points
+    if (entries.count(33550) && entries.count(33922)) {
+        std::vector<double> scale = doubleValues(entries[33550]);
+        std::vector<double> tie = doubleValues(entries[33922]);
+        if (scale.size() >= 2 && tie.size() >= 6) {
+            if (fabs(scale[0] - scale[1]) > 0.001)
+                throw logic_error_fmt("GeoTIF '{}': pixel scale in x and y do not match (x: {}, y: {}).", fileName(), scale[0], scale[1]);
+            mCellsize = scale[0];
+            mXLeft = tie[3] - tie[0] * scale[0];
+            mYTop = tie[4] + tie[1] * scale[1];
+        }
+    }
+    if (entries.count(42113)) {
+        std::vector<char> text = rawValues(entries[42113]);
+        text.push_back('\0');
+        char *end = nullptr;
+        mNoData = strtod(text.data(), &end);
+        mHasNoData = end != text.data();
+    }
+
+    // projection information is used for writing GeoTIFFs
+    std::vector<GeoTIFF::SProjectionTag> projection;
+    for (uint16_t tag : { 34735, 34736, 34737 })
+        if (entries.count(tag)) {
+            const SEntry &e = entries[tag];
+            projection.push_back( GeoTIFF::SProjectionTag { e.tag, e.type, static_cast<uint32_t>(e.count), rawValues(e) } );
+        }
+    if (!projection.empty())
+        GeoTIFF::setProjectionTags(projection);
+}
+
+void TiffReader::decodeBlock(size_t index, size_t rows, std::vector<unsigned char> &buffer, std::vector<unsigned char> &temp) const
+{
+    const size_t bps = bytesPerSample();
+    const size_t row_bytes = mBlockWidth * bps;
+    const size_t n_bytes = row_bytes * rows;
+    buffer.resize(n_bytes);
+
+    uint64_t offset = mOffsets[index];
+    uint64_t size = mByteCounts[index];
+    if (offset + size > mFile.size())
+        throw logic_error_fmt("TIFF '{}': invalid offset of tile/strip {}.", fileName(), index);
+    const unsigned char *src = reinterpret_cast<const unsigned char*>(mFile.data()) + offset;
+    size_t n = 0;
+    if (size > 0) {
+        switch (mCompression) {
+        case 1: // no compression
+            n = std::min(static_cast<size_t>(size), n_bytes);
+            memcpy(buffer.data(), src, n);
+            break;
+        case 5: // LZW
+            n = lzwDecode(src, static_cast<size_t>(size), buffer.data(), n_bytes);
+            break;
+        case 8: case 32946: // deflate
+            n = FreeImage_ZLibUncompress(buffer.data(), static_cast<DWORD>(n_bytes), const_cast<BYTE*>(src), static_cast<DWORD>(size));
+            if (n == 0)
+                throw logic_error_fmt("TIFF '{}': decompression of tile/strip {} failed.", fileName(), index);
+            break;
+        case 32773: // PackBits
+            n = packBitsDecode(src, static_cast<size_t>(size), buffer.data(), n_bytes);
+            break;
+        }
+    }
+    if (n < n_bytes)
+        memset(buffer.data() + n, 0, n_bytes - n); // missing data (e.g. sparse files)
+
+    if (mPredictor == 3) {
+        // floating point predictor: the bytes of a row are differenced, and stored as byte planes (most significant byte first)
+        temp.resize(row_bytes);
+        const bool little = nativeLittleEndian();
+        for (size_t r=0; r<rows; ++r) {
+            unsigned char *row = buffer.data() + r * row_bytes;
+            for (size_t i=1; i<row_bytes; ++i)
+                row[i] = static_cast<unsigned char>(row[i] + row[i-1]);
+            for (size_t s=0; s<mBlockWidth; ++s)
+                for (size_t b=0; b<bps; ++b)
+                    temp[s*bps + (little ? bps - 1 - b : b)] = row[b * mBlockWidth + s];
+            memcpy(row, temp.data(), row_bytes);
+        }
+        return;
+    }
+
+    if (mSwap && bps > 1) {
+        for (size_t i=0; i<n_bytes; i+=bps)
+            std::reverse(buffer.begin() + static_cast<std::ptrdiff_t>(i), buffer.begin() + static_cast<std::ptrdiff_t>(i + bps));
+    }
+
+    if (mPredictor == 2) {
+        // horizontal differencing: values are stored as difference to the left neighbor
+        for (size_t r=0; r<rows; ++r) {
+            unsigned char *row = buffer.data() + r * row_bytes;
+            switch (bps) {
+            case 1: for (size_t x=1; x<mBlockWidth; ++x) row[x] = static_cast<unsigned char>(row[x] + row[x-1]); break;
+            case 2: { uint16_t *v = reinterpret_cast<uint16_t*>(row); for (size_t x=1; x<mBlockWidth; ++x) v[x] = static_cast<uint16_t>(v[x] + v[x-1]); break; }
+            case 4: { uint32_t *v = reinterpret_cast<uint32_t*>(row); for (size_t x=1; x<mBlockWidth; ++x) v[x] += v[x-1]; break; }
+            case 8: { uint64_t *v = reinterpret_cast<uint64_t*>(row); for (size_t x=1; x<mBlockWidth; ++x) v[x] += v[x-1]; break; }
+            }
+        }
+    }
+}
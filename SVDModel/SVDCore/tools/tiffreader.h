@@ -0,0 +1,105 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef TIFFREADER_H
+#define TIFFREADER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "mappedfile.h"
+
+/**
+ * @brief The TiffReader class is a native reader for single band (Geo)TIFF files.
+ * Classic TIFF and BigTIFF (>4GB) files in both byte orders are supported, with tiled or striped layout,
+ * and the compression schemes none, LZW, deflate and PackBits (with the horizontal and floating point predictor).
+ * Tiles (or strips) are decompressed in parallel, and only the tiles that intersect the requested window are read.
+ * Supported sample types are 8/16/32 bit (un)signed integers and 32/64 bit floating point numbers.
+ */
+class TiffReader
+{
+public:
+    enum SampleType { Unknown, UInt8, Int8, UInt16, Int16, UInt32, Int32, Float32, Float64 };
+    /// a decoded tile or strip; values are in native byte order, row by row (with 'width' values per row).
+    /// Note that tiles at the right/bottom edge of the image are padded, i.e. 'x'+'width' may be larger than the image width.
+    struct SBlock {
+        size_t x, y; ///< pixel position of the upper left corner
+        size_t width, height; ///< size of the block (pixels)
+        const unsigned char *data;
+    };
+
+    /// open the file and parse the first image directory. Throws an exception if the file is not a supported TIFF.
+    TiffReader(const std::string &fileName);
+    const std::string &fileName() const { return mFile.fileName(); }
+
+    size_t width() const { return mWidth; }
+    size_t height() const { return mHeight; }
+    SampleType sampleType() const { return mSampleType; }
+    size_t bytesPerSample() const { return mBitsPerSample / 8; }
+    bool isBigTiff() const { return mBigTiff; }
+    bool isTiled() const { return mTiled; }
+
+    // geo reference
+    /// true if the file contains pixel scale and tie points
+    bool hasGeoReference() const { return mCellsize > 0.; }
+    /// world coordinates of the upper left corner of the image
+    double xLeft() const { return mXLeft; }
+    double yTop() const { return mYTop; }
+    double cellsize() const { return mCellsize; }
+    /// the no data value (GDAL_NODATA tag)
+    bool hasNoData() const { return mHasNoData; }
+    double noDataValue() const { return mNoData; }
+
+    /// decode all tiles/strips that intersect the window given by 'x0', 'y0' (pixel position of upper left corner)
+    /// and 'w', 'h' (size in pixels), and call 'fn' for each block. 'fn' is called concurrently by
+    /// 'n_threads' threads (0: one thread per core).
+    void readBlocks(size_t x0, size_t y0, size_t w, size_t h, const std::function<void(const SBlock &block)> &fn, int n_threads=0) const;
+
+private:
+    struct SEntry { uint16_t tag; uint16_t type; uint64_t count; const unsigned char *value; };
+    uint16_t read16(const unsigned char *p) const;
+    uint32_t read32(const unsigned char *p) const;
+    uint64_t read64(const unsigned char *p) const;
+    /// return the values of a tag as integers / floating point numbers
+    std::vector<uint64_t> intValues(const SEntry &e) const;
+    std::vector<double> doubleValues(const SEntry &e) const;
+    std::vector<char> rawValues(const SEntry &e) const;
+    void parseDirectory(uint64_t offset);
+    /// decompress block 'index' to 'buffer' (native byte order, predictor removed)
+    void decodeBlock(size_t index, size_t rows, std::vector<unsigned char> &buffer, std::vector<unsigned char> &temp) const;
+
+    MappedFile mFile;
+    bool mSwap; ///< true if the byte order of the file differs from the native byte order
+    bool mBigTiff;
+    size_t mWidth, mHeight;
+    size_t mBitsPerSample;
+    SampleType mSampleType;
+    int mCompression;
+    int mPredictor;
+    bool mTiled;
+    size_t mBlockWidth, mBlockHeight; ///< size of tiles (or width and rows per strip)
+    std::vector<uint64_t> mOffsets;
+    std::vector<uint64_t> mByteCounts;
+    double mXLeft, mYTop, mCellsize;
+    bool mHasNoData;
+    double mNoData;
+};
+
+#endif // TIFFREADER_H
@@ -189,7 +189,13 @@ void ModelController::finishedStep(int n)
     mCurrentStep++;
     mIsCurrentlyRunning = false;
     if (mCurrentStep >= mYearsToRun) {
-        // finished
+        // finished: make sure that all outputs are written to disk
+        try {
+            if (Model::hasInstance() && Model::instance()->outputManager())
+                Model::instance()->outputManager()->flush();
+        } catch (const std::exception &e) {
+            log(QString("Error while writing outputs: %1").arg(e.what()));
+        }
         log(QString("Finished!"));
         RunState::instance()->modelState()=ModelRunState::Finished;
         emit finished();
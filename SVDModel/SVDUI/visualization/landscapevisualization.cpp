@@ -30,6 +30,7 @@
 #include "tools.h"
 
 #include <QPainter>
+#include <algorithm>
 
 LandscapeVisualization::LandscapeVisualization(QObject *parent): QObject(parent)
 {
@@ -276,16 +277,20 @@ void LandscapeVisualization::doRenderExpression(bool auto_scale)
     double min_value = 0.;
     double max_value = 1000.; // defaults
 
+    // evaluate the expression for all cells (batch mode)
+    std::vector<int> cells;
+    for (int i=0;i<grid.count();++i)
+        if (!grid[i].isNull())
+            cells.push_back(i);
+    std::vector<double> values(cells.size());
+    mExpression.calculateBatch(cw, cells.size(), [&cw, &grid, &cells](size_t i) { cw.setData(&grid[cells[i]]); }, values.data());
+
     if (auto_scale) {
         min_value = std::numeric_limits<double>::max();
         max_value = std::numeric_limits<double>::min();
-        for (Cell &c : grid) {
-            if (!c.isNull()) {
-                cw.setData(&c);
-                value = mExpression.calculate(cw);
-                min_value = std::min(min_value, value);
-                max_value = std::max(max_value, value);
-            }
+        for (double v : values) {
+            min_value = std::min(min_value, v);
+            max_value = std::max(max_value, v);
         }
     }
     mLegend->setAbsoluteValueRange(min_value, max_value);
@@ -297,12 +302,15 @@ void LandscapeVisualization::doRenderExpression(bool auto_scale)
     const uchar *cline = mRenderTexture.scanLine(0);
     QRgb* line = reinterpret_cast<QRgb*>(const_cast<uchar*>(cline)); // write directly to the buffer (without a potential detach)
 
+    // cells are stored in the order of the grid: find the value of a cell by its index
+    std::vector<int>::const_iterator cell_it;
     for (int y = grid.sizeY()-1; y>=0; --y) {
+        cell_it = std::lower_bound(cells.cbegin(), cells.cend(), grid.index(0, y));
         for (int x=0; x<grid.sizeX(); ++x, ++line) {
             const Cell &c = grid(x,y);
             if (!c.isNull()) {
-                cw.setData(&c);
-                value = mExpression.calculate(cw);
+                value = values[static_cast<size_t>(cell_it - cells.cbegin())];
+                ++cell_it;
                 *line = alpha & pal->color(value);
             } else {
                 *line = fill_color;